@@ -4,16 +4,26 @@
  * @author Dennis J. McWherter, Jr.
  */
 #include <iostream>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <fstream>
+#include <limits>
+#include <map>
 #include <utility>
 #include <vector>
 
 #include "AnalyzeData.h"
 #include "DCException.h"
 #include "DCUtil.h"
+#include "GramMatrix.h"
+#include "KendallTau.h"
+#include "Kernels.h"
 #include "ParserBase.h"
+#include "Ranker.h"
+#include "StreamStats.h"
+#include "ThreadPool.h"
+#include "TileScanner.h"
 
 // Use boost lib for GraphML writing
 #include <boost/graph/graphml.hpp>
@@ -27,6 +37,160 @@ typedef adjacency_list<vecS, vecS, undirectedS,
   property<vertex_color_t, string>,
   property<edge_weight_t, int> > Graph;
 
+#define MATRIX_PANEL (16 * TILE_VALUES) // Rows of every key standardized at a time for the correlation matrix
+
+/**
+ * Reads the values of a key a chunk at a time from any position, whatever
+ * its tiles look like
+ */
+class ChunkReader
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param parser  Parser holding the values
+   * @param id      Id of the key to read
+   * @param first   Index of the first value to read
+   */
+  ChunkReader(const ParserBase& parser, int id, size_t first)
+    : parser(parser), id(id), tile(0), pos(0), buffer(TILE_VALUES), chunk(TILE_VALUES)
+  {
+    // Skip the tiles before first without unpacking them
+    size_t size;
+    while((size = parser.getTileSize(id, tile)) > 0 && size <= first) {
+      first -= size;
+      ++tile;
+    }
+    values = parser.getTile(id, tile, &buffer[0]);
+    pos = first;
+  }
+
+  /**
+   * Read the next values
+   *
+   * NOTE: The values are only valid until the next call
+   *
+   * @param n     Number of values to read (at most TILE_VALUES)
+   * @param vals  Receives the values (in the tile itself if it holds all of them)
+   * @return  Number of values read (fewer than n past the last value)
+   */
+  size_t read(size_t n, const double*& vals)
+  {
+    if(values.size() - pos >= n) {
+      vals = values.data() + pos;
+      pos += n;
+      return n;
+    }
+
+    // The values span tiles, so gather them
+    size_t got = 0;
+    while(got < n && !values.empty()) {
+      size_t count = min(n - got, values.size() - pos);
+      copy(values.data() + pos, values.data() + pos + count, chunk.begin() + got);
+      got += count;
+      pos += count;
+      if(pos == values.size()) {
+        values = parser.getTile(id, ++tile, &buffer[0]);
+        pos = 0;
+      }
+    }
+    vals = &chunk[0];
+    return got;
+  }
+
+private:
+  const ParserBase& parser;
+  int id;
+  size_t tile;          // Tile being read
+  GridView values;      // Its values
+  size_t pos;           // Next value in it
+  vector<double> buffer; // Room to unpack a tile
+  vector<double> chunk;  // Values gathered across tiles
+};
+
+/**
+ * Takes the co-moments of a run of chunks of one key against its partners
+ * on a pool thread
+ */
+class PearsonTask : public Task
+{
+public:
+  PearsonTask(const ParserBase& parser, int id, const vector<int>& partners, const vector<size_t>& counts,
+              vector<vector<CoMoments> >& chunks, size_t first, size_t last)
+    : parser(parser), id(id), partners(partners), counts(counts), chunks(chunks), first(first), last(last)
+  {
+  }
+
+  virtual void run()
+  {
+    size_t start = first * TILE_VALUES;
+    ChunkReader x(parser, id, start);
+    vector<ChunkReader*> ys;
+    for(size_t p = 0 ; p < partners.size() ; ++p)
+      ys.push_back(new ChunkReader(parser, partners[p], start));
+
+    // Each chunk of the key is read once for all of its partners
+    for(size_t c = first ; c < last ; ++c) {
+      const double* xv;
+      size_t n = x.read(TILE_VALUES, xv);
+      for(size_t p = 0 ; p < partners.size() ; ++p) {
+        if(c >= chunks[p].size())
+          continue;
+        const double* yv;
+        size_t count = min(static_cast<size_t>(TILE_VALUES), counts[p] - c * TILE_VALUES);
+        assert(count <= n);
+        count = ys[p]->read(count, yv);
+        chunks[p][c].set(xv, yv, count);
+      }
+    }
+
+    for(size_t p = 0 ; p < ys.size() ; ++p)
+      delete ys[p];
+  }
+
+  const ParserBase& parser;
+  int id;
+  const vector<int>& partners;
+  const vector<size_t>& counts;          // Pairs to correlate with each partner
+  vector<vector<CoMoments> >& chunks;    // Co-moments of each chunk with each partner
+  size_t first, last;                    // Chunks to take
+};
+
+/**
+ * Standardizes one thread's keys for a panel of rows of the correlation matrix
+ */
+class StandardizeTask : public Task
+{
+public:
+  StandardizeTask(const vector<ChunkReader*>& readers, const vector<double>& means, const vector<double>& scales,
+                  vector<double>& panel, size_t stride, size_t first, size_t last)
+    : readers(readers), means(means), scales(scales), panel(panel), stride(stride), rows(0), first(first), last(last)
+  {
+  }
+
+  virtual void run()
+  {
+    for(size_t k = first ; k < last ; ++k) {
+      double* out = &panel[k * stride];
+      for(size_t start = 0 ; start < rows ; start += TILE_VALUES) {
+        const double* vals;
+        size_t n = readers[k]->read(min(static_cast<size_t>(TILE_VALUES), rows - start), vals);
+        for(size_t i = 0 ; i < n ; ++i)
+          out[start + i] = (vals[i] - means[k]) * scales[k];
+      }
+    }
+  }
+
+  const vector<ChunkReader*>& readers;  // Next rows of each key
+  const vector<double>& means;
+  const vector<double>& scales;         // 1 / sqrt(sum of squared deviations) of each key
+  vector<double>& panel;                // Rows of each key, stride apart
+  size_t stride;
+  size_t rows;                          // Rows in this panel
+  size_t first, last;                   // Keys to take
+};
+
 /** Static methods */
 /**
  * Compute the norm between to vectors (presumably these are grids)
@@ -41,18 +205,92 @@ double AnalyzeData::computeNorm(const vector<double>& x, const vector<double>& y
 {
   assert(x.size() == y.size()); // grep: Should this be a hard assert or should I simply return NaN?
 
-  double ret = 0.f;
-  double tmp = 0.f;
-  
   // Norm eq:
   // sqrt(Sum for all i of (x_i - y_i)^2)
-  for(unsigned i = 0 ; i < x.size() ; ++i) {
-    tmp  = x[i] - y[i];
-    tmp *= tmp;
-    ret += tmp;
+  LaneSums ret;
+  if(!x.empty())
+    Kernels::sumSquaredDiffs(ret, &x[0], &y[0], x.size());
+
+  return sqrt(ret.total());
+}
+
+/**
+ * Compute the norm between two grids sent in single precision
+ *
+ * NOTE: The differences are summed in double precision
+ *
+ * @param x   The first set of values
+ * @param y   The second set of values
+ * @return  The 2-norm between the sets
+ */
+double AnalyzeData::computeNorm(const vector<float>& x, const vector<float>& y)
+{
+  assert(x.size() == y.size());
+
+  LaneSums ret;
+  if(!x.empty())
+    Kernels::sumSquaredDiffs(ret, &x[0], &y[0], x.size());
+
+  return sqrt(ret.total());
+}
+
+/**
+ * Compute the norm between two grids either of which may hold only its
+ * nonzero values, walking both in cell order (cells missing from one are zero)
+ *
+ * @param x       The first set of values
+ * @param xCells  Cell of each value of x (empty if x holds every value)
+ * @param y       The second set of values
+ * @param yCells  Cell of each value of y (empty if y holds every value)
+ * @return  The 2-norm between the sets
+ */
+template<typename T>
+static double sparseNorm(const vector<T>& x, const vector<unsigned>& xCells, const vector<T>& y, const vector<unsigned>& yCells)
+{
+  // Each square goes into the partial sum of its cell, as it would densely
+  const size_t none = static_cast<size_t>(-1);
+  LaneSums ret;
+  size_t i = 0, j = 0;
+  while(i < x.size() || j < y.size()) {
+    size_t xc = (i == x.size()) ? none : xCells.empty() ? i : xCells[i];
+    size_t yc = (j == y.size()) ? none : yCells.empty() ? j : yCells[j];
+    double tmp;
+    if(xc == yc)
+      tmp = static_cast<double>(x[i++]) - y[j++];
+    else if(xc < yc)
+      tmp = x[i++];
+    else
+      tmp = -static_cast<double>(y[j++]);
+    ret.addAt(min(xc, yc), tmp * tmp);
   }
 
-  return sqrt(ret);
+  return sqrt(ret.total());
+}
+
+/**
+ * Compute the norm between two grids either of which may hold only its
+ * nonzero values
+ *
+ * @param x       The first set of values
+ * @param xCells  Cell of each value of x (empty if x holds every value)
+ * @param y       The second set of values
+ * @param yCells  Cell of each value of y (empty if y holds every value)
+ * @return  The 2-norm between the sets
+ */
+double AnalyzeData::computeNorm(const vector<double>& x, const vector<unsigned>& xCells,
+                                const vector<double>& y, const vector<unsigned>& yCells)
+{
+  if(xCells.empty() && yCells.empty())
+    return computeNorm(x, y);
+  return sparseNorm(x, xCells, y, yCells);
+}
+
+double AnalyzeData::computeNorm(const vector<float>& x, const vector<unsigned>& xCells,
+                                const vector<float>& y, const vector<unsigned>& yCells)
+{
+  if(xCells.empty() && yCells.empty())
+    return computeNorm(x, y);
+  return sparseNorm(x, xCells, y, yCells);
 }
 
 /** Public methods */
@@ -79,14 +317,21 @@ AnalyzeData::AnalyzeData(ParserBase& parser)
  */
 double AnalyzeData::mean(const std::string& key, size_t n) const
 {
-  double ret = 0.f;
+  return mean(data.getKeyId(key), n);
+}
 
-  vector<double> vals(data.getAllValues(key));
-  size_t max = vals.size();
+/**
+ * Retrieve simple average
+ *
+ * @param id    Id of the key to analyze
+ * @param n     Sample size (default=0 all values)
+ * @return  The mean of the key for the given sample size
+ */
+double AnalyzeData::mean(int id, size_t n) const
+{
+  double ret = 0.f;
 
-  n = (n < 1 || n > max) ? max : n;
-  
-  ret = sum(key, n);
+  n = sum(id, n, ret);
 
   // Mean is (Sum of all elements) / Number of Elements [or sample of elements summed together]
   ret /= n;
@@ -103,24 +348,21 @@ double AnalyzeData::mean(const std::string& key, size_t n) const
  */
 double AnalyzeData::variance(const string& key, size_t n) const
 {
-  double ret = 0;
-  double mval = mean(key, n);
-
-  vector<double> vals(data.getAllValues(key));
-  size_t max = vals.size();
-
-  n = (n == 0 || n > max) ? max : n;
-
-  // Expected value calculation for (x^2)
-  for(size_t i = 0 ; i < n ; ++i)
-    ret += (vals[i] * vals[i]);
-  ret /= n;
-
-  // At this point ret = E(x^2)
-  // variance = E(x^2) - (E(x))^2
-  ret -= (mval * mval);
+  return variance(data.getKeyId(key), n);
+}
 
-  return ret;
+/**
+ * Retrieve simple variance
+ *
+ * @param id    Id of the key to analyze
+ * @param n     Sample size (default=0 means all values)
+ * @return  Return the variance for the provided sample size
+ */
+double AnalyzeData::variance(int id, size_t n) const
+{
+  RunningStats stats;
+  summarize(id, stats, n);
+  return stats.variance();
 }
 
 /**
@@ -131,9 +373,21 @@ double AnalyzeData::variance(const string& key, size_t n) const
  * @return  The standard deviation of the key for the given sample size
  */
 double AnalyzeData::stddev(const string& key, size_t n) const
+{
+  return stddev(data.getKeyId(key), n);
+}
+
+/**
+ * Retrieve simple standard deviation
+ *
+ * @param id    Id of the key to analyze
+ * @param n     Sample size (default=0 which means all values)
+ * @return  The standard deviation of the key for the given sample size
+ */
+double AnalyzeData::stddev(int id, size_t n) const
 {
   double ret = 0;
-  double var = variance(key, n);
+  double var = variance(id, n);
 
   // stddev = sqrt(variance)
   ret = sqrt(var);
@@ -150,8 +404,51 @@ double AnalyzeData::stddev(const string& key, size_t n) const
  */
 double AnalyzeData::sum(const string& key, size_t n) const
 {
-  vector<double> vals(data.getAllValues(key));
-  return sum(vals, n);
+  return sum(data.getKeyId(key), n);
+}
+
+/**
+ * Compute the sum of a key
+ *
+ * @param id    Id of the key to compute sum for
+ * @param n     How many elements to sum (default=0 which is all elements)
+ * @return  Sum of the values for the key
+ */
+double AnalyzeData::sum(int id, size_t n) const
+{
+  double ret = 0.f;
+  sum(id, n, ret);
+  return ret;
+}
+
+/**
+ * Compute the sum, mean, variance, standard deviation, minimum and
+ * maximum of a key in one pass over its values
+ *
+ * @param id      Id of the key to analyze
+ * @param stats   Receives the statistics (should be empty)
+ * @param n       Sample size (default=0 which means all values)
+ */
+void AnalyzeData::summarize(int id, RunningStats& stats, size_t n) const
+{
+  TileScanner tiles(data, id);
+  SparseTile tile;
+  double dense[TILE_VALUES];
+  size_t seen = 0;
+  while((n == 0 || seen < n) && tiles.next(tile)) {
+    size_t count = (n == 0 || n - seen > tile.size) ? tile.size : n - seen;
+    const GridView& vals = tile.values;
+    if(tile.sparse()) {
+      // Zero cells count towards the minimum, maximum and variance, so fill them in
+      fill(dense, dense + count, 0.0);
+      for(size_t i = 0 ; i < vals.size() && tile.cells[i] < count ; ++i)
+        dense[tile.cells[i]] = vals[i];
+      stats.add(dense, count);
+    } else {
+      stats.add(vals.data(), count);
+    }
+    seen += count;
+  }
 }
 
 /**
@@ -163,42 +460,73 @@ double AnalyzeData::sum(const string& key, size_t n) const
  */
 double AnalyzeData::pearsons(const string& key1, const string& key2) const
 {
-  vector<double> xv(data.getAllValues(key1)),
-    xsq(data.getAllValues(key1)),
-    ysq(data.getAllValues(key2));
+  return pearsons(data.getKeyId(key1), data.getKeyId(key2));
+}
 
-  vector<double> tmp(data.getAllValues(key2));
+/**
+ * Compute Pearson's Correlation Coefficient
+ *
+ * @param id1   Id of the first key to analyze
+ * @param id2   Id of the second key to analyze
+ * @return  Result of pearon's coefficient between two keys
+ */
+double AnalyzeData::pearsons(int id1, int id2) const
+{
+  vector<int> partners(1, id2);
+  vector<double> ret;
+  pearsons(id1, partners, ret);
+  return ret[0];
+}
 
+/**
+ * Compute Pearson's Correlation Coefficient of one key against several
+ * others in a single pass over its values
+ *
+ * @param id        Id of the key to analyze
+ * @param partners  Ids of the keys to correlate it with
+ * @param ret       Receives the coefficient with each partner, in order
+ * @param threads   Threads to split the values over (0 = one per hardware thread)
+ */
+void AnalyzeData::pearsons(int id, const vector<int>& partners, vector<double>& ret, unsigned threads) const
+{
   // It is possible to correlate two fields with different sample sizes
   // so let's compare against the smaller of the two.
-  size_t n = (xv.size() < tmp.size()) ? xv.size() : tmp.size(); // Sample size
-
-  assert(n != 0);
-
-  vector<double> xy;
-  for(size_t i = 0 ; i < n ; ++i)
-    xy.push_back(xv[i]); // Get our sample size of x-vals
-
   // TODO: Should we pick randomly to correlate or just take the first n items of each?
-  for(size_t i = 0 ; i < n ; ++i) {
-    // Do all calculations - assume all are same size by
-    // previous assertion
-    xy[i]  *= tmp[i];
-    ysq[i] *= ysq[i];
-    xsq[i] *= xsq[i];
+  size_t size = count(id);
+  size_t chunkCount = 0;
+  vector<size_t> counts;
+  vector<vector<CoMoments> > chunks(partners.size());
+  for(size_t p = 0 ; p < partners.size() ; ++p) {
+    counts.push_back(min(size, count(partners[p])));
+    assert(counts.back() != 0);
+    chunks[p].resize((counts.back() + TILE_VALUES - 1) / TILE_VALUES);
+    chunkCount = max(chunkCount, chunks[p].size());
   }
 
-  // Variables used in calculation
-  double sX   = sum(key1, n);
-  double sY   = sum(key2, n);
-  double sXY  = sum(xy);
-  double sXsq = sum(xsq);
-  double sYsq = sum(ysq);
+  // Every thread takes a run of chunks; the co-moments of each chunk are
+  // merged in order afterwards, so the threads do not change the result
+  unsigned workers = ThreadPool::resolve(threads, chunkCount);
+  vector<PearsonTask*> tasks;
+  vector<Task*> work;
+  for(unsigned w = 0 ; w < workers ; ++w) {
+    size_t first = chunkCount * w / workers;
+    size_t last = chunkCount * (w + 1) / workers;
+    tasks.push_back(new PearsonTask(data, id, partners, counts, chunks, first, last));
+    work.push_back(tasks.back());
+  }
 
-  double numer = ((n * sXY) - (sX * sY)); // Numerator
-  double denom = sqrt((((n * sXsq) - (sX * sX)) * ((n * sYsq) - (sY * sY)))); // Denominator
+  if(workers > 1) {
+    ThreadPool pool(workers);
+    pool.run(work);
+  } else if(!tasks.empty()) {
+    tasks[0]->run();
+  }
+  for(size_t i = 0 ; i < tasks.size() ; ++i)
+    delete tasks[i];
 
-  return (numer / denom);
+  ret.clear();
+  for(size_t p = 0 ; p < partners.size() ; ++p)
+    ret.push_back(CoMoments::total(chunks[p]).pearson());
 }
 
 /**
@@ -210,8 +538,120 @@ double AnalyzeData::pearsons(const string& key1, const string& key2) const
  */
 double AnalyzeData::spearmans(const string& key1, const string& key2) const
 {
-  // TODO: Implement
-  return 0.f;
+  return spearmans(data.getKeyId(key1), data.getKeyId(key2));
+}
+
+/**
+ * Compute Spearman's Coefficient
+ *
+ * @param id1   Id of the first key to analyze
+ * @param id2   Id of the second key to analyze
+ * @return  Resulting Spearman's coefficient
+ */
+double AnalyzeData::spearmans(int id1, int id2) const
+{
+  vector<int> partners(1, id2);
+  vector<double> ret;
+  spearmans(id1, partners, ret);
+  return ret[0];
+}
+
+/**
+ * Compute Spearman's Coefficient of one key against several others,
+ * ranking the key only once
+ *
+ * @param id        Id of the key to analyze
+ * @param partners  Ids of the keys to correlate it with
+ * @param ret       Receives the coefficient with each partner, in order
+ * @param threads   Threads to rank the values with (0 = one per hardware thread)
+ */
+void AnalyzeData::spearmans(int id, const vector<int>& partners, vector<double>& ret, unsigned threads) const
+{
+  // Pairs are correlated up to the shorter key, as with pearsons()
+  size_t size = count(id);
+  vector<double> ranks, partnerRanks, truncated;
+  ret.clear();
+  for(size_t p = 0 ; p < partners.size() ; ++p) {
+    size_t n = min(size, count(partners[p]));
+    assert(n != 0);
+
+    // The key is only ranked again when a partner is shorter
+    const vector<double>* xRanks = &ranks;
+    if(n == size) {
+      if(ranks.empty())
+        rank(id, n, ranks, threads);
+    } else {
+      rank(id, n, truncated, threads);
+      xRanks = &truncated;
+    }
+    rank(partners[p], n, partnerRanks, threads);
+
+    // Pearson's coefficient of the ranks
+    vector<CoMoments> chunks((n + TILE_VALUES - 1) / TILE_VALUES);
+    for(size_t c = 0 ; c < chunks.size() ; ++c) {
+      size_t start = c * TILE_VALUES;
+      chunks[c].set(&(*xRanks)[start], &partnerRanks[start], min(static_cast<size_t>(TILE_VALUES), n - start));
+    }
+    ret.push_back(CoMoments::total(chunks).pearson());
+  }
+}
+
+/**
+ * Compute Kendall's tau-b
+ *
+ * @param key1  First key to analyze
+ * @param key2  Second key to analyze
+ * @return  Resulting Kendall's coefficient
+ */
+double AnalyzeData::kendalls(const string& key1, const string& key2) const
+{
+  return kendalls(data.getKeyId(key1), data.getKeyId(key2));
+}
+
+/**
+ * Compute Kendall's tau-b
+ *
+ * @param id1   Id of the first key to analyze
+ * @param id2   Id of the second key to analyze
+ * @return  Resulting Kendall's coefficient
+ */
+double AnalyzeData::kendalls(int id1, int id2) const
+{
+  vector<int> partners(1, id2);
+  vector<double> ret;
+  kendalls(id1, partners, ret);
+  return ret[0];
+}
+
+/**
+ * Compute Kendall's tau-b of one key against several others
+ *
+ * @param id        Id of the key to analyze
+ * @param partners  Ids of the keys to correlate it with
+ * @param ret       Receives the coefficient with each partner, in order
+ * @param threads   Threads to sort the pairs with (0 = one per hardware thread)
+ */
+void AnalyzeData::kendalls(int id, const vector<int>& partners, vector<double>& ret, unsigned threads) const
+{
+  size_t size = count(id);
+  ret.clear();
+  for(size_t p = 0 ; p < partners.size() ; ++p) {
+    size_t n = min(size, count(partners[p]));
+    assert(n != 0);
+
+    KendallTau tau(n);
+    ChunkReader x(data, id, 0);
+    ChunkReader y(data, partners[p], 0);
+    for(size_t start = 0 ; start < n ; start += TILE_VALUES) {
+      const double* xVals;
+      const double* yVals;
+      size_t len = min(static_cast<size_t>(TILE_VALUES), n - start);
+      x.read(len, xVals);
+      y.read(len, yVals);
+      tau.add(xVals, yVals, len);
+    }
+    ret.push_back(tau.compute(threads));
+  }
 }
 
 /**
@@ -224,15 +664,52 @@ double AnalyzeData::spearmans(const string& key1, const string& key2) const
  */
 vector<pair<double, Coord3D> > AnalyzeData::filter(const string& key, double lower, double upper) const
 {
-  vector<double> vals(data.getAllValues(key));
+  TileScanner tiles(data, data.getKeyId(key));
+  SparseTile tile;
+  unsigned first = 0; // Index of the tile's first value in the grid
   vector<pair<double, Coord3D> > ret;
+  bool zeros = (lower <= 0.0 && upper >= 0.0); // True if zero cells pass the filter
 
   // Generate our filtered list
-  for(unsigned i = 0 ; i < vals.size() ; ++i) {
-    if(vals[i] >= lower && vals[i] <= upper) {
-      Coord3D coord(data.getCoordinate(i));
-      ret.push_back(pair<double, Coord3D>(vals[i], coord));
+  while(tiles.next(tile)) {
+    const GridView& vals = tile.values;
+    // Skip tiles with nothing in range (the zero cells of a sparse tile are not in vals)
+    double lo, hi;
+    Kernels::minMax(vals.data(), vals.size(), lo, hi);
+    if((hi < lower || lo > upper) && !(tile.sparse() && zeros)) {
+      first += static_cast<unsigned>(tile.size);
+      continue;
     }
+
+    if(!tile.sparse()) {
+      for(unsigned i = 0 ; i < vals.size() ; ++i) {
+        if(vals[i] >= lower && vals[i] <= upper) {
+          Coord3D coord(data.getCoordinate(first + i));
+          ret.push_back(pair<double, Coord3D>(vals[i], coord));
+        }
+      }
+    } else if(!zeros) {
+      // Only the nonzero values can pass
+      for(size_t i = 0 ; i < vals.size() ; ++i) {
+        if(vals[i] >= lower && vals[i] <= upper) {
+          Coord3D coord(data.getCoordinate(first + tile.cells[i]));
+          ret.push_back(pair<double, Coord3D>(vals[i], coord));
+        }
+      }
+    } else {
+      // Every cell is visited in order, zero unless it is the next nonzero one
+      size_t next = 0;
+      for(unsigned i = 0 ; i < tile.size ; ++i) {
+        double val = 0.0;
+        if(next < vals.size() && tile.cells[next] == i)
+          val = vals[next++];
+        if(val >= lower && val <= upper) {
+          Coord3D coord(data.getCoordinate(first + i));
+          ret.push_back(pair<double, Coord3D>(val, coord));
+        }
+      }
+    }
+    first += static_cast<unsigned>(tile.size);
   }
 
   return ret;
@@ -306,25 +783,246 @@ string AnalyzeData::getConnectivityGraph(const string& key, double lower, double
   return filename;
 }
 
+/**
+ * Compute Pearson's Correlation Coefficient of every pair of several keys
+ *
+ * @param ids       Ids of the keys
+ * @param ret       Receives the coefficients, a row per key in the order of ids
+ * @param threads   Threads to compute them with (0 = one per hardware thread)
+ * @return  Number of values of each key correlated (keys with any other number are NaN)
+ */
+size_t AnalyzeData::correlationMatrix(const vector<int>& ids, vector<double>& ret, unsigned threads) const
+{
+  size_t all = ids.size();
+  ret.assign(all * all, numeric_limits<double>::quiet_NaN());
+
+  // The matrix needs the same rows of every key, so a key with more or fewer
+  // values than most of them (e.g. a snapshot cut short) is left out rather
+  // than cutting every other key down to it
+  size_t n = commonCount(ids);
+  vector<size_t> slots; // Where each key used is in ids
+  for(size_t k = 0 ; k < all ; ++k) {
+    if(count(ids[k]) == n)
+      slots.push_back(k);
+  }
+  size_t keys = slots.size();
+  if(n == 0)
+    return 0;
+
+  // Each key is standardized once, so that the sum of the products of
+  // two keys is their coefficient
+  vector<double> means(keys), scales(keys);
+  for(size_t k = 0 ; k < keys ; ++k) {
+    RunningStats stats;
+    summarize(ids[slots[k]], stats, n);
+    double m2 = stats.variance() * static_cast<double>(n);
+    means[k] = stats.mean();
+    scales[k] = (m2 > 0.0) ? 1.0 / sqrt(m2) : 0.0;
+  }
+
+  // A panel of rows of every key at a time
+  size_t stride = min(n, static_cast<size_t>(MATRIX_PANEL));
+  vector<double> panel(keys * stride);
+  vector<const double*> cols;
+  vector<ChunkReader*> readers;
+  for(size_t k = 0 ; k < keys ; ++k) {
+    cols.push_back(&panel[k * stride]);
+    readers.push_back(new ChunkReader(data, ids[slots[k]], 0));
+  }
+
+  unsigned workers = ThreadPool::resolve(threads, keys);
+  ThreadPool pool(workers);
+  vector<StandardizeTask*> tasks;
+  vector<Task*> work;
+  for(unsigned w = 0 ; w < workers ; ++w) {
+    tasks.push_back(new StandardizeTask(readers, means, scales, panel, stride, keys * w / workers, keys * (w + 1) / workers));
+    work.push_back(tasks.back());
+  }
+
+  GramMatrix gram(keys);
+  for(size_t start = 0 ; start < n ; start += stride) {
+    size_t rows = min(stride, n - start);
+    for(size_t i = 0 ; i < tasks.size() ; ++i)
+      tasks[i]->rows = rows;
+    pool.run(work);
+    gram.add(cols, rows, pool);
+  }
+
+  for(size_t i = 0 ; i < tasks.size() ; ++i)
+    delete tasks[i];
+  for(size_t k = 0 ; k < keys ; ++k)
+    delete readers[k];
+
+  for(size_t a = 0 ; a < keys ; ++a) {
+    for(size_t b = 0 ; b < keys ; ++b) {
+      if(scales[a] > 0.0 && scales[b] > 0.0)
+        ret[slots[a] * all + slots[b]] = (a == b) ? 1.0 : gram.get(a, b);
+    }
+  }
+
+  return n;
+}
+
+/**
+ * Write out the correlation matrix of several keys
+ *
+ * NOTE: Keys with more or fewer values than most of them are left out of the file
+ *
+ * @param keys      Keys to correlate
+ * @param binary    Write the key count, the number of rows, the null-terminated keys and
+ *                  then the rows of doubles instead of a CSV file
+ * @param addtl     Optional parameter for specifying an extra identifier onto the filename (i.e. run number)
+ * @param threads   Threads to compute it with (0 = one per hardware thread)
+ * @param omitted   If given, receives the keys left out
+ * @return  The file name of the resultant matrix file
+ */
+string AnalyzeData::getCorrelationMatrix(const vector<string>& keys, bool binary, string addtl, unsigned threads,
+                                         vector<string>* omitted) const
+{
+  string filename("CorrelationMatrix");
+  filename.append(addtl);
+  filename.append(binary ? ".bin" : ".csv");
+
+  vector<int> ids;
+  for(size_t k = 0 ; k < keys.size() ; ++k)
+    ids.push_back(data.getKeyId(keys[k]));
+  vector<double> matrix;
+  size_t rows = correlationMatrix(ids, matrix, threads);
+
+  // Only the keys that were correlated over those rows are written
+  vector<size_t> kept;
+  for(size_t k = 0 ; k < keys.size() ; ++k) {
+    if(count(ids[k]) == rows)
+      kept.push_back(k);
+    else if(omitted != NULL)
+      omitted->push_back(keys[k]);
+  }
+
+  if(binary) {
+    ofstream out(filename.c_str(), ios::out | ios::binary);
+    unsigned count = static_cast<unsigned>(kept.size());
+    unsigned long long used = rows;
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(&used), sizeof(used));
+    for(size_t k = 0 ; k < kept.size() ; ++k)
+      out.write(keys[kept[k]].c_str(), keys[kept[k]].size() + 1);
+    for(size_t a = 0 ; a < kept.size() ; ++a) {
+      for(size_t b = 0 ; b < kept.size() ; ++b)
+        out.write(reinterpret_cast<const char*>(&matrix[kept[a] * keys.size() + kept[b]]), sizeof(double));
+    }
+    out.close();
+  } else {
+    ofstream out(filename.c_str());
+    out<< "Rows:," << rows << endl;
+    out<< "Parameter";
+    for(size_t k = 0 ; k < kept.size() ; ++k)
+      out<< "," << keys[kept[k]];
+    out<< endl;
+    for(size_t a = 0 ; a < kept.size() ; ++a) {
+      out<< keys[kept[a]];
+      for(size_t b = 0 ; b < kept.size() ; ++b) {
+        double val = matrix[kept[a] * keys.size() + kept[b]];
+        if(val != val)
+          out<< ",NA";
+        else
+          out<< "," << val;
+      }
+      out<< endl;
+    }
+    out.close();
+  }
+
+  return filename;
+}
+
 /** Private methods */
 
 /**
- * Sum the subset of values in a vector
+ * Count the values of a key without unpacking them
  *
- * @param vec   The vector to sum up
- * @param n     Number of elements to sum (if n = 0, then sum everything)
- * @return  The sum of the first n elements in vec
+ * @param id    Id of the key
+ * @return  Number of values
  */
-double AnalyzeData::sum(const vector<double>& vec, size_t n) const
+size_t AnalyzeData::count(int id) const
 {
-  double ret = 0.f;
-  size_t max = vec.size();
-  n = (n == 0 || n > max) ? max : n;
-  for(size_t i = 0 ; i < n ; ++i)
-    ret += vec[i];
+  size_t ret = 0, size;
+  for(size_t tile = 0 ; (size = data.getTileSize(id, tile)) > 0 ; ++tile)
+    ret += size;
+  return ret;
+}
+
+/**
+ * Get the number of values most of several keys have
+ *
+ * @param ids   Ids of the keys
+ * @return  Number of values (the larger on a tie, 0 if there are no keys)
+ */
+size_t AnalyzeData::commonCount(const vector<int>& ids) const
+{
+  map<size_t, size_t> keys; // Keys with each number of values
+  for(size_t k = 0 ; k < ids.size() ; ++k)
+    keys[count(ids[k])]++;
+
+  size_t ret = 0, most = 0;
+  map<size_t, size_t>::const_iterator it;
+  for(it = keys.begin() ; it != keys.end() ; ++it) {
+    if(it->second >= most) {
+      ret = it->first;
+      most = it->second;
+    }
+  }
   return ret;
 }
 
+/**
+ * Rank the first values of a key (see Ranker)
+ *
+ * @param id        Id of the key
+ * @param n         Number of values to rank
+ * @param ranks     Receives the rank of each value
+ * @param threads   Threads to rank them with (0 = one per hardware thread)
+ */
+void AnalyzeData::rank(int id, size_t n, vector<double>& ranks, unsigned threads) const
+{
+  Ranker ranker(n);
+  TileScanner tiles(data, id);
+  GridView tile;
+  while(ranker.size() < n && tiles.next(tile))
+    ranker.add(tile.data(), min(tile.size(), n - ranker.size()));
+  ranker.rank(ranks, threads);
+}
+
+/**
+ * Sum the subset of values of a key, a tile at a time
+ *
+ * @param id    Id of the key to sum up
+ * @param n     Number of elements to sum (if n = 0, then sum everything)
+ * @param ret   The sum of the first n elements is added to this
+ * @return  Number of elements summed (fewer than n if the key has fewer)
+ */
+size_t AnalyzeData::sum(int id, size_t n, double& ret) const
+{
+  TileScanner tiles(data, id);
+  SparseTile tile;
+  LaneSums sums;
+  size_t seen = 0;
+  while((n == 0 || seen < n) && tiles.next(tile)) {
+    size_t count = (n == 0 || n - seen > tile.size) ? tile.size : n - seen;
+    const GridView& vals = tile.values;
+    if(tile.sparse()) {
+      // Only the nonzero values of the first count cells
+      for(size_t i = 0 ; i < vals.size() && tile.cells[i] < count ; ++i)
+        sums.addAt(tile.cells[i], vals[i]);
+      sums.skip(count);
+    } else {
+      Kernels::sum(sums, vals.data(), count);
+    }
+    seen += count;
+  }
+  ret += sums.total();
+  return seen;
+}
+
 /**
  * Write a VTK legacy file of a connected graph
  *
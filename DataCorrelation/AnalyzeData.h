@@ -15,8 +15,10 @@
 #include <vector>
 
 #include "Coord3D.h"
+#include "GridView.h"
 
 class ParserBase;
+struct RunningStats;
 
 typedef std::pair<int, int> Edge;
 
@@ -34,6 +36,32 @@ public: /** Static members */
    */
   static double computeNorm(const std::vector<double>& x, const std::vector<double>& y);
 
+  /**
+   * Compute the norm between two grids sent in single precision
+   *
+   * NOTE: The differences are summed in double precision
+   *
+   * @param x   The first set of values
+   * @param y   The second set of values
+   * @return  The 2-norm between the sets
+   */
+  static double computeNorm(const std::vector<float>& x, const std::vector<float>& y);
+
+  /**
+   * Compute the norm between two grids either of which may hold only its
+   * nonzero values
+   *
+   * @param x       The first set of values
+   * @param xCells  Cell of each value of x (empty if x holds every value)
+   * @param y       The second set of values
+   * @param yCells  Cell of each value of y (empty if y holds every value)
+   * @return  The 2-norm between the sets
+   */
+  static double computeNorm(const std::vector<double>& x, const std::vector<unsigned>& xCells,
+                            const std::vector<double>& y, const std::vector<unsigned>& yCells);
+  static double computeNorm(const std::vector<float>& x, const std::vector<unsigned>& xCells,
+                            const std::vector<float>& y, const std::vector<unsigned>& yCells);
+
 public: /** Public members */
   /**
    * Constructor
@@ -83,6 +111,16 @@ public: /** Public members */
    */
   virtual double sum(const std::string& key, size_t n=0) const;
 
+  /**
+   * Compute the sum, mean, variance, standard deviation, minimum and
+   * maximum of a key in one pass over its values
+   *
+   * @param id      Id of the key to analyze
+   * @param stats   Receives the statistics (should be empty)
+   * @param n       Sample size (default=0 which means all values)
+   */
+  virtual void summarize(int id, RunningStats& stats, size_t n=0) const;
+
   /**
    * Compute Pearson's Correlation Coefficient
    *
@@ -92,6 +130,28 @@ public: /** Public members */
    */
   virtual double pearsons(const std::string& key1, const std::string& key2) const;
 
+  /**
+   * The same statistics for keys already resolved to ids (see ParserBase::getKeyId())
+   */
+  virtual double mean(int id, size_t n=0) const;
+  virtual double variance(int id, size_t n=0) const;
+  virtual double stddev(int id, size_t n=0) const;
+  virtual double sum(int id, size_t n=0) const;
+  virtual double pearsons(int id1, int id2) const;
+
+  /**
+   * Compute Pearson's Correlation Coefficient of one key against several
+   * others in a single pass over its values
+   *
+   * NOTE: Each pair is correlated up to the shorter of the two keys
+   *
+   * @param id        Id of the key to analyze
+   * @param partners  Ids of the keys to correlate it with
+   * @param ret       Receives the coefficient with each partner, in order
+   * @param threads   Threads to split the values over (0 = one per hardware thread)
+   */
+  virtual void pearsons(int id, const std::vector<int>& partners, std::vector<double>& ret, unsigned threads=1) const;
+
   /**
    * Compute Spearman's Coefficient
    *
@@ -100,6 +160,59 @@ public: /** Public members */
    * @return  Resulting Spearman's coefficient
    */
   virtual double spearmans(const std::string& key1, const std::string& key2) const;
+  virtual double spearmans(int id1, int id2) const;
+
+  /**
+   * Compute Spearman's Coefficient of one key against several others,
+   * ranking the key only once
+   *
+   * NOTE: Each pair is correlated up to the shorter of the two keys. Equal
+   *       values share the average of their ranks.
+   *
+   * @param id        Id of the key to analyze
+   * @param partners  Ids of the keys to correlate it with
+   * @param ret       Receives the coefficient with each partner, in order
+   * @param threads   Threads to rank the values with (0 = one per hardware thread)
+   */
+  virtual void spearmans(int id, const std::vector<int>& partners, std::vector<double>& ret, unsigned threads=1) const;
+
+  /**
+   * Compute Kendall's tau-b
+   *
+   * @param key1  First key to analyze
+   * @param key2  Second key to analyze
+   * @return  Resulting Kendall's coefficient
+   */
+  virtual double kendalls(const std::string& key1, const std::string& key2) const;
+  virtual double kendalls(int id1, int id2) const;
+
+  /**
+   * Compute Kendall's tau-b of one key against several others (see KendallTau)
+   *
+   * NOTE: Each pair is correlated up to the shorter of the two keys
+   *
+   * @param id        Id of the key to analyze
+   * @param partners  Ids of the keys to correlate it with
+   * @param ret       Receives the coefficient with each partner, in order
+   * @param threads   Threads to sort the pairs with (0 = one per hardware thread)
+   */
+  virtual void kendalls(int id, const std::vector<int>& partners, std::vector<double>& ret, unsigned threads=1) const;
+
+  /**
+   * Compute Pearson's Correlation Coefficient of every pair of several keys
+   * (see GramMatrix)
+   *
+   * NOTE: Only keys with as many values as most of them are correlated, the
+   *       rest (e.g. a snapshot cut short) are NaN against every key rather than
+   *       cutting the others down to them. A key with the same value everywhere
+   *       is NaN against every key, itself included.
+   *
+   * @param ids       Ids of the keys
+   * @param ret       Receives the coefficients, a row per key in the order of ids
+   * @param threads   Threads to compute them with (0 = one per hardware thread)
+   * @return  Number of values of each key correlated (keys with any other number are NaN)
+   */
+  virtual size_t correlationMatrix(const std::vector<int>& ids, std::vector<double>& ret, unsigned threads=1) const;
 
   /**
    * Filter data between a given inclusive range (i.e. [lower, upper])
@@ -122,15 +235,58 @@ public: /** Public members */
    */
   virtual std::string getConnectivityGraph(const std::string& key, double lower=0.0, double upper=1.0, std::string addtl="") const;
 
+  /**
+   * Write out the correlation matrix of several keys
+   *
+   * NOTE: Keys with more or fewer values than most of them are left out of the file
+   *
+   * @param keys      Keys to correlate
+   * @param binary    Write the key count, the number of rows, the null-terminated keys and
+   *                  then the rows of doubles instead of a CSV file
+   * @param addtl     Optional parameter for specifying an extra identifier onto the filename (i.e. run number)
+   * @param threads   Threads to compute it with (0 = one per hardware thread)
+   * @param omitted   If given, receives the keys left out
+   * @return  The file name of the resultant matrix file
+   */
+  virtual std::string getCorrelationMatrix(const std::vector<std::string>& keys, bool binary=false, std::string addtl="",
+                                           unsigned threads=1, std::vector<std::string>* omitted=NULL) const;
+
 private:
   /**
-   * Sum the subset of values in a vector
+   * Count the values of a key without unpacking them
+   *
+   * @param id    Id of the key
+   * @return  Number of values
+   */
+  size_t count(int id) const;
+
+  /**
+   * Get the number of values most of several keys have
+   *
+   * @param ids   Ids of the keys
+   * @return  Number of values (the larger on a tie, 0 if there are no keys)
+   */
+  size_t commonCount(const std::vector<int>& ids) const;
+
+  /**
+   * Rank the first values of a key (see Ranker)
+   *
+   * @param id        Id of the key
+   * @param n         Number of values to rank
+   * @param ranks     Receives the rank of each value
+   * @param threads   Threads to rank them with (0 = one per hardware thread)
+   */
+  void rank(int id, size_t n, std::vector<double>& ranks, unsigned threads) const;
+
+  /**
+   * Sum the subset of values of a key, a tile at a time
    *
-   * @param vec   The vector to sum up
+   * @param id    Id of the key to sum up
    * @param n     Number of elements to sum (if n = 0, then sum everything)
-   * @return  The sum of the first n elements in vec
+   * @param ret   The sum of the first n elements is added to this
+   * @return  Number of elements summed (fewer than n if the key has fewer)
    */
-  virtual double sum(const std::vector<double>& vec, size_t n=0) const;
+  virtual size_t sum(int id, size_t n, double& ret) const;
 
   /**
    * Write a VTK legacy file of a connected graph
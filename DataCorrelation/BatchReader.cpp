@@ -0,0 +1,527 @@
+/**
+ * BatchReader.cpp
+ *
+ * Reads a set of files with many large reads in flight at once
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_IO_URING) && defined(__linux__)
+#define USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#include "BatchReader.h"
+#include "DCUtil.h"
+
+using namespace std;
+
+#ifdef USE_IO_URING
+/**
+ * The submission and completion queues shared with the kernel
+ */
+struct IoRing
+{
+  int fd;
+  void* sqMap;
+  void* cqMap;
+  size_t sqSize, cqSize, sqesSize;
+  unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+  unsigned *cqHead, *cqTail, *cqMask;
+  io_uring_sqe* sqes;
+  io_uring_cqe* cqes;
+  iovec vecs[BATCH_BUFFERS]; // Indexed like the buffers
+};
+
+/**
+ * Set up a ring (no liburing, just the system calls)
+ *
+ * @param entries   Reads that may be in flight at once
+ * @return  The ring, or NULL if io_uring is not available
+ */
+static IoRing* openRing(unsigned entries)
+{
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if(fd < 0)
+    return NULL; // Older kernel, or not allowed here
+
+  IoRing* ring = new IoRing;
+  ring->fd = fd;
+  ring->sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+  // Newer kernels map both queues at once
+  bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if(single)
+    ring->sqSize = ring->cqSize = max(ring->sqSize, ring->cqSize);
+
+  ring->sqMap = mmap(NULL, ring->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  ring->cqMap = single ? ring->sqMap
+    : mmap(NULL, ring->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  void* sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if(ring->sqMap == MAP_FAILED || ring->cqMap == MAP_FAILED || sqes == MAP_FAILED) {
+    if(sqes != MAP_FAILED)
+      munmap(sqes, ring->sqesSize);
+    if(!single && ring->cqMap != MAP_FAILED)
+      munmap(ring->cqMap, ring->cqSize);
+    if(ring->sqMap != MAP_FAILED)
+      munmap(ring->sqMap, ring->sqSize);
+    close(fd);
+    delete ring;
+    return NULL;
+  }
+
+  char* sq = static_cast<char*>(ring->sqMap);
+  char* cq = static_cast<char*>(ring->cqMap);
+  ring->sqHead  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  ring->sqTail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  ring->sqMask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  ring->cqHead  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  ring->cqTail  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  ring->cqMask  = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  ring->cqes    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  ring->sqes    = static_cast<io_uring_sqe*>(sqes);
+  return ring;
+}
+
+/**
+ * Tear a ring down
+ *
+ * @param ring  The ring
+ */
+static void closeRing(IoRing* ring)
+{
+  munmap(ring->sqes, ring->sqesSize);
+  if(ring->cqMap != ring->sqMap)
+    munmap(ring->cqMap, ring->cqSize);
+  munmap(ring->sqMap, ring->sqSize);
+  close(ring->fd);
+  delete ring;
+}
+
+/**
+ * Submit queued reads and/or wait for finished ones
+ *
+ * @param ring    The ring
+ * @param submit  Number of reads queued since the last call
+ * @param wait    Number of finished reads to wait for
+ * @return  Reads submitted, or -1 on error (see errno)
+ */
+static int enterRing(IoRing* ring, unsigned submit, unsigned wait)
+{
+  for(;;) {
+    int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring->fd, submit, wait,
+      (wait > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0));
+    if(ret >= 0 || errno != EINTR)
+      return ret;
+  }
+}
+#else
+/**
+ * Stands in for the ring when io_uring is not built in
+ */
+struct IoRing
+{
+};
+#endif
+
+/**
+ * Read from a position in a file
+ *
+ * NOTE: Only ever called from the reading thread
+ *
+ * @param fd      The file
+ * @param out     Receives the bytes
+ * @param n       Number of bytes wanted
+ * @param offset  Where to read from
+ * @return  Bytes read (0 at the end of the file), or a negative errno
+ */
+static long long readAt(int fd, char* out, size_t n, long long offset)
+{
+#ifdef _WIN32
+  if(_lseeki64(fd, offset, SEEK_SET) < 0)
+    return -errno;
+  int got = _read(fd, out, static_cast<unsigned>(n));
+#else
+  ssize_t got;
+  while((got = pread(fd, out, n, static_cast<off_t>(offset))) < 0 && errno == EINTR)
+    ;
+#endif
+  return (got < 0) ? -errno : got;
+}
+
+/**
+ * Runs BatchReader::run() on the reading thread
+ */
+class BatchReadTask : public Task
+{
+public:
+  BatchReadTask(BatchReader& reader)
+    : reader(reader)
+  {
+  }
+
+  virtual void run()
+  {
+    reader.run();
+  }
+
+private:
+  BatchReader& reader;
+};
+
+/**
+ * Constructor
+ *
+ * @param paths   Files to read (opened straight away)
+ */
+BatchReader::BatchReader(const vector<string>& paths)
+  : files(paths.size()), buffers(BATCH_BUFFERS), inflight(0), stopping(false), ring(NULL), thread(NULL), task(NULL)
+{
+  for(size_t i = 0 ; i < paths.size() ; ++i) {
+    File& file = files[i];
+#ifdef _WIN32
+    file.fd = _open(paths[i].c_str(), _O_RDONLY | _O_BINARY);
+    if(file.fd >= 0)
+      file.size = _filelengthi64(file.fd);
+#else
+    file.fd = open(paths[i].c_str(), O_RDONLY);
+    struct stat info;
+    if(file.fd >= 0 && fstat(file.fd, &info) == 0)
+      file.size = info.st_size;
+#endif
+    file.chunks = static_cast<size_t>((file.size + BATCH_BUFFER_SIZE - 1) / BATCH_BUFFER_SIZE);
+    file.closed = (file.fd < 0);
+  }
+}
+
+/**
+ * Destructor (stops reading and closes the files)
+ */
+BatchReader::~BatchReader()
+{
+  if(thread != NULL) {
+    {
+      ScopedLock guard(lock);
+      stopping = true;
+      hasWork.broadcast();
+    }
+    delete thread; // Waits for run() to return once no read is in flight
+  }
+  delete task;
+
+#ifdef USE_IO_URING
+  if(ring != NULL)
+    closeRing(ring);
+#endif
+
+  for(size_t i = 0 ; i < files.size() ; ++i) {
+    if(files[i].fd >= 0) {
+#ifdef _WIN32
+      _close(files[i].fd);
+#else
+      ::close(files[i].fd);
+#endif
+    }
+  }
+}
+
+/**
+ * Start reading
+ */
+void BatchReader::start()
+{
+  if(thread != NULL)
+    return;
+
+#ifdef USE_IO_URING
+  ring = openRing(BATCH_BUFFERS);
+#endif
+
+  task = new BatchReadTask(*this);
+  thread = new ThreadPool(1);
+  thread->submit(task);
+}
+
+/**
+ * Check if a file could be opened
+ *
+ * @param file  Index of the file
+ */
+bool BatchReader::isOpen(size_t file) const
+{
+  return files[file].fd >= 0;
+}
+
+/**
+ * Get the next chunk of a file, waiting for it to be read if necessary
+ *
+ * @param file  Index of the file
+ * @param data  Receives the start of the chunk
+ * @param size  Receives the number of bytes in it
+ * @return  True if there was a chunk, false at the end of the file (or on error)
+ */
+bool BatchReader::next(size_t file, const char*& data, size_t& size)
+{
+  ScopedLock guard(lock);
+  File& f = files[file];
+
+  if(f.holding >= 0) {
+    release(f.holding);
+    f.holding = -1;
+  }
+
+  for(;;) {
+    if(f.error || f.closed || f.consumed == f.chunks)
+      return false;
+
+    // Reads may finish out of order
+    for(size_t i = 0 ; i < buffers.size() ; ++i) {
+      Buffer& buf = buffers[i];
+      if(buf.state == READY && buf.file == file && buf.chunk == f.consumed) {
+        buf.state = HELD;
+        f.holding = static_cast<int>(i);
+        f.consumed++;
+        data = &buf.data[0];
+        size = buf.got;
+        return true;
+      }
+    }
+
+    hasData.wait(lock);
+  }
+}
+
+/**
+ * Check if a file could not be read to the end
+ *
+ * @param file  Index of the file
+ */
+bool BatchReader::failed(size_t file) const
+{
+  ScopedLock guard(lock);
+  return files[file].error;
+}
+
+/**
+ * Stop reading a file and give its buffers back
+ *
+ * @param file  Index of the file
+ */
+void BatchReader::close(size_t file)
+{
+  ScopedLock guard(lock);
+  File& f = files[file];
+  f.closed = true;
+  f.holding = -1;
+
+  // Buffers still being read are given back when their reads finish
+  for(size_t i = 0 ; i < buffers.size() ; ++i) {
+    if(buffers[i].file == file && (buffers[i].state == READY || buffers[i].state == HELD))
+      release(i);
+  }
+}
+
+/**
+ * Get how the reads are made
+ *
+ * @return  "io_uring" or "pread"
+ */
+const char* BatchReader::getBackend() const
+{
+  return (ring != NULL) ? "io_uring" : "pread";
+}
+
+/**
+ * Issue reads and hand them over as they finish (reading thread)
+ */
+void BatchReader::run()
+{
+  vector<size_t> issue;
+  vector<pair<size_t, long long> > finished;
+
+  for(;;) {
+    {
+      ScopedLock guard(lock);
+      for(;;) {
+        if(stopping) {
+          // The kernel may still be writing into buffers, so wait for those reads
+          if(inflight == 0)
+            return;
+          break;
+        }
+        assign(issue);
+        if(!issue.empty() || inflight > 0)
+          break;
+        hasWork.wait(lock);
+      }
+    }
+
+    // Only this thread touches buffers being read, so no lock is needed for the reads
+    finished.clear();
+#ifdef USE_IO_URING
+    if(ring != NULL) {
+      // Queue every read, then submit them together
+      unsigned tail = *ring->sqTail;
+      for(size_t i = 0 ; i < issue.size() ; ++i) {
+        Buffer& buf = buffers[issue[i]];
+        iovec& vec = ring->vecs[issue[i]];
+        vec.iov_base = &buf.data[buf.got];
+        vec.iov_len = buf.want - buf.got;
+
+        unsigned slot = tail & *ring->sqMask;
+        io_uring_sqe& sqe = ring->sqes[slot];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = files[buf.file].fd;
+        sqe.addr = reinterpret_cast<unsigned long long>(&vec);
+        sqe.len = 1;
+        sqe.off = buf.offset + buf.got;
+        sqe.user_data = issue[i];
+        ring->sqArray[slot] = slot;
+        tail++;
+      }
+      __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+      // Submit and wait for at least one read to finish
+      if(enterRing(ring, static_cast<unsigned>(issue.size()), 1) < 0) {
+        // Take back whatever the kernel did not pick up and fail those reads
+        int err = errno;
+        unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+        __atomic_store_n(ring->sqTail, head, __ATOMIC_RELEASE);
+        for(size_t i = issue.size() - min(issue.size(), static_cast<size_t>(tail - head)) ; i < issue.size() ; ++i)
+          finished.push_back(make_pair(issue[i], static_cast<long long>(-err)));
+      }
+
+      unsigned head = *ring->cqHead;
+      unsigned last = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+      for( ; head != last ; ++head) {
+        const io_uring_cqe& cqe = ring->cqes[head & *ring->cqMask];
+        finished.push_back(make_pair(static_cast<size_t>(cqe.user_data), static_cast<long long>(cqe.res)));
+      }
+      __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    } else
+#endif
+    {
+      for(size_t i = 0 ; i < issue.size() ; ++i) {
+        Buffer& buf = buffers[issue[i]];
+        long long got = readAt(files[buf.file].fd, &buf.data[buf.got], buf.want - buf.got, buf.offset + buf.got);
+        finished.push_back(make_pair(issue[i], got));
+      }
+    }
+    issue.clear();
+
+    ScopedLock guard(lock);
+    for(size_t i = 0 ; i < finished.size() ; ++i)
+      complete(finished[i].first, finished[i].second, issue);
+    hasData.broadcast();
+  }
+}
+
+/**
+ * Pick the reads to issue next (with the lock held)
+ *
+ * @param issue   Receives the buffers to read into
+ */
+void BatchReader::assign(vector<size_t>& issue)
+{
+  // Only the first few files still being parsed, so they share the buffers
+  size_t window = BATCH_BUFFERS / BATCH_PER_FILE;
+  size_t free = 0;
+
+  for(size_t i = 0 ; i < files.size() && window > 0 ; ++i) {
+    File& f = files[i];
+    if(f.closed)
+      continue;
+    window--;
+
+    while(!f.error && f.issued < f.chunks && f.buffers < BATCH_PER_FILE) {
+      while(free < buffers.size() && buffers[free].state != FREE)
+        free++;
+      if(free == buffers.size())
+        return;
+
+      Buffer& buf = buffers[free];
+      if(buf.data.empty())
+        buf.data.resize(BATCH_BUFFER_SIZE);
+      buf.state = READING;
+      buf.file = i;
+      buf.chunk = f.issued++;
+      buf.offset = static_cast<long long>(buf.chunk) * BATCH_BUFFER_SIZE;
+      buf.want = static_cast<size_t>(min(static_cast<long long>(BATCH_BUFFER_SIZE), f.size - buf.offset));
+      buf.got = 0;
+      f.buffers++;
+      inflight++;
+      issue.push_back(free);
+    }
+  }
+}
+
+/**
+ * Account for a finished read (with the lock held)
+ *
+ * @param index   The buffer
+ * @param result  Bytes read, or a negative errno
+ * @param issue   Receives the buffer again if the read has to go on
+ */
+void BatchReader::complete(size_t index, long long result, vector<size_t>& issue)
+{
+  Buffer& buf = buffers[index];
+  File& f = files[buf.file];
+
+  if(result == -EINTR || result == -EAGAIN) {
+    issue.push_back(index); // Try again
+    return;
+  }
+
+  if(result > 0)
+    buf.got += static_cast<size_t>(result);
+  if(result > 0 && buf.got < buf.want && !stopping && !f.closed) {
+    issue.push_back(index); // Short read, carry on from where it stopped
+    return;
+  }
+
+  inflight--;
+  if(result < 0 || buf.got < buf.want)
+    f.error = true; // Failed, or the file shrank while it was read
+
+  if(f.error || f.closed || stopping)
+    release(index);
+  else
+    buf.state = READY;
+}
+
+/**
+ * Give a buffer back (with the lock held)
+ *
+ * @param index   The buffer
+ */
+void BatchReader::release(size_t index)
+{
+  Buffer& buf = buffers[index];
+  if(buf.state == FREE)
+    return;
+  buf.state = FREE;
+  files[buf.file].buffers--;
+  hasWork.signal();
+}
@@ -0,0 +1,209 @@
+/**
+ * BatchReader.h
+ *
+ * Reads a set of files with many large reads in flight at once, ahead of
+ * the parser, into a ring of reusable buffers
+ *
+ * The reads are queued with io_uring on Linux (when built with
+ * HAVE_IO_URING and the kernel allows it), otherwise they are made one
+ * after another with pread() on a thread of their own. Reads are issued
+ * for the first few files still being parsed, a limited number of buffers
+ * per file, so several files are read ahead at the same time without the
+ * first one taking every buffer.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef BATCHREADER_H__
+#define BATCHREADER_H__
+
+#include <string>
+#include <vector>
+
+#include "ChunkSource.h"
+#include "ThreadPool.h"
+
+#define BATCH_BUFFERS 32              // Reads in flight or waiting to be parsed (bounds the memory used)
+#define BATCH_BUFFER_SIZE (1 << 20)   // Bytes per read
+#define BATCH_PER_FILE 8              // Buffers one file may hold
+
+struct IoRing; // Queues shared with the kernel (see BatchReader.cpp)
+
+class BatchReader
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param files   Files to read (opened straight away)
+   */
+  BatchReader(const std::vector<std::string>& files);
+
+  /**
+   * Destructor (stops reading and closes the files)
+   */
+  virtual ~BatchReader();
+
+  /**
+   * Start reading
+   *
+   * NOTE: Files closed before this are never read
+   */
+  void start();
+
+  /**
+   * Check if a file could be opened
+   *
+   * @param file  Index of the file
+   */
+  bool isOpen(size_t file) const;
+
+  /**
+   * Get the next chunk of a file, waiting for it to be read if necessary
+   *
+   * NOTE: The chunk stays valid until the next call for the same file
+   *
+   * @param file  Index of the file
+   * @param data  Receives the start of the chunk
+   * @param size  Receives the number of bytes in it
+   * @return  True if there was a chunk, false at the end of the file (or on error)
+   */
+  bool next(size_t file, const char*& data, size_t& size);
+
+  /**
+   * Check if a file could not be read to the end
+   *
+   * @param file  Index of the file
+   */
+  bool failed(size_t file) const;
+
+  /**
+   * Stop reading a file and give its buffers back
+   *
+   * @param file  Index of the file
+   */
+  void close(size_t file);
+
+  /**
+   * Get how the reads are made
+   *
+   * @return  "io_uring" or "pread"
+   */
+  const char* getBackend() const;
+
+private:
+  friend class BatchReadTask;
+
+  /**
+   * State of a buffer
+   */
+  enum BUFFERSTATE
+  {
+    FREE,
+    READING,
+    READY, // Waiting to be parsed
+    HELD   // Being parsed
+  };
+
+  /**
+   * One read
+   */
+  struct Buffer
+  {
+    Buffer()
+      : state(FREE), file(0), chunk(0), offset(0), want(0), got(0)
+    {
+    }
+    std::vector<char> data;
+    BUFFERSTATE state;
+    size_t file, chunk; // Which chunk of which file it holds
+    long long offset;   // Where the chunk starts in the file
+    size_t want, got;   // Bytes in the chunk and read so far
+  };
+
+  /**
+   * One file
+   */
+  struct File
+  {
+    File()
+      : fd(-1), size(0), issued(0), chunks(0), consumed(0), buffers(0), holding(-1), closed(false), error(false)
+    {
+    }
+    int fd;
+    long long size;
+    size_t issued;   // Chunks handed to reads so far
+    size_t chunks;   // Chunks in the file
+    size_t consumed; // Chunks handed to the parser so far
+    size_t buffers;  // Buffers it holds in any state
+    int holding;     // Buffer being parsed (-1 if none)
+    bool closed, error;
+  };
+
+  BatchReader(const BatchReader&);
+  BatchReader& operator=(const BatchReader&);
+
+  /**
+   * Issue reads and hand them over as they finish (reading thread)
+   */
+  void run();
+
+  /**
+   * Pick the reads to issue next (with the lock held)
+   *
+   * @param issue   Receives the buffers to read into
+   */
+  void assign(std::vector<size_t>& issue);
+
+  /**
+   * Account for a finished read (with the lock held)
+   *
+   * @param index   The buffer
+   * @param result  Bytes read, or a negative errno
+   * @param issue   Receives the buffer again if the read has to go on
+   */
+  void complete(size_t index, long long result, std::vector<size_t>& issue);
+
+  /**
+   * Give a buffer back (with the lock held)
+   *
+   * @param index   The buffer
+   */
+  void release(size_t index);
+
+  std::vector<File> files;
+  std::vector<Buffer> buffers;
+  size_t inflight;  // Buffers being read
+  bool stopping;
+  IoRing* ring;     // NULL when reading with pread()
+  ThreadPool* thread;
+  Task* task;
+  mutable Mutex lock;
+  Condition hasData, hasWork;
+};
+
+/**
+ * One file of a BatchReader, read through ChunkSource
+ */
+class BatchedFile : public ChunkSource
+{
+public:
+  BatchedFile(BatchReader& reader, size_t file)
+    : reader(reader), file(file)
+  {
+  }
+
+  /**
+   * Destructor (gives the file's buffers back)
+   */
+  virtual ~BatchedFile() { reader.close(file); }
+
+  virtual bool next(const char*& data, size_t& size) { return reader.next(file, data, size); }
+  virtual bool failed() const { return reader.failed(file); }
+
+private:
+  BatchReader& reader;
+  size_t file;
+};
+
+#endif /** BATCHREADER_H__ */
@@ -0,0 +1,191 @@
+/**
+ * ChildProcess.cpp
+ *
+ * Runs a shell command as a child process that can be stopped
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <vector>
+
+#include "ChildProcess.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ */
+ChildProcess::ChildProcess()
+#ifdef _WIN32
+  : process(NULL), job(NULL), running(false), signalled(false), status(-1)
+#else
+  : pid(-1), signalled(false), status(-1)
+#endif
+{
+}
+
+/**
+ * Destructor (does not stop the process)
+ */
+ChildProcess::~ChildProcess()
+{
+#ifdef _WIN32
+  if(process != NULL)
+    CloseHandle(process);
+  if(job != NULL)
+    CloseHandle(job);
+#endif
+}
+
+/**
+ * Start the command, like system() does but without waiting for it
+ *
+ * @param cmd   The command
+ * @return  True if started, false otherwise
+ */
+bool ChildProcess::start(const string& cmd)
+{
+#ifdef _WIN32
+  // The simulator is started by cmd.exe, so both go in a job to be stopped together
+  job = CreateJobObject(NULL, NULL);
+  if(job == NULL)
+    return false;
+
+  string line("cmd.exe /c ");
+  line.append(cmd);
+  vector<char> buffer(line.begin(), line.end()); // CreateProcess may write to it
+  buffer.push_back('\0');
+
+  STARTUPINFOA startup;
+  PROCESS_INFORMATION info;
+  ZeroMemory(&startup, sizeof(startup));
+  startup.cb = sizeof(startup);
+  if(!CreateProcessA(NULL, &buffer[0], NULL, NULL, FALSE, CREATE_SUSPENDED, NULL, NULL, &startup, &info))
+    return false;
+
+  // Join the job before running so nothing it starts escapes
+  AssignProcessToJobObject(job, info.hProcess);
+  ResumeThread(info.hThread);
+  CloseHandle(info.hThread);
+  ScopedLock guard(lock);
+  process = info.hProcess;
+  running = true;
+  return true;
+#else
+  pid_t child = fork();
+  if(child == 0) {
+    // A process group of its own so the simulator is stopped along with the shell
+    setpgid(0, 0);
+    execl("/bin/sh", "sh", "-c", cmd.c_str(), static_cast<char*>(NULL));
+    _exit(127);
+  }
+  if(child < 0)
+    return false;
+  setpgid(child, child); // Also here, in case stop() is called before the child gets to it
+  ScopedLock guard(lock);
+  pid = child;
+  return true;
+#endif
+}
+
+/**
+ * Wait for the command to finish
+ *
+ * @return  Its exit status (-1 if it was never started)
+ */
+int ChildProcess::wait()
+{
+#ifdef _WIN32
+  if(process == NULL)
+    return -1;
+  DWORD code = 0;
+  WaitForSingleObject(process, INFINITE);
+  GetExitCodeProcess(process, &code);
+  ScopedLock guard(lock);
+  running = false;
+  status = static_cast<int>(code);
+  return status;
+#else
+  pid_t child;
+  {
+    ScopedLock guard(lock);
+    child = pid;
+  }
+  if(child <= 0)
+    return -1;
+
+  // Wait for it to exit without collecting it, so its id cannot be reused
+  // before stop() knows it is gone
+  siginfo_t info;
+  while(waitid(P_PID, child, &info, WEXITED | WNOWAIT) < 0) {
+    if(errno != EINTR)
+      return -1;
+  }
+  {
+    ScopedLock guard(lock);
+    pid = 0;
+  }
+
+  int code = 0;
+  while(waitpid(child, &code, 0) < 0) {
+    if(errno != EINTR)
+      return -1;
+  }
+  ScopedLock guard(lock);
+  status = code;
+  return status;
+#endif
+}
+
+/**
+ * Stop the command and everything it started
+ *
+ * @return  True if the command was still running and was told to stop, false otherwise
+ */
+bool ChildProcess::stop()
+{
+  ScopedLock guard(lock);
+#ifdef _WIN32
+  if(!running || WaitForSingleObject(process, 0) == WAIT_OBJECT_0)
+    return false;
+  TerminateJobObject(job, 1);
+  signalled = true;
+  return true;
+#else
+  if(pid <= 0)
+    return false;
+
+  // Exited but not collected yet: it finished on its own
+  siginfo_t info;
+  info.si_pid = 0;
+  if(waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid != 0)
+    return false;
+
+  kill(-pid, SIGTERM);
+  signalled = true;
+  return true;
+#endif
+}
+
+/**
+ * Check if the command was cut short by stop() once wait() has returned
+ *
+ * @return  False if it was never told to stop, or if it exited successfully anyway
+ *          (it was told to as it finished on its own)
+ */
+bool ChildProcess::wasStopped() const
+{
+  ScopedLock guard(lock);
+#ifdef _WIN32
+  return signalled && status != 0;
+#else
+  return signalled && !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+#endif
+}
@@ -0,0 +1,88 @@
+/**
+ * ChildProcess.h
+ *
+ * Runs a shell command as a child process that can be stopped
+ * (fork/exec or CreateProcess)
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef CHILDPROCESS_H__
+#define CHILDPROCESS_H__
+
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#endif
+
+#include "ThreadPool.h"
+
+class ChildProcess
+{
+public:
+  /**
+   * Constructor
+   */
+  ChildProcess();
+
+  /**
+   * Destructor (does not stop the process)
+   */
+  virtual ~ChildProcess();
+
+  /**
+   * Start the command, like system() does but without waiting for it
+   *
+   * NOTE: Everything the command starts is stopped along with it
+   *
+   * @param cmd   The command
+   * @return  True if started, false otherwise
+   */
+  bool start(const std::string& cmd);
+
+  /**
+   * Wait for the command to finish
+   *
+   * @return  Its exit status (-1 if it was never started)
+   */
+  int wait();
+
+  /**
+   * Stop the command and everything it started
+   *
+   * NOTE: May be called from another thread while wait() is blocked. A command
+   *       that has already exited is never signalled (its id may be reused once
+   *       wait() has collected it).
+   *
+   * @return  True if the command was still running and was told to stop, false otherwise
+   */
+  bool stop();
+
+  /**
+   * Check if the command was cut short by stop() once wait() has returned
+   *
+   * @return  False if it was never told to stop, or if it exited successfully anyway
+   *          (it was told to as it finished on its own)
+   */
+  bool wasStopped() const;
+
+private:
+  ChildProcess(const ChildProcess&);
+  ChildProcess& operator=(const ChildProcess&);
+
+#ifdef _WIN32
+  HANDLE process;
+  HANDLE job; // Holds every process the command starts
+  bool running;
+#else
+  pid_t pid; // Also the id of its process group (0 once it has exited)
+#endif
+  bool signalled; // True if stop() told it to stop
+  int status;     // Exit status wait() returned
+  mutable Mutex lock; // Held while checking the command is running and signalling it
+};
+
+#endif /** CHILDPROCESS_H__ */
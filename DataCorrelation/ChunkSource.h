@@ -0,0 +1,40 @@
+/**
+ * ChunkSource.h
+ *
+ * A file the parser reads as a sequence of chunks of bytes rather than
+ * line by line (see UTChemParser::parseValues())
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef CHUNKSOURCE_H__
+#define CHUNKSOURCE_H__
+
+#include <cstddef>
+
+class ChunkSource
+{
+public:
+  /**
+   * Destructor
+   */
+  virtual ~ChunkSource(){}
+
+  /**
+   * Get the next chunk of the file
+   *
+   * NOTE: The chunk stays valid until the next call
+   *
+   * @param data  Receives the start of the chunk
+   * @param size  Receives the number of bytes in it
+   * @return  True if there was a chunk, false at the end of the file (or on error)
+   */
+  virtual bool next(const char*& data, size_t& size) = 0;
+
+  /**
+   * Check if the file could not be read to the end
+   */
+  virtual bool failed() const = 0;
+};
+
+#endif /** CHUNKSOURCE_H__ */
@@ -0,0 +1,370 @@
+/**
+ * CompressedFile.cpp
+ *
+ * Reads a gzip or zstd compressed file as a stream, decompressing on its
+ * own thread
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "CompressedFile.h"
+#include "DCUtil.h"
+
+using namespace std;
+
+/**
+ * State of the format being decoded
+ */
+struct CompressedFile::Decoder
+{
+  Decoder()
+    : format(NONE)
+  {
+#ifdef HAVE_ZLIB
+    gz = NULL;
+#endif
+#ifdef HAVE_ZSTD
+    raw = NULL;
+    stream = NULL;
+    eof = false;
+    lastRet = 0;
+#endif
+  }
+  FORMAT format;
+#ifdef HAVE_ZLIB
+  gzFile gz;
+#endif
+#ifdef HAVE_ZSTD
+  FILE* raw;
+  ZSTD_DStream* stream;
+  vector<char> input;
+  ZSTD_inBuffer in;
+  bool eof;       // True once all of the file has been read
+  size_t lastRet; // 0 when the last frame was finished
+#endif
+};
+
+/**
+ * Runs CompressedFile::decode() on the decoder thread
+ */
+class DecodeTask : public Task
+{
+public:
+  DecodeTask(CompressedFile& file)
+    : file(file)
+  {
+  }
+
+  virtual void run()
+  {
+    file.decode();
+  }
+
+private:
+  CompressedFile& file;
+};
+
+/**
+ * Constructor
+ */
+CompressedFile::CompressedFile()
+  : decoder(NULL), thread(NULL), task(NULL), head(0), filled(0), holding(false),
+    done(true), error(false), stopping(false)
+{
+}
+
+/**
+ * Destructor (closes the file if still open)
+ */
+CompressedFile::~CompressedFile()
+{
+  close();
+}
+
+/**
+ * Get the format of a file from its extension
+ *
+ * @param path  Path to the file
+ * @return  The format (NONE if not compressed)
+ */
+CompressedFile::FORMAT CompressedFile::formatOf(const string& path)
+{
+  size_t dot = path.find_last_of('.');
+  if(dot == string::npos)
+    return NONE;
+
+  string ext(path.substr(dot));
+  DCUtil::strToUpper(ext);
+  if(ext.compare(".GZ") == 0)
+    return GZIP;
+  if(ext.compare(".ZST") == 0)
+    return ZSTD;
+  return NONE;
+}
+
+/**
+ * Find a file, or a compressed copy of it if it is not there
+ *
+ * @param path  Path to the file as it was written
+ * @return  path if it exists, else path with .gz or .zst added if that
+ *          exists, else path
+ */
+string CompressedFile::locate(const string& path)
+{
+  const char* const extensions[] = { "", ".gz", ".zst" };
+  for(size_t i = 0 ; i < sizeof(extensions) / sizeof(extensions[0]) ; ++i) {
+    string candidate(path + extensions[i]);
+    ifstream file(candidate.c_str());
+    if(file.is_open())
+      return candidate;
+  }
+  return path;
+}
+
+/**
+ * Open a file and start decompressing it
+ *
+ * @param path  Path to the file (see formatOf())
+ * @return  True if opened, false otherwise
+ */
+bool CompressedFile::open(const string& path)
+{
+  close();
+
+  decoder = new Decoder;
+  decoder->format = formatOf(path);
+
+  bool opened = false;
+  switch(decoder->format) {
+  case GZIP:
+#ifdef HAVE_ZLIB
+    decoder->gz = gzopen(path.c_str(), "rb");
+    if(decoder->gz != NULL) {
+      gzbuffer(decoder->gz, DECODE_CHUNK_SIZE);
+      opened = true;
+    }
+#else
+    cerr<< "Built without zlib, cannot read " << path << endl;
+#endif
+    break;
+  case ZSTD:
+#ifdef HAVE_ZSTD
+    decoder->raw = fopen(path.c_str(), "rb");
+    if(decoder->raw != NULL) {
+      decoder->stream = ZSTD_createDStream();
+      ZSTD_initDStream(decoder->stream);
+      decoder->input.resize(ZSTD_DStreamInSize());
+      decoder->in.src = &decoder->input[0];
+      decoder->in.size = decoder->in.pos = 0;
+      opened = true;
+    }
+#else
+    cerr<< "Built without libzstd, cannot read " << path << endl;
+#endif
+    break;
+  default:
+    break;
+  }
+
+  if(!opened) {
+    close();
+    return false;
+  }
+
+  head = filled = 0;
+  holding = done = error = stopping = false;
+  task = new DecodeTask(*this);
+  thread = new ThreadPool(1);
+  thread->submit(task);
+  return true;
+}
+
+/**
+ * Get the next chunk of decompressed bytes
+ *
+ * @param data  Receives the start of the chunk
+ * @param size  Receives the number of bytes in it
+ * @return  True if there was a chunk, false at the end of the file (or on error)
+ */
+bool CompressedFile::next(const char*& data, size_t& size)
+{
+  ScopedLock guard(lock);
+
+  // The last chunk handed out can be decoded into again
+  if(holding) {
+    head = (head + 1) % DECODE_CHUNKS;
+    filled--;
+    holding = false;
+    hasSpace.signal();
+  }
+
+  while(filled == 0 && !done)
+    hasData.wait(lock);
+  if(filled == 0)
+    return false;
+
+  holding = true;
+  data = &chunks[head][0];
+  size = chunks[head].size();
+  return true;
+}
+
+/**
+ * Check if the file could not be decompressed to the end
+ */
+bool CompressedFile::failed() const
+{
+  ScopedLock guard(lock);
+  return error;
+}
+
+/**
+ * Stop decompressing and close the file
+ */
+void CompressedFile::close()
+{
+  if(thread != NULL) {
+    {
+      ScopedLock guard(lock);
+      stopping = true;
+      hasSpace.broadcast();
+    }
+    delete thread; // Waits for decode() to return
+    thread = NULL;
+  }
+  delete task;
+  task = NULL;
+
+  if(decoder != NULL) {
+#ifdef HAVE_ZLIB
+    if(decoder->gz != NULL)
+      gzclose(decoder->gz);
+#endif
+#ifdef HAVE_ZSTD
+    if(decoder->stream != NULL)
+      ZSTD_freeDStream(decoder->stream);
+    if(decoder->raw != NULL)
+      fclose(decoder->raw);
+#endif
+    delete decoder;
+    decoder = NULL;
+  }
+
+  head = filled = 0;
+  holding = false;
+  done = true;
+}
+
+/**
+ * Decompress the file into the chunks until the end (decoder thread)
+ */
+void CompressedFile::decode()
+{
+  for(;;) {
+    size_t slot;
+    {
+      ScopedLock guard(lock);
+      while(filled == DECODE_CHUNKS && !stopping)
+        hasSpace.wait(lock);
+      if(stopping)
+        return;
+      slot = (head + filled) % DECODE_CHUNKS;
+    }
+
+    // Outside the lock so the reader carries on with the chunks already decoded
+    bool decoded = decodeChunk(chunks[slot]);
+
+    ScopedLock guard(lock);
+    if(!decoded || chunks[slot].empty()) {
+      error = !decoded;
+      done = true;
+      hasData.broadcast();
+      return;
+    }
+    filled++;
+    hasData.signal();
+  }
+}
+
+/**
+ * Fill one chunk (decoder thread)
+ *
+ * @param out   The chunk (resized to what was decoded)
+ * @return  False on error
+ */
+bool CompressedFile::decodeChunk(vector<char>& out)
+{
+  out.resize(DECODE_CHUNK_SIZE);
+  size_t got = 0;
+
+  switch(decoder->format) {
+  case GZIP:
+#ifdef HAVE_ZLIB
+    while(got < out.size()) {
+      int n = gzread(decoder->gz, &out[got], static_cast<unsigned>(out.size() - got));
+      if(n < 0)
+        return false;
+      if(n == 0) {
+        // A file cut short also just ends, so check how it ended
+        int err = Z_OK;
+        gzerror(decoder->gz, &err);
+        if(err != Z_OK)
+          return false;
+        break;
+      }
+      got += n;
+    }
+#endif
+    break;
+  case ZSTD:
+#ifdef HAVE_ZSTD
+    {
+      ZSTD_inBuffer& in = decoder->in;
+      ZSTD_outBuffer dest;
+      dest.dst = &out[0];
+      dest.size = out.size();
+      dest.pos = 0;
+      while(dest.pos < dest.size) {
+        if(in.pos == in.size && !decoder->eof) {
+          in.size = fread(&decoder->input[0], 1, decoder->input.size(), decoder->raw);
+          in.pos = 0;
+          if(in.size == 0) {
+            if(ferror(decoder->raw))
+              return false;
+            decoder->eof = true;
+          }
+        }
+        if(decoder->eof && decoder->lastRet == 0)
+          break; // Every frame was finished
+
+        size_t before = dest.pos;
+        size_t ret = ZSTD_decompressStream(decoder->stream, &dest, &in);
+        if(ZSTD_isError(ret))
+          return false;
+        decoder->lastRet = ret;
+        if(decoder->eof && ret != 0 && dest.pos == before)
+          return false; // Cut short in the middle of a frame
+      }
+      got = dest.pos;
+    }
+#endif
+    break;
+  default:
+    return false;
+  }
+
+  out.resize(got);
+  return true;
+}
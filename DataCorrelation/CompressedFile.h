@@ -0,0 +1,126 @@
+/**
+ * CompressedFile.h
+ *
+ * Reads a gzip (.gz) or zstd (.zst) compressed file as a stream, with the
+ * decompression running on its own thread a few chunks ahead of the reader
+ *
+ * NOTE: Built with zlib when HAVE_ZLIB is defined and with libzstd when
+ *       HAVE_ZSTD is defined, otherwise such files cannot be opened
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef COMPRESSEDFILE_H__
+#define COMPRESSEDFILE_H__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "ChunkSource.h"
+#include "ThreadPool.h"
+
+#define DECODE_CHUNKS 4             // Chunks decoded ahead of the reader (bounds the memory used)
+#define DECODE_CHUNK_SIZE (1 << 18) // Bytes in one chunk
+
+class CompressedFile : public ChunkSource
+{
+public:
+  /**
+   * Compression formats
+   */
+  enum FORMAT
+  {
+    NONE,
+    GZIP,
+    ZSTD
+  };
+
+  /**
+   * Constructor
+   */
+  CompressedFile();
+
+  /**
+   * Destructor (closes the file if still open)
+   */
+  virtual ~CompressedFile();
+
+  /**
+   * Get the format of a file from its extension
+   *
+   * @param path  Path to the file
+   * @return  The format (NONE if not compressed)
+   */
+  static FORMAT formatOf(const std::string& path);
+
+  /**
+   * Find a file, or a compressed copy of it if it is not there
+   *
+   * @param path  Path to the file as it was written
+   * @return  path if it exists, else path with .gz or .zst added if that
+   *          exists, else path
+   */
+  static std::string locate(const std::string& path);
+
+  /**
+   * Open a file and start decompressing it
+   *
+   * @param path  Path to the file (see formatOf())
+   * @return  True if opened, false otherwise
+   */
+  bool open(const std::string& path);
+
+  /**
+   * Get the next chunk of decompressed bytes
+   *
+   * NOTE: The chunk stays valid until the next call
+   *
+   * @param data  Receives the start of the chunk
+   * @param size  Receives the number of bytes in it
+   * @return  True if there was a chunk, false at the end of the file (or on error)
+   */
+  virtual bool next(const char*& data, size_t& size);
+
+  /**
+   * Check if the file could not be decompressed to the end
+   */
+  virtual bool failed() const;
+
+  /**
+   * Stop decompressing and close the file
+   */
+  void close();
+
+private:
+  friend class DecodeTask;
+  struct Decoder;
+
+  CompressedFile(const CompressedFile&);
+  CompressedFile& operator=(const CompressedFile&);
+
+  /**
+   * Decompress the file into the chunks until the end (decoder thread)
+   */
+  void decode();
+
+  /**
+   * Fill one chunk (decoder thread)
+   *
+   * @param out   The chunk (resized to what was decoded)
+   * @return  False on error
+   */
+  bool decodeChunk(std::vector<char>& out);
+
+  Decoder* decoder;          // Format-specific state
+  ThreadPool* thread;        // Runs decode()
+  Task* task;
+  std::vector<char> chunks[DECODE_CHUNKS];
+  size_t head, filled;       // First chunk the reader has not released and number decoded
+  bool holding;              // True while the reader holds the head chunk
+  bool done, error, stopping;
+  mutable Mutex lock;
+  Condition hasData, hasSpace;
+};
+
+#endif /** COMPRESSEDFILE_H__ */
@@ -7,6 +7,7 @@
  */
 
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 
@@ -22,7 +23,7 @@ using namespace std;
  * @param file    Path to configuration file
  */
 Configuration::Configuration(const string& file)
-  : filename(file), lineno(0), parserState(NONE), runSimulation(true), sym(SYMMETRIC)
+  : filename(file), lineno(0), parserState(NONE), runSimulation(true), streamVals(false), followOut(false), sym(SYMMETRIC)
 {
   parse();
 }
@@ -79,6 +80,9 @@ void Configuration::parse()
     } else if(parserState == PARAMETER) {
       if(parseParameter(line))
         parserState = ANALYSIS;
+    } else if(parserState == WATCH) {
+      if(parseWatch(line))
+        parserState = ANALYSIS;
     }
   }
 
@@ -93,6 +97,18 @@ void Configuration::parse()
     throw DCException("Unclosed file{ ... } block");
   else if(parserState == ANALYSIS)
     throw DCException("Unclosed analysis{ ... } block");
+
+  // Every parameter is sent in single precision if every grid is stored
+  // that way, and the parser rounds the keys of the others that ask for it
+  paramset::iterator it;
+  for(it = params.begin() ; it != params.end() ; ++it) {
+    if(parserOpts.single)
+      it->stats |= Parameter::SINGLE;
+    if(it->stats & Parameter::SINGLE) {
+      bool& prefix = parserOpts.singleKeys[it->name];
+      prefix = prefix || (it->stats & Parameter::ALL_SIMILAR) != 0;
+    }
+  }
 }
 
 /**
@@ -133,6 +149,48 @@ bool Configuration::parseMain(const std::string& line)
       DCUtil::strToUpper(val);
       if(val.compare("FALSE") == 0 || val.compare("0") == 0)
         runSimulation = false; // Don't run simulation, just analyze
+    } else if(Configuration::isVarLine(line, "mmap")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      parserOpts.mmap = !(val.compare("FALSE") == 0 || val.compare("0") == 0);
+    } else if(Configuration::isVarLine(line, "lazy")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      parserOpts.lazy = !(val.compare("FALSE") == 0 || val.compare("0") == 0);
+    } else if(Configuration::isVarLine(line, "cache")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      parserOpts.cache = !(val.compare("FALSE") == 0 || val.compare("0") == 0);
+    } else if(Configuration::isVarLine(line, "compress")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      parserOpts.compress = !(val.compare("FALSE") == 0 || val.compare("0") == 0);
+    } else if(Configuration::isVarLine(line, "batch")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      parserOpts.batch = !(val.compare("FALSE") == 0 || val.compare("0") == 0);
+    } else if(Configuration::isVarLine(line, "single")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      parserOpts.single = !(val.compare("FALSE") == 0 || val.compare("0") == 0);
+    } else if(Configuration::isVarLine(line, "delta")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      parserOpts.delta = !(val.compare("FALSE") == 0 || val.compare("0") == 0);
+    } else if(Configuration::isVarLine(line, "sparse")) {
+      double density = atof(Configuration::extractValue(line).c_str());
+      parserOpts.sparse = (density < 0.0) ? 0.0 : density;
+    } else if(Configuration::isVarLine(line, "stream")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      streamVals = !(val.compare("FALSE") == 0 || val.compare("0") == 0);
+    } else if(Configuration::isVarLine(line, "follow")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      followOut = !(val.compare("FALSE") == 0 || val.compare("0") == 0);
+    } else if(Configuration::isVarLine(line, "threads")) {
+      int threads = atoi(Configuration::extractValue(line).c_str());
+      parserOpts.threads = (threads < 0) ? 0 : threads;
     } else if(Configuration::isVarLine(line, "output")) {
       string out(Configuration::extractValue(line));
       // Comma delimited
@@ -157,6 +215,31 @@ bool Configuration::parseMain(const std::string& line)
       } else if(DCUtil::startsWith(val, "negative")) {
         sym = NEGATIVE;
       }
+    } else if(Configuration::isVarLine(line, "matrixFormat")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      matrix.binary = (val.compare("BINARY") == 0);
+    } else if(Configuration::isVarLine(line, "matrix")) {
+      string keys(Configuration::extractValue(line));
+      string upper(keys);
+      DCUtil::strToUpper(upper);
+      matrix.prefixes.clear();
+      if(upper.compare("ALL") == 0) {
+        matrix.prefixes.push_back(""); // Every key
+      } else if(!(keys.empty() || upper.compare("FALSE") == 0 || upper.compare("0") == 0)) {
+        // Comma delimited
+        size_t pos = 0, last = 0;
+        while((pos = keys.find_first_of(',', pos)) != string::npos) {
+          string str(keys.substr(last, (pos - last)));
+          DCUtil::trim(str);
+          matrix.prefixes.push_back(str);
+          pos++;
+          last = pos;
+        }
+        string str(keys.substr(last));
+        DCUtil::trim(str);
+        matrix.prefixes.push_back(str);
+      }
     } else if(Configuration::isVarLine(line, "graph")) { // --- BEGIN GRAPHING SECTION WHICH MAY BE MOVED TO ITS OWN BLOCK (for flexibility)
       graph.valueToGraph = Configuration::extractValue(line);
     } else if(Configuration::isVarLine(line, "upperThresh")) {
@@ -270,6 +353,9 @@ bool Configuration::parseAnalysis(const std::string& line)
     } else if(DCUtil::startsWith(line, "parameter")) {
       parserState = PARAMETER;
       parseParameter(line);
+    } else if(DCUtil::startsWith(line, "watch")) {
+      parserState = WATCH;
+      parseWatch(line);
     } else {
       Configuration::throwException("Unexpected value in analysis{ ... }", lineno);
     }
@@ -304,6 +390,8 @@ bool Configuration::parseParameter(const std::string& line)
     open = Configuration::validOpen(line, "parameter");
     p.stats   = 0; // Unless told otherwise, everything is disabled.
     p.pearson.clear();
+    p.spearman.clear();
+    p.kendall.clear();
   } else {
     if(DCUtil::startsWith(line, "}")) {
       open = false;
@@ -321,10 +409,24 @@ bool Configuration::parseParameter(const std::string& line)
     } else if(DCUtil::startsWith(line, "stddev")) {
       if(DCUtil::XToY<string, int>(Configuration::extractValue(line)) > 0)
         p.stats |= Parameter::STDDEV;
+    } else if(DCUtil::startsWith(line, "min")) {
+      if(DCUtil::XToY<string, int>(Configuration::extractValue(line)) > 0)
+        p.stats |= Parameter::MIN;
+    } else if(DCUtil::startsWith(line, "max")) {
+      if(DCUtil::XToY<string, int>(Configuration::extractValue(line)) > 0)
+        p.stats |= Parameter::MAX;
     } else if(DCUtil::startsWith(line, "pearson")) {
       p.pearson = Configuration::extractValue(line);
       if(!p.pearson.empty())
         p.stats |= Parameter::PEARSON;
+    } else if(DCUtil::startsWith(line, "spearman")) {
+      p.spearman = Configuration::extractValue(line);
+      if(!p.spearman.empty())
+        p.stats |= Parameter::SPEARMAN;
+    } else if(DCUtil::startsWith(line, "kendall")) {
+      p.kendall = Configuration::extractValue(line);
+      if(!p.kendall.empty())
+        p.stats |= Parameter::KENDALL;
     } else if(DCUtil::startsWith(line, "norm")) {
       if(DCUtil::XToY<string, int>(Configuration::extractValue(line)) > 0)
         p.stats |= Parameter::NORM;
@@ -332,6 +434,9 @@ bool Configuration::parseParameter(const std::string& line)
       if(DCUtil::XToY<string, int>(Configuration::extractValue(line)) > 0) {
         p.stats |= Parameter::ALL_SIMILAR;
       }
+    } else if(Configuration::isVarLine(line, "single")) {
+      if(DCUtil::XToY<string, int>(Configuration::extractValue(line)) > 0)
+        p.stats |= Parameter::SINGLE;
     } else {
       Configuration::throwException("Unexpected value in parameter{ ... }", lineno);
     }
@@ -340,6 +445,72 @@ bool Configuration::parseParameter(const std::string& line)
   return false;
 }
 
+/**
+ * Parse a watch block (must be within analysis block)
+ *
+ * @param line    The line which opened the block
+ * @return  True if closed, false otherwise
+ */
+bool Configuration::parseWatch(const std::string& line)
+{
+  static bool open = false;
+  static Watch w;
+
+  // Get the key to watch
+  if(DCUtil::startsWith(line, "watch")) {
+    size_t start = line.find_first_of("\"");
+    size_t end   = line.find_last_of("\"");
+    if(start == string::npos || end == string::npos || start == end)
+      Configuration::throwException("Invalid watch{ ... } block defined", lineno);
+    w = Watch();
+    w.name = line.substr(start + 1, end - start - 1);
+  }
+
+  if(!open) {
+    open = Configuration::validOpen(line, "watch");
+  } else {
+    if(DCUtil::startsWith(line, "}")) {
+      open = false;
+      if(!w.hasAbove && !w.hasBelow && w.epsilon < 0.0)
+        Configuration::throwException("watch{ ... } block has no stop rule", lineno);
+      watches.push_back(w);
+      return true;
+    } else if(Configuration::isVarLine(line, "stat")) {
+      string val(Configuration::extractValue(line));
+      DCUtil::strToUpper(val);
+      if(val.compare("SUM") == 0)
+        w.stat = Watch::SUM;
+      else if(val.compare("MEAN") == 0)
+        w.stat = Watch::MEAN;
+      else if(val.compare("VARIANCE") == 0)
+        w.stat = Watch::VARIANCE;
+      else if(val.compare("STDDEV") == 0)
+        w.stat = Watch::STDDEV;
+      else if(val.compare("MIN") == 0)
+        w.stat = Watch::MIN;
+      else if(val.compare("MAX") == 0)
+        w.stat = Watch::MAX;
+      else
+        Configuration::throwException("Unknown statistic in watch{ ... }", lineno);
+    } else if(Configuration::isVarLine(line, "above")) {
+      w.above = DCUtil::XToY<string, double>(Configuration::extractValue(line));
+      w.hasAbove = true;
+    } else if(Configuration::isVarLine(line, "below")) {
+      w.below = DCUtil::XToY<string, double>(Configuration::extractValue(line));
+      w.hasBelow = true;
+    } else if(Configuration::isVarLine(line, "epsilon")) {
+      w.epsilon = DCUtil::XToY<string, double>(Configuration::extractValue(line));
+    } else if(Configuration::isVarLine(line, "window")) {
+      int window = DCUtil::XToY<string, int>(Configuration::extractValue(line));
+      w.window = (window > 0) ? window : 1;
+    } else {
+      Configuration::throwException("Unexpected value in watch{ ... }", lineno);
+    }
+  }
+
+  return false;
+}
+
 /**
  * Set the list of keys to update params for "all" values
  *
@@ -357,6 +528,8 @@ void Configuration::updateParams(const vector<string>& keys)
           Parameter param;
           param.name    = *itt;
           param.pearson = it->pearson;
+          param.spearman = it->spearman;
+          param.kendall = it->kendall;
           param.stats   = it->stats;
           newParams.push_back(param);
         }
@@ -369,6 +542,45 @@ void Configuration::updateParams(const vector<string>& keys)
     params.push_back(*it);
 }
 
+/**
+ * Look up the parser ids of every parameter's keys (after updateParams())
+ *
+ * @param parser  The parser the keys were read by
+ */
+void Configuration::resolveParams(const ParserBase& parser)
+{
+  paramset::iterator it;
+  for(it = params.begin() ; it != params.end() ; ++it) {
+    it->id = parser.getKeyId(it->name);
+    it->pearsonId = it->pearson.empty() ? KeyDictionary::NO_KEY : parser.getKeyId(it->pearson);
+    it->spearmanId = it->spearman.empty() ? KeyDictionary::NO_KEY : parser.getKeyId(it->spearman);
+    it->kendallId = it->kendall.empty() ? KeyDictionary::NO_KEY : parser.getKeyId(it->kendall);
+  }
+}
+
+/**
+ * Check if everything requested can be computed while the values are
+ * streamed (sum, mean, variance, stddev, min and max only, no graph or matrix)
+ *
+ * @return  True if the grids do not need to be kept, false otherwise
+ */
+bool Configuration::canStream() const
+{
+  const unsigned streamable = Parameter::SUM | Parameter::MEAN | Parameter::VARIANCE
+    | Parameter::STDDEV | Parameter::MIN | Parameter::MAX | Parameter::ALL_SIMILAR | Parameter::SINGLE;
+
+  if(!graph.valueToGraph.empty() || !matrix.prefixes.empty())
+    return false;
+
+  paramset::const_iterator it;
+  for(it = params.begin() ; it != params.end() ; ++it) {
+    if(it->stats & ~streamable)
+      return false;
+  }
+
+  return true;
+}
+
 /** Helper methods (private) */
 
 /**
@@ -14,6 +14,8 @@
 #include <string>
 #include <vector>
 
+#include "ParserBase.h"
+
 #define MAX_VALS 4 // Should directly correspond with the number of elements in the STATS enum
 
 /**
@@ -31,6 +33,12 @@ struct Rules
  */
 struct Parameter
 {
+  Parameter()
+    : stats(0), id(KeyDictionary::NO_KEY), pearsonId(KeyDictionary::NO_KEY), spearmanId(KeyDictionary::NO_KEY),
+      kendallId(KeyDictionary::NO_KEY)
+  {
+  }
+
   /**
    * Enum for bit vector (for stat enabling)
    */
@@ -42,10 +50,16 @@ struct Parameter
     STDDEV      = 0x08,
     PEARSON     = 0x10,
     NORM        = 0x20,
-    ALL_SIMILAR = 0x40
+    ALL_SIMILAR = 0x40,
+    SINGLE      = 0x80, // Stored and sent in single precision
+    MIN         = 0x100,
+    MAX         = 0x200,
+    SPEARMAN    = 0x400,
+    KENDALL     = 0x800
   };
-  std::string name, pearson;
+  std::string name, pearson, spearman, kendall;
   unsigned stats;
+  int id, pearsonId, spearmanId, kendallId; // Parser ids of name, pearson, spearman and kendall (see Configuration::resolveParams())
 };
 
 /**
@@ -61,7 +75,51 @@ struct GraphData
   double lowerThresh, upperThresh;
 };
 
+/**
+ * Struct for the correlation matrix of many keys
+ */
+struct MatrixData
+{
+  MatrixData()
+    : binary(false)
+  {
+  }
+  std::vector<std::string> prefixes; // Keys starting with any of these ("" for every key, none for no matrix)
+  bool binary;                       // Write it as a binary file rather than CSV
+};
+
+/**
+ * Struct for watching a key while the simulation runs (see Monitor)
+ */
+struct Watch
+{
+  Watch()
+    : stat(MEAN), hasAbove(false), hasBelow(false), above(0.0), below(0.0), epsilon(-1.0), window(1)
+  {
+  }
+
+  /**
+   * Statistic computed over each TIME snapshot of the key
+   */
+  enum STAT
+  {
+    SUM,
+    MEAN,
+    VARIANCE,
+    STDDEV,
+    MIN,
+    MAX
+  };
+  std::string name;
+  STAT stat;
+  bool hasAbove, hasBelow;
+  double above, below; // Stop once the statistic crosses these
+  double epsilon;      // Stop once it changes by less than this (negative if unset)...
+  unsigned window;     // ...from each snapshot to the next over this many snapshots
+};
+
 typedef std::vector<Parameter> paramset;
+typedef std::vector<Watch> watchset;
 typedef std::vector<Rules> ruleset;
 typedef std::map<std::string, ruleset > rules_container;
 
@@ -100,6 +158,8 @@ public:
   virtual std::vector<std::string> getOutput() const { return output; }
   virtual bool runSim() const { return runSimulation; }
   virtual bool listKeys() const { return listKeyVals; }
+  virtual bool streamValues() const { return streamVals; }
+  virtual bool followOutput() const { return followOut || !watches.empty(); } // Watches need the outputs followed
   virtual Symmetry getSymmetry() const { return sym; }
 
   /**
@@ -116,6 +176,13 @@ public:
    */
   const paramset& getParams() const { return params; }
 
+  /**
+   * Get the keys to watch while the simulation runs
+   *
+   * @return  A const reference to the watches
+   */
+  const watchset& getWatches() const { return watches; }
+
   /**
    * Get the graph information
    *
@@ -123,6 +190,20 @@ public:
    */
   const GraphData& getGraphing() const { return graph; }
 
+  /**
+   * Get the correlation matrix information
+   *
+   * @return  A const reference to the correlation matrix information
+   */
+  const MatrixData& getMatrix() const { return matrix; }
+
+  /**
+   * Get the parser tuning options
+   *
+   * @return  A const reference to the parser options
+   */
+  const ParserOptions& getParserOptions() const { return parserOpts; }
+
   /**
    * Set the list of keys to update params for "all" values
    *
@@ -130,6 +211,23 @@ public:
    */
   void updateParams(const std::vector<std::string>& keys);
 
+  /**
+   * Look up the parser ids of every parameter's keys (after updateParams())
+   *
+   * @param parser  The parser the keys were read by
+   */
+  void resolveParams(const ParserBase& parser);
+
+  /**
+   * Check if everything requested can be computed while the values are
+   * streamed: sum, mean, variance, stddev, min and max only (of a key or
+   * every key sharing its prefix, possibly in single precision), with no
+   * pearson, spearman, kendall or norm, no graph and no matrix
+   *
+   * @return  True if the grids do not need to be kept, false otherwise
+   */
+  bool canStream() const;
+
 private:
   /**
    * Parse data from input file
@@ -176,6 +274,14 @@ private:
    */
   virtual bool parseParameter(const std::string& line);
 
+  /**
+   * Parse a watch block (must be within analysis block)
+   *
+   * @param line    The line which opened the block
+   * @return  True if closed, false otherwise
+   */
+  virtual bool parseWatch(const std::string& line);
+
   /**
    * Check if variable line
    *
@@ -220,7 +326,8 @@ private:
     RULES,
     FILE,
     ANALYSIS,
-    PARAMETER
+    PARAMETER,
+    WATCH
   };
 
   // Private variables related to state and parsing
@@ -232,7 +339,7 @@ private:
   /** Main vars */
   std::string exe, datadir, simulator, runName;
   std::vector<std::string> output;
-  bool runSimulation, listKeyVals;
+  bool runSimulation, listKeyVals, streamVals, followOut;
 
   /* Rules/files vars in structure */
   rules_container rules;
@@ -240,9 +347,18 @@ private:
   /** Parameters to analyze */
   paramset params;
 
+  /** Keys to watch while the simulation runs */
+  watchset watches;
+
   /* Graph data */
   GraphData graph;
 
+  /* Correlation matrix data */
+  MatrixData matrix;
+
+  /* Parser tuning */
+  ParserOptions parserOpts;
+
   /* Symmetry data */
   Symmetry sym;
 };
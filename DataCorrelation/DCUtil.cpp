@@ -12,6 +12,7 @@
 #else // This is for opendir() and readdir() in *nix
 #include <dirent.h>
 #include <sys/stat.h>
+#include <unistd.h> // usleep()
 #endif
 #include <cstdio>
 #include <cstring>
@@ -285,3 +286,17 @@ bool DCUtil::isDirectory(const std::string& file)
   
   return ret;
 }
+
+/**
+ * Suspend the calling thread
+ *
+ * @param ms    Milliseconds to sleep for
+ */
+void DCUtil::sleepMillis(unsigned ms)
+{
+#ifdef _WIN32
+  Sleep(ms);
+#else
+  usleep(ms * 1000);
+#endif
+}
@@ -157,6 +157,13 @@ public:
    */
   static bool isDirectory(const std::string& file);
 
+  /**
+   * Suspend the calling thread
+   *
+   * @param ms    Milliseconds to sleep for
+   */
+  static void sleepMillis(unsigned ms);
+
 private:
   // Simple container so we don't have random methods floating.
   // Just a C++ thing.
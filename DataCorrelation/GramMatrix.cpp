@@ -0,0 +1,117 @@
+/**
+ * GramMatrix.cpp
+ *
+ * Sums of the products of every pair of columns (X'X)
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#include <algorithm>
+
+#include "GramMatrix.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+/**
+ * Position of a pair of columns in the sums (a row of pairs at a time)
+ *
+ * @param columns   Number of columns
+ * @param a         The first column
+ * @param b         The second column (no smaller than a)
+ * @return  Its position
+ */
+static size_t position(size_t columns, size_t a, size_t b)
+{
+  return a * columns - a * (a - 1) / 2 + (b - a);
+}
+
+/**
+ * One thread's tiles of the matrix for a panel of rows
+ */
+class GramTask : public Task
+{
+public:
+  GramTask(const vector<const double*>& cols, size_t n, vector<LaneSums>& sums, size_t columns)
+    : cols(cols), n(n), sums(sums), columns(columns)
+  {
+  }
+
+  virtual void run()
+  {
+    for(size_t t = 0 ; t < tiles.size() ; ++t) {
+      size_t aFirst = tiles[t].first * GRAM_BLOCK, aLast = min(aFirst + GRAM_BLOCK, columns);
+      size_t bFirst = tiles[t].second * GRAM_BLOCK, bLast = min(bFirst + GRAM_BLOCK, columns);
+      for(size_t start = 0 ; start < n ; start += GRAM_SEGMENT) {
+        size_t len = min(static_cast<size_t>(GRAM_SEGMENT), n - start);
+        for(size_t a = aFirst ; a < aLast ; ++a) {
+          for(size_t b = max(a, bFirst) ; b < bLast ; ++b)
+            Kernels::dot(sums[position(columns, a, b)], cols[a] + start, cols[b] + start, len);
+        }
+      }
+    }
+  }
+
+  const vector<const double*>& cols;
+  size_t n;
+  vector<LaneSums>& sums;
+  size_t columns;
+  vector<pair<size_t, size_t> > tiles; // Blocks of the columns (first <= second)
+};
+
+/**
+ * Constructor
+ *
+ * @param columns   Number of columns
+ */
+GramMatrix::GramMatrix(size_t columns)
+  : columns(columns), sums(columns * (columns + 1) / 2)
+{
+}
+
+/**
+ * Add the next rows
+ *
+ * @param cols  The rows of each column (one array per column)
+ * @param n     Number of rows
+ * @param pool  Threads to multiply them with (the tiles are split over all of them)
+ */
+void GramMatrix::add(const vector<const double*>& cols, size_t n, ThreadPool& pool)
+{
+  if(n == 0 || columns == 0)
+    return;
+
+  // Tiles are dealt out in turn, so each thread gets some near the diagonal
+  unsigned workers = pool.size() > 0 ? pool.size() : 1;
+  vector<GramTask*> tasks;
+  for(unsigned w = 0 ; w < workers ; ++w)
+    tasks.push_back(new GramTask(cols, n, sums, columns));
+  size_t blocks = (columns + GRAM_BLOCK - 1) / GRAM_BLOCK;
+  size_t next = 0;
+  for(size_t a = 0 ; a < blocks ; ++a) {
+    for(size_t b = a ; b < blocks ; ++b)
+      tasks[next++ % workers]->tiles.push_back(make_pair(a, b));
+  }
+
+  vector<Task*> work;
+  for(unsigned w = 0 ; w < workers ; ++w) {
+    if(!tasks[w]->tiles.empty())
+      work.push_back(tasks[w]);
+  }
+  pool.run(work);
+
+  for(unsigned w = 0 ; w < workers ; ++w)
+    delete tasks[w];
+}
+
+/**
+ * Get the sum of the products of two columns over every row added
+ *
+ * @param a   The first column
+ * @param b   The second column
+ * @return  The sum
+ */
+double GramMatrix::get(size_t a, size_t b) const
+{
+  return (a <= b) ? sums[position(columns, a, b)].total() : sums[position(columns, b, a)].total();
+}
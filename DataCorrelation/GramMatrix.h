@@ -0,0 +1,74 @@
+/**
+ * GramMatrix.h
+ *
+ * Sums of the products of every pair of columns (X'X), used for the
+ * correlation matrix of many keys at once
+ *
+ * Rows are handed over a panel at a time. The matrix is split into tiles
+ * of GRAM_BLOCK x GRAM_BLOCK columns and each thread takes whole tiles, so
+ * no two threads add to the same sum. Within a tile the columns are walked
+ * GRAM_SEGMENT rows at a time, so the segments of a tile's columns stay in
+ * cache while every pair of them is multiplied. Each sum is a run of
+ * Kernels::dot() (see LaneSums), so neither the threads, the tiles nor the
+ * size of the panels change the result.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef GRAMMATRIX_H__
+#define GRAMMATRIX_H__
+
+#include <cstddef>
+#include <vector>
+
+#include "Kernels.h"
+
+#define GRAM_BLOCK 8        // Columns per side of a tile
+#define GRAM_SEGMENT 2048   // Rows of a tile multiplied at a time
+
+class ThreadPool;
+
+class GramMatrix
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param columns   Number of columns
+   */
+  GramMatrix(size_t columns);
+
+  /**
+   * Destructor
+   */
+  virtual ~GramMatrix(){}
+
+  /**
+   * Add the next rows
+   *
+   * @param cols  The rows of each column (one array per column)
+   * @param n     Number of rows
+   * @param pool  Threads to multiply them with (the tiles are split over all of them)
+   */
+  void add(const std::vector<const double*>& cols, size_t n, ThreadPool& pool);
+
+  /**
+   * Get the sum of the products of two columns over every row added
+   *
+   * @param a   The first column
+   * @param b   The second column
+   * @return  The sum
+   */
+  double get(size_t a, size_t b) const;
+
+  /**
+   * Get the number of columns
+   */
+  size_t size() const { return columns; }
+
+private:
+  size_t columns;
+  std::vector<LaneSums> sums; // Each pair of columns a <= b, a row of pairs at a time
+};
+
+#endif /** GRAMMATRIX_H__ */
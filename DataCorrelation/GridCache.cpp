@@ -0,0 +1,393 @@
+/**
+ * GridCache.cpp
+ *
+ * Binary sidecar holding the parsed grids of a set of output files
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "GridCache.h"
+
+#define CACHE_MAGIC "DCGRID02"
+#define CACHE_MAGIC_LEN 8
+#define CACHE_SUFFIX ".gridcache"
+#define CACHE_NO_BASE 0xffffffffu
+
+using namespace std;
+
+typedef unsigned long long uint64;
+typedef long long int64;
+
+/**
+ * Check the byte order of this machine
+ *
+ * @return  True if doubles and integers are stored little-endian
+ */
+static bool isLittleEndian()
+{
+  const unsigned one = 1;
+  return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+/**
+ * Get the size and modification time of a file
+ *
+ * @param path    Path to the file
+ * @param size    Receives the size in bytes
+ * @param mtime   Receives the modification time (seconds since the epoch)
+ * @return  True if the file exists, false otherwise
+ */
+static bool sourceInfo(const string& path, uint64& size, int64& mtime)
+{
+#ifdef _WIN32
+  struct __stat64 st;
+  if(_stat64(path.c_str(), &st) != 0)
+    return false;
+#else
+  struct stat st;
+  if(stat(path.c_str(), &st) != 0)
+    return false;
+#endif
+  size = static_cast<uint64>(st.st_size);
+  mtime = static_cast<int64>(st.st_mtime);
+  return true;
+}
+
+/**
+ * Append a little-endian integer to a buffer
+ *
+ * @param out     Buffer to append to
+ * @param val     The value
+ * @param bytes   Width of the value in bytes
+ */
+static void putInt(string& out, uint64 val, unsigned bytes)
+{
+  for(unsigned i = 0 ; i < bytes ; ++i)
+    out += static_cast<char>((val >> (8 * i)) & 0xff);
+}
+
+/**
+ * Append a length prefixed string to a buffer
+ */
+static void putString(string& out, const string& str)
+{
+  putInt(out, str.size(), 4);
+  out.append(str);
+}
+
+/**
+ * Bounds checked reader over the mapped cache
+ */
+class CacheReader
+{
+public:
+  CacheReader(const char* begin, const char* end)
+    : pos(begin), begin(begin), end(end)
+  {
+  }
+
+  bool getInt(uint64& val, unsigned bytes)
+  {
+    if(static_cast<size_t>(end - pos) < bytes)
+      return false;
+    val = 0;
+    for(unsigned i = 0 ; i < bytes ; ++i)
+      val |= static_cast<uint64>(static_cast<unsigned char>(pos[i])) << (8 * i);
+    pos += bytes;
+    return true;
+  }
+
+  bool getString(string& str)
+  {
+    uint64 len;
+    if(!getInt(len, 4) || static_cast<uint64>(end - pos) < len)
+      return false;
+    str.assign(pos, static_cast<size_t>(len));
+    pos += len;
+    return true;
+  }
+
+  size_t offset() const { return pos - begin; }
+
+private:
+  const char* pos;
+  const char* begin;
+  const char* end;
+};
+
+/**
+ * Constructor
+ */
+GridCache::GridCache()
+  : nx(1), ny(1), nz(1)
+{
+}
+
+/**
+ * Get the path of the cache for a set of output files
+ *
+ * @param files   The output files (in the order they are parsed)
+ * @return  Path of the sidecar (empty if there are no files)
+ */
+string GridCache::pathFor(const vector<string>& files)
+{
+  if(files.empty())
+    return string();
+  return files[0] + CACHE_SUFFIX;
+}
+
+/**
+ * Map the cache for a set of output files
+ *
+ * @param files   The output files (in the order they are parsed)
+ * @return  True if a cache exists and is still valid for every file, false otherwise
+ */
+bool GridCache::open(const vector<string>& files)
+{
+  string path(pathFor(files));
+  if(path.empty() || !file.open(path))
+    return false;
+
+  if(!parse(files)) {
+    file.close();
+    grids.clear();
+    times.clear();
+    swapped.clear();
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Read the header and key table, checking it against the source files
+ *
+ * @param files   The output files (in the order they are parsed)
+ * @return  True if the cache is valid, false otherwise
+ */
+bool GridCache::parse(const vector<string>& files)
+{
+  const char* data = file.data();
+  if(file.size() < CACHE_MAGIC_LEN || memcmp(data, CACHE_MAGIC, CACHE_MAGIC_LEN) != 0)
+    return false;
+
+  CacheReader in(data + CACHE_MAGIC_LEN, data + file.size());
+  uint64 val, count;
+
+  if(!in.getInt(val, 4)) return false;
+  nx = static_cast<unsigned>(val);
+  if(!in.getInt(val, 4)) return false;
+  ny = static_cast<unsigned>(val);
+  if(!in.getInt(val, 4)) return false;
+  nz = static_cast<unsigned>(val);
+
+  // Same files, in the same order, untouched since the cache was written
+  if(!in.getInt(count, 4) || count != files.size())
+    return false;
+  for(size_t i = 0 ; i < files.size() ; ++i) {
+    string path;
+    uint64 size, cachedSize, cachedTime;
+    int64 mtime;
+    if(!in.getString(path) || !in.getInt(cachedSize, 8) || !in.getInt(cachedTime, 8))
+      return false;
+    if(path != files[i] || !sourceInfo(files[i], size, mtime))
+      return false;
+    if(size != cachedSize || static_cast<uint64>(mtime) != cachedTime)
+      return false;
+  }
+
+  if(!in.getInt(count, 4))
+    return false;
+  times.resize(static_cast<size_t>(count));
+  for(size_t i = 0 ; i < times.size() ; ++i) {
+    if(!in.getString(times[i]))
+      return false;
+  }
+
+  if(!in.getInt(count, 4))
+    return false;
+  grids.resize(static_cast<size_t>(count));
+  vector<uint64> sizes(grids.size());
+  for(size_t i = 0 ; i < grids.size() ; ++i) {
+    sizes[i] = 0;
+    if(!in.getString(grids[i].key) || !in.getInt(val, 4))
+      return false;
+
+    if(val != CACHE_NO_BASE) {
+      // A snapshot of an earlier key that holds values
+      CachedGrid& snapshot = grids[i];
+      if(val >= i || grids[static_cast<size_t>(val)].base >= 0)
+        return false;
+      snapshot.base = static_cast<int>(val);
+      const CachedGrid& base = grids[snapshot.base];
+
+      if(!in.getInt(val, 4) || val >= times.size() || !in.getInt(count, 4))
+        return false;
+      snapshot.time = static_cast<size_t>(val);
+      snapshot.blocks.resize(static_cast<size_t>(count));
+      for(size_t j = 0 ; j < snapshot.blocks.size() ; ++j) {
+        if(!in.getInt(val, 8) || val >= base.offsets.size())
+          return false;
+        snapshot.blocks[j] = static_cast<size_t>(val);
+      }
+      continue;
+    }
+
+    if(!in.getInt(count, 4))
+      return false;
+    grids[i].offsets.resize(static_cast<size_t>(count));
+    for(size_t j = 0 ; j < grids[i].offsets.size() ; ++j) {
+      if(!in.getInt(val, 8))
+        return false;
+      grids[i].offsets[j] = static_cast<size_t>(val);
+    }
+    if(!in.getInt(sizes[i], 8))
+      return false;
+  }
+
+  // Values start at the next multiple of 8 bytes so they can be used in place
+  size_t pos = CACHE_MAGIC_LEN + in.offset();
+  pos = (pos + 7) & ~static_cast<size_t>(7);
+
+  bool inPlace = isLittleEndian();
+  if(!inPlace)
+    swapped.reserve(grids.size()); // Views point into these, so they must never move
+  for(size_t i = 0 ; i < grids.size() ; ++i) {
+    if(grids[i].base >= 0)
+      continue; // Nothing stored
+    if(pos > file.size() || sizes[i] > (file.size() - pos) / sizeof(double))
+      return false; // Truncated
+    size_t n = static_cast<size_t>(sizes[i]);
+    const char* values = data + pos;
+    pos += n * sizeof(double);
+
+    for(size_t j = 0 ; j < grids[i].offsets.size() ; ++j) {
+      if(grids[i].offsets[j] > n)
+        return false;
+    }
+
+    if(n == 0)
+      continue;
+
+    if(inPlace) {
+      grids[i].values = GridView(reinterpret_cast<const double*>(values), n);
+    } else {
+      // Reverse the bytes of each value into a buffer of our own
+      swapped.push_back(vector<double>(n));
+      char* out = reinterpret_cast<char*>(&swapped.back()[0]);
+      for(size_t j = 0 ; j < n * sizeof(double) ; ++j)
+        out[j] = values[(j & ~static_cast<size_t>(7)) + 7 - (j & 7)];
+      grids[i].values = GridView(&swapped.back()[0], n);
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Write the cache for a set of output files
+ *
+ * @param files   The output files (in the order they were parsed)
+ * @param nx      Cells in the x direction
+ * @param ny      Cells in the y direction
+ * @param nz      Number of layers
+ * @param times   TIME values in the order they were seen
+ * @param grids   Grids to store
+ * @return  True if written, false otherwise
+ */
+bool GridCache::write(const vector<string>& files, unsigned nx, unsigned ny, unsigned nz,
+                      const vector<string>& times, const vector<CachedGrid>& grids)
+{
+  string path(pathFor(files));
+  if(path.empty())
+    return false;
+
+  string header(CACHE_MAGIC, CACHE_MAGIC_LEN);
+  putInt(header, nx, 4);
+  putInt(header, ny, 4);
+  putInt(header, nz, 4);
+
+  putInt(header, files.size(), 4);
+  for(size_t i = 0 ; i < files.size() ; ++i) {
+    uint64 size;
+    int64 mtime;
+    if(!sourceInfo(files[i], size, mtime))
+      return false;
+    putString(header, files[i]);
+    putInt(header, size, 8);
+    putInt(header, static_cast<uint64>(mtime), 8);
+  }
+
+  putInt(header, times.size(), 4);
+  for(size_t i = 0 ; i < times.size() ; ++i)
+    putString(header, times[i]);
+
+  putInt(header, grids.size(), 4);
+  for(size_t i = 0 ; i < grids.size() ; ++i) {
+    putString(header, grids[i].key);
+    if(grids[i].base >= 0) {
+      putInt(header, grids[i].base, 4);
+      putInt(header, grids[i].time, 4);
+      putInt(header, grids[i].blocks.size(), 4);
+      for(size_t j = 0 ; j < grids[i].blocks.size() ; ++j)
+        putInt(header, grids[i].blocks[j], 8);
+      continue;
+    }
+
+    putInt(header, CACHE_NO_BASE, 4);
+    putInt(header, grids[i].offsets.size(), 4);
+    for(size_t j = 0 ; j < grids[i].offsets.size() ; ++j)
+      putInt(header, grids[i].offsets[j], 8);
+    putInt(header, grids[i].values.size(), 8);
+  }
+
+  while(header.size() % 8 != 0)
+    header += '\0';
+
+  string temp(path + ".tmp");
+  ofstream out(temp.c_str(), ios::out | ios::binary | ios::trunc);
+  if(!out.is_open())
+    return false;
+
+  out.write(header.data(), header.size());
+
+  bool inPlace = isLittleEndian();
+  for(size_t i = 0 ; i < grids.size() && out ; ++i) {
+    if(grids[i].base >= 0)
+      continue;
+    const GridView& values = grids[i].values;
+    if(inPlace) {
+      out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+    } else {
+      for(size_t j = 0 ; j < values.size() ; ++j) {
+        const char* bytes = reinterpret_cast<const char*>(&values[j]);
+        char le[sizeof(double)];
+        for(size_t k = 0 ; k < sizeof(double) ; ++k)
+          le[k] = bytes[sizeof(double) - 1 - k];
+        out.write(le, sizeof(double));
+      }
+    }
+  }
+
+  bool success = !out.fail();
+  out.close();
+
+  // Replace any older cache (rename() does not overwrite on Windows)
+  if(success) {
+    remove(path.c_str());
+    success = (rename(temp.c_str(), path.c_str()) == 0);
+  }
+  if(!success)
+    remove(temp.c_str());
+
+  return success;
+}
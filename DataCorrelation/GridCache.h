@@ -0,0 +1,125 @@
+/**
+ * GridCache.h
+ *
+ * Binary sidecar holding the parsed grids of a set of output files so that
+ * later runs can map it instead of parsing the text again
+ *
+ * Layout (all integers and doubles little-endian):
+ *   "DCGRID02"
+ *   uint32 nx, ny, nz
+ *   uint32 number of source files, then for each:
+ *     uint32 path length, path, uint64 size, int64 mtime
+ *   uint32 number of TIME values, then for each:
+ *     uint32 length, value
+ *   uint32 number of keys, then for each:
+ *     uint32 key length, key, uint32 base (0xffffffff if the key holds values), then either
+ *       uint32 number of layers, uint64 layer offsets[layers], uint64 number of values
+ *     or for a time snapshot of the key at index base:
+ *       uint32 TIME index, uint32 number of blocks, uint64 blocks[blocks]
+ *   padding to a multiple of 8 bytes
+ *   double values of every key holding values, in key order
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef GRIDCACHE_H__
+#define GRIDCACHE_H__
+
+#include <string>
+#include <vector>
+
+#include "GridView.h"
+#include "MappedFile.h"
+
+/**
+ * One key's grid as stored in the cache
+ */
+struct CachedGrid
+{
+  CachedGrid()
+    : base(-1), time(0)
+  {
+  }
+  std::string key;
+  std::vector<size_t> offsets; // Where each layer starts in values
+  GridView values;
+
+  // Time snapshots (no values of their own)
+  int base;                    // Index of the grid holding the values (-1 if this one does)
+  size_t time;                 // Index of the snapshot's TIME value
+  std::vector<size_t> blocks;  // Layers of the base grid in the snapshot
+};
+
+class GridCache
+{
+public:
+  /**
+   * Constructor
+   */
+  GridCache();
+
+  /**
+   * Destructor
+   */
+  virtual ~GridCache(){}
+
+  /**
+   * Get the path of the cache for a set of output files
+   *
+   * @param files   The output files (in the order they are parsed)
+   * @return  Path of the sidecar (empty if there are no files)
+   */
+  static std::string pathFor(const std::vector<std::string>& files);
+
+  /**
+   * Map the cache for a set of output files
+   *
+   * @param files   The output files (in the order they are parsed)
+   * @return  True if a cache exists and is still valid for every file, false otherwise
+   */
+  bool open(const std::vector<std::string>& files);
+
+  /**
+   * Write the cache for a set of output files
+   *
+   * NOTE: Written to a temporary file first and then moved into place
+   *
+   * @param files   The output files (in the order they were parsed)
+   * @param nx      Cells in the x direction
+   * @param ny      Cells in the y direction
+   * @param nz      Number of layers
+   * @param times   TIME values in the order they were seen
+   * @param grids   Grids to store
+   * @return  True if written, false otherwise
+   */
+  static bool write(const std::vector<std::string>& files, unsigned nx, unsigned ny, unsigned nz,
+                    const std::vector<std::string>& times, const std::vector<CachedGrid>& grids);
+
+  /** Simple get methods (valid after a successful open()) */
+  unsigned getNX() const { return nx; }
+  unsigned getNY() const { return ny; }
+  unsigned getNZ() const { return nz; }
+  const std::vector<std::string>& getTimes() const { return times; }
+  const std::vector<CachedGrid>& getGrids() const { return grids; }
+
+private:
+  // Caches own their mapping, so are not copyable
+  GridCache(const GridCache&);
+  GridCache& operator=(const GridCache&);
+
+  /**
+   * Read the header and key table, checking it against the source files
+   *
+   * @param files   The output files (in the order they are parsed)
+   * @return  True if the cache is valid, false otherwise
+   */
+  bool parse(const std::vector<std::string>& files);
+
+  MappedFile file;
+  unsigned nx, ny, nz;
+  std::vector<std::string> times;
+  std::vector<CachedGrid> grids;
+  std::vector<std::vector<double> > swapped; // Values converted on big-endian machines
+};
+
+#endif /** GRIDCACHE_H__ */
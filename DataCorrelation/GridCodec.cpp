@@ -0,0 +1,987 @@
+/**
+ * GridCodec.cpp
+ *
+ * Lossless compression of grids of doubles
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "GridCodec.h"
+
+#define PLANES 8          // Bytes in a double
+#define PLANE_ZERO 0      // Every byte of the plane is zero (nothing stored)
+#define PLANE_RAW 1       // Bytes stored as they are
+#define PLANE_HUFFMAN 2   // Canonical Huffman code
+#define HUFF_MAX_BITS 11  // Longest code, so decoding is a single table lookup per byte
+#define TILE_XOR 0        // Bits of each value XORed with the previous value
+#define TILE_DECIMAL 1    // Each value as a decimal mantissa and a power of ten
+#define TILE_SINGLE 2     // Each value as a raw float
+#define TILE_RAW 3        // Each value as a raw double
+#define TILE_SPARSE 4     // Cells and raw doubles of the nonzero values only
+#define TILE_SPARSE_SINGLE 5 // Cells and raw floats of the nonzero values only
+#define TILE_DELTA 6      // Bits of each value XORed with those of the same cell of an earlier tile
+#define TILE_CHANGED 7    // Cells that differ from an earlier tile, and their bits XORed with its
+#define DELTA_CHAIN 16     // Longest run of tiles each stored as changes from the one before
+#define MAX_POW10 22      // Largest power of ten a double holds exactly
+#define MAX_MANTISSA (1LL << 53) // Largest mantissa a double holds exactly
+#define NOT_DECIMAL 0xff  // Scale of a value stored as raw bits instead
+
+using namespace std;
+
+typedef unsigned long long uint64;
+typedef long long int64;
+
+// Exact powers of ten
+static const double POW10[MAX_POW10 + 1] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Work out Huffman code lengths for a plane
+ *
+ * @param freq    Number of times each byte appears
+ * @param len     Receives the code length of each byte (0 if unused)
+ */
+static void codeLengths(const unsigned* freq, unsigned char* len)
+{
+  unsigned f[256];
+  memcpy(f, freq, sizeof(f));
+
+  for(;;) {
+    // Leaves sorted by frequency, then merged with a second queue of
+    // internal nodes (which come out already sorted)
+    vector<pair<unsigned, int> > leaves;
+    for(int s = 0 ; s < 256 ; ++s) {
+      len[s] = 0;
+      if(f[s] > 0)
+        leaves.push_back(make_pair(f[s], s));
+    }
+    sort(leaves.begin(), leaves.end());
+
+    size_t m = leaves.size();
+    if(m == 1) {
+      len[leaves[0].second] = 1;
+      return;
+    }
+
+    vector<unsigned> weight(2 * m - 1);
+    vector<size_t> parent(2 * m - 1, 0);
+    for(size_t i = 0 ; i < m ; ++i)
+      weight[i] = leaves[i].first;
+
+    size_t leaf = 0, node = m, next = m;
+    while(next < 2 * m - 1) {
+      size_t pick[2];
+      for(int k = 0 ; k < 2 ; ++k) {
+        if(leaf < m && (node >= next || weight[leaf] <= weight[node]))
+          pick[k] = leaf++;
+        else
+          pick[k] = node++;
+      }
+      weight[next] = weight[pick[0]] + weight[pick[1]];
+      parent[pick[0]] = parent[pick[1]] = next;
+      next++;
+    }
+
+    // Parents always come after their children, so one pass from the root down
+    vector<unsigned> depth(2 * m - 1, 0);
+    unsigned longest = 0;
+    for(size_t i = 2 * m - 1 ; i-- > 0 ; ) {
+      if(i != 2 * m - 2)
+        depth[i] = depth[parent[i]] + 1;
+      if(i < m) {
+        len[leaves[i].second] = static_cast<unsigned char>(depth[i]);
+        longest = max(longest, depth[i]);
+      }
+    }
+
+    if(longest <= HUFF_MAX_BITS)
+      return;
+
+    // Too deep, so flatten the distribution and try again
+    for(int s = 0 ; s < 256 ; ++s) {
+      if(f[s] > 0)
+        f[s] = (f[s] >> 1) | 1;
+    }
+  }
+}
+
+/**
+ * Assign canonical codes from code lengths
+ *
+ * @param len     Code length of each byte
+ * @param code    Receives the code of each byte
+ */
+static void canonicalCodes(const unsigned char* len, unsigned* code)
+{
+  unsigned count[HUFF_MAX_BITS + 1] = { 0 };
+  unsigned next[HUFF_MAX_BITS + 2] = { 0 };
+  for(int s = 0 ; s < 256 ; ++s)
+    count[len[s]]++;
+  count[0] = 0;
+  for(int bits = 1 ; bits <= HUFF_MAX_BITS ; ++bits)
+    next[bits + 1] = (next[bits] + count[bits]) << 1;
+  for(int s = 0 ; s < 256 ; ++s) {
+    if(len[s] > 0)
+      code[s] = next[len[s]]++;
+  }
+}
+
+/**
+ * Pack one byte plane onto the end of a buffer
+ *
+ * @param plane   The bytes
+ * @param n       Number of bytes
+ * @param out     Buffer to append to
+ */
+static void packPlane(const unsigned char* plane, size_t n, vector<unsigned char>& out)
+{
+  unsigned freq[256] = { 0 };
+  for(size_t i = 0 ; i < n ; ++i)
+    freq[plane[i]]++;
+
+  if(freq[0] == n) {
+    out.push_back(PLANE_ZERO);
+    return;
+  }
+
+  unsigned char len[256];
+  codeLengths(freq, len);
+
+  // Code lengths are stored as nibbles up to the largest byte used
+  int maxSym = 255;
+  while(len[maxSym] == 0)
+    maxSym--;
+  size_t bits = 0;
+  for(int s = 0 ; s <= maxSym ; ++s)
+    bits += static_cast<size_t>(freq[s]) * len[s];
+  size_t coded = 1 + (maxSym / 2 + 1) + (bits + 7) / 8;
+
+  if(coded >= n) {
+    out.push_back(PLANE_RAW);
+    out.insert(out.end(), plane, plane + n);
+    return;
+  }
+
+  out.push_back(PLANE_HUFFMAN);
+  out.push_back(static_cast<unsigned char>(maxSym));
+  for(int s = 0 ; s <= maxSym ; s += 2)
+    out.push_back(static_cast<unsigned char>(len[s] | ((s + 1 <= maxSym) ? (len[s + 1] << 4) : 0)));
+
+  unsigned code[256];
+  canonicalCodes(len, code);
+
+  uint64 acc = 0;
+  unsigned pending = 0;
+  for(size_t i = 0 ; i < n ; ++i) {
+    unsigned char s = plane[i];
+    acc = (acc << len[s]) | code[s];
+    pending += len[s];
+    while(pending >= 8) {
+      pending -= 8;
+      out.push_back(static_cast<unsigned char>(acc >> pending));
+    }
+    acc &= (static_cast<uint64>(1) << pending) - 1;
+  }
+  if(pending > 0)
+    out.push_back(static_cast<unsigned char>(acc << (8 - pending)));
+}
+
+/**
+ * Unpack one byte plane
+ *
+ * @param pos     Start of the plane
+ * @param end     End of the packed data
+ * @param n       Number of bytes in the plane
+ * @param plane   Receives the bytes
+ * @return  Start of whatever follows the plane
+ */
+static const unsigned char* unpackPlane(const unsigned char* pos, const unsigned char* end, size_t n,
+                                        unsigned char* plane)
+{
+  unsigned char mode = *pos++;
+
+  if(mode == PLANE_ZERO) {
+    memset(plane, 0, n);
+    return pos;
+  }
+
+  if(mode == PLANE_RAW) {
+    memcpy(plane, pos, n);
+    return pos + n;
+  }
+
+  // Huffman: rebuild the decoding table from the code lengths
+  int maxSym = *pos++;
+  unsigned char len[256] = { 0 };
+  for(int s = 0 ; s <= maxSym ; s += 2) {
+    len[s] = *pos & 0x0f;
+    if(s + 1 <= maxSym)
+      len[s + 1] = *pos >> 4;
+    pos++;
+  }
+
+  unsigned code[256];
+  canonicalCodes(len, code);
+
+  unsigned short table[1 << HUFF_MAX_BITS];
+  for(int s = 0 ; s <= maxSym ; ++s) {
+    if(len[s] == 0)
+      continue;
+    unsigned first = code[s] << (HUFF_MAX_BITS - len[s]);
+    unsigned last = first + (1u << (HUFF_MAX_BITS - len[s]));
+    for(unsigned j = first ; j < last ; ++j)
+      table[j] = static_cast<unsigned short>((s << 4) | len[s]);
+  }
+
+  // Bits are kept left aligned in buf
+  const unsigned char* start = pos;
+  uint64 buf = 0;
+  unsigned avail = 0;
+  size_t i = 0;
+  while(i < n) {
+    while(avail <= 56 && pos < end) {
+      buf |= static_cast<uint64>(*pos++) << (56 - avail);
+      avail += 8;
+    }
+
+    // At least 57 bits are buffered, enough for 5 codes
+    for(int k = 0 ; k < 5 && i < n ; ++k, ++i) {
+      unsigned short entry = table[buf >> (64 - HUFF_MAX_BITS)];
+      plane[i] = static_cast<unsigned char>(entry >> 4);
+      buf <<= (entry & 0x0f);
+      avail -= (entry & 0x0f);
+    }
+  }
+
+  // Whatever follows starts on the byte after the last code
+  size_t used = 8 * static_cast<size_t>(pos - start) - avail;
+  return start + (used + 7) / 8;
+}
+
+/**
+ * Pack 64-bit words as 8 byte planes onto the end of a buffer
+ *
+ * @param words   The words
+ * @param n       Number of words
+ * @param out     Buffer to append to
+ */
+static void packWords(const uint64* words, size_t n, vector<unsigned char>& out)
+{
+  unsigned char plane[TILE_VALUES];
+  for(int k = 0 ; k < PLANES ; ++k) {
+    for(size_t i = 0 ; i < n ; ++i)
+      plane[i] = static_cast<unsigned char>(words[i] >> (8 * k));
+    packPlane(plane, n, out);
+  }
+}
+
+/**
+ * Unpack 64-bit words stored as 8 byte planes
+ *
+ * @param pos     Start of the first plane
+ * @param end     End of the packed data
+ * @param n       Number of words
+ * @param words   Receives the words
+ * @return  Start of whatever follows the planes
+ */
+static const unsigned char* unpackWords(const unsigned char* pos, const unsigned char* end, size_t n, uint64* words)
+{
+  unsigned char plane[TILE_VALUES];
+  memset(words, 0, n * sizeof(uint64));
+  for(int k = 0 ; k < PLANES ; ++k) {
+    if(*pos == PLANE_ZERO) {
+      pos++; // Usual for the high bytes, nothing to add
+      continue;
+    }
+    pos = unpackPlane(pos, end, n, plane);
+    for(size_t i = 0 ; i < n ; ++i)
+      words[i] |= static_cast<uint64>(plane[i]) << (8 * k);
+  }
+  return pos;
+}
+
+/**
+ * Convert a decimal mantissa and scale back to a double
+ *
+ * NOTE: Both operands are exact and IEEE division/multiplication round
+ *       correctly, so this gives the same double as parsing the decimal
+ *
+ * @param m       The mantissa
+ * @param scale   Power of ten (0 to 2 * MAX_POW10, MAX_POW10 meaning 10^0)
+ * @return  m / 10^(scale - MAX_POW10)
+ */
+static double fromDecimal(int64 m, int scale)
+{
+  int e = scale - MAX_POW10;
+  return (e >= 0) ? static_cast<double>(m) / POW10[e] : static_cast<double>(m) * POW10[-e];
+}
+
+/**
+ * Try to write a value as a decimal with a given power of ten
+ *
+ * @param val     The value
+ * @param scale   The power (see fromDecimal())
+ * @param m       Receives the mantissa
+ * @return  True if m / 10^(scale - MAX_POW10) is exactly val
+ */
+static bool tryDecimal(double val, int scale, int64& m)
+{
+  int e = scale - MAX_POW10;
+  double scaled = (e >= 0) ? val * POW10[e] : val / POW10[-e];
+  if(scaled >= MAX_MANTISSA || scaled <= -MAX_MANTISSA)
+    return false;
+  m = static_cast<int64>((scaled < 0) ? scaled - 0.5 : scaled + 0.5);
+  return fromDecimal(m, scale) == val;
+}
+
+/**
+ * Find the shortest decimal that gives a value
+ *
+ * @param val     The value
+ * @param m       Receives the mantissa
+ * @return  The scale (see fromDecimal()), or NOT_DECIMAL if there is none
+ */
+static int toDecimal(double val, int64& m)
+{
+  if(val != val || val > 1e300 || val < -1e300)
+    return NOT_DECIMAL;
+
+  // Start from the power that leaves a single digit
+  int first = MAX_POW10 - static_cast<int>(floor(log10(fabs(val)))) - 1;
+  for(int scale = max(first, 0) ; scale <= 2 * MAX_POW10 ; ++scale) {
+    if(tryDecimal(val, scale, m))
+      return scale;
+  }
+
+  return NOT_DECIMAL;
+}
+
+/**
+ * Count the decimal digits of a mantissa
+ *
+ * @param m   The mantissa (not 0)
+ * @return  Number of digits
+ */
+static int digitsOf(int64 m)
+{
+  uint64 u = (m < 0) ? -static_cast<uint64>(m) : static_cast<uint64>(m);
+  int digits = 0;
+  for( ; u > 0 ; u /= 10)
+    digits++;
+  return digits;
+}
+
+const size_t PackedGrid::NO_BLOCK;
+
+/**
+ * Constructor
+ */
+PackedGrid::PackedGrid()
+  : count(0)
+{
+}
+
+/**
+ * Pack a layer block onto the end of the grid
+ *
+ * NOTE: A tile never spans two blocks
+ *
+ * @param vals  The values
+ * @param n     Number of values
+ */
+void PackedGrid::append(const double* vals, size_t n)
+{
+  blockTiles.push_back(index.size());
+  for(size_t i = 0 ; i < n ; i += TILE_VALUES) {
+    size_t m = min(static_cast<size_t>(TILE_VALUES), n - i);
+    addTile(m);
+    packTile(vals + i, m);
+  }
+}
+
+/**
+ * Track the error made rounding values to floats
+ *
+ * @param vals      The values
+ * @param n         Number of values
+ * @param absError  Raised to the largest absolute error
+ * @param relError  Raised to the largest error relative to the value
+ */
+static void roundingError(const double* vals, size_t n, double& absError, double& relError)
+{
+  for(size_t i = 0 ; i < n ; ++i) {
+    double err = fabs(static_cast<float>(vals[i]) - vals[i]);
+    absError = max(absError, err);
+    if(vals[i] != 0.0)
+      relError = max(relError, err / fabs(vals[i]));
+  }
+}
+
+/**
+ * Store a layer block onto the end of the grid
+ *
+ * @param vals      The values
+ * @param n         Number of values
+ * @param mode      How to store the tiles
+ * @param absError  Raised to the largest absolute error made rounding
+ * @param relError  Raised to the largest error relative to the value
+ * @param earlier   Block of as many values to store changes from (NO_BLOCK for none, lossless only)
+ * @param previous  The values of that block (as they unpack)
+ */
+void PackedGrid::append(const double* vals, size_t n, const PackMode& mode, double& absError, double& relError,
+                        size_t earlier, const double* previous)
+{
+  // Tiles line up with those of the earlier block since it holds as many values
+  bool changes = (earlier < blockTiles.size() && previous != NULL && mode.lossless && !mode.single);
+  if(changes && firstTile(earlier + 1) - firstTile(earlier) != (n + TILE_VALUES - 1) / TILE_VALUES)
+    changes = false;
+
+  blockTiles.push_back(index.size());
+  for(size_t i = 0 ; i < n ; i += TILE_VALUES) {
+    size_t m = min(static_cast<size_t>(TILE_VALUES), n - i);
+    size_t tile = changes ? firstTile(earlier) + i / TILE_VALUES : NO_BLOCK;
+    size_t offset = addTile(m);
+
+    if(mode.sparse > 0.0) {
+      // Only +0.0 is left out, so -0.0 keeps its sign
+      size_t nonzero = 0;
+      for(size_t j = i ; j < i + m ; ++j) {
+        uint64 bits;
+        memcpy(&bits, &vals[j], sizeof(bits));
+        nonzero += (bits != 0);
+      }
+      if(nonzero < mode.sparse * m) {
+        sparseTile(vals + i, m, mode.single);
+        if(mode.single)
+          roundingError(vals + i, m, absError, relError);
+        continue;
+      }
+    }
+
+    if(mode.lossless) {
+      // Short decimals often pack smaller than floats, and then lose nothing
+      packTile(vals + i, m);
+
+      // Unless few cells changed since the earlier tile (and the chain is short enough)
+      if(tile != NO_BLOCK) {
+        size_t chain = 1;
+        bool listed;
+        for(size_t t = tile ; chain < DELTA_CHAIN && deltaOf(t, t, listed) != NULL ; ++chain)
+          ;
+        if(chain < DELTA_CHAIN) {
+          vector<unsigned char> whole(data.begin() + offset, data.end());
+          data.resize(offset);
+          deltaTile(vals + i, m, tile, previous + i);
+          if(data.size() - offset >= whole.size()) {
+            data.resize(offset);
+            data.insert(data.end(), whole.begin(), whole.end());
+          }
+        }
+      }
+
+      if(!mode.single || data.size() - offset <= 1 + m * sizeof(float))
+        continue;
+      data.resize(offset);
+    }
+
+    if(mode.single) {
+      singleTile(vals + i, m, data);
+      roundingError(vals + i, m, absError, relError);
+    } else {
+      data.resize(offset + 1 + m * sizeof(double));
+      data[offset] = TILE_RAW;
+      memcpy(&data[offset + 1], vals + i, m * sizeof(double));
+    }
+  }
+}
+
+/**
+ * Add a tile to the index (its data is what follows)
+ *
+ * @param n     Number of values in it
+ * @return  Where its data starts
+ */
+size_t PackedGrid::addTile(size_t n)
+{
+  Tile tile;
+  tile.first = count;
+  tile.offset = data.size();
+  index.push_back(tile);
+  count += n;
+  return tile.offset;
+}
+
+/**
+ * Store one tile as raw floats onto the end of data
+ *
+ * @param vals  The values (rounded to the nearest float)
+ * @param n     Number of values (at most TILE_VALUES)
+ * @param out   Buffer to append to
+ */
+void PackedGrid::singleTile(const double* vals, size_t n, vector<unsigned char>& out)
+{
+  size_t offset = out.size();
+  out.resize(offset + 1 + n * sizeof(float));
+  out[offset] = TILE_SINGLE;
+
+  float single[TILE_VALUES];
+  for(size_t i = 0 ; i < n ; ++i)
+    single[i] = static_cast<float>(vals[i]);
+  memcpy(&out[offset + 1], single, n * sizeof(float));
+}
+
+/**
+ * Store one tile as changes from an earlier tile onto the end of data
+ *
+ * Cells that did not change leave words of zero, so either the byte planes
+ * of every word pack down to almost nothing, or only the cells that changed
+ * are listed, whichever is smaller
+ *
+ * @param vals      The values
+ * @param n         Number of values (at most TILE_VALUES)
+ * @param earlier   Index of the earlier tile (as many values)
+ * @param previous  Its values
+ */
+void PackedGrid::deltaTile(const double* vals, size_t n, size_t earlier, const double* previous)
+{
+  uint64 words[TILE_VALUES];
+  uint64 changes[TILE_VALUES];
+  unsigned short cells[TILE_VALUES];
+  unsigned short changed = 0;
+  for(size_t i = 0 ; i < n ; ++i) {
+    uint64 bits, before;
+    memcpy(&bits, &vals[i], sizeof(bits));
+    memcpy(&before, &previous[i], sizeof(before));
+    words[i] = bits ^ before;
+    if(words[i] != 0) {
+      cells[changed] = static_cast<unsigned short>(i);
+      changes[changed++] = words[i];
+    }
+  }
+
+  // The earlier tile is stored as how far back it is
+  size_t offset = data.size();
+  unsigned distance = static_cast<unsigned>(index.size() - 1 - earlier);
+  data.push_back(TILE_DELTA);
+  for(size_t k = 0 ; k < sizeof(distance) ; ++k)
+    data.push_back(static_cast<unsigned char>(distance >> (8 * k)));
+  size_t header = data.size();
+  packWords(words, n, data);
+
+  vector<unsigned char> listed(reinterpret_cast<unsigned char*>(&changed), reinterpret_cast<unsigned char*>(&changed + 1));
+  listed.insert(listed.end(), reinterpret_cast<unsigned char*>(cells), reinterpret_cast<unsigned char*>(cells + changed));
+  packWords(changes, changed, listed);
+  if(listed.size() < data.size() - header) {
+    data[offset] = TILE_CHANGED;
+    data.resize(header);
+    data.insert(data.end(), listed.begin(), listed.end());
+  }
+}
+
+/**
+ * Find what a tile stored as changes refers to
+ *
+ * @param tile      Index of the tile
+ * @param earlier   Receives the index of the tile it changes
+ * @param listed    Receives true if only the cells that changed are stored
+ * @return  Start of its changes (NULL if the tile is stored whole)
+ */
+const unsigned char* PackedGrid::deltaOf(size_t tile, size_t& earlier, bool& listed) const
+{
+  if(tile >= index.size())
+    return NULL;
+  const unsigned char* pos = &data[0] + index[tile].offset;
+  if(*pos != TILE_DELTA && *pos != TILE_CHANGED)
+    return NULL;
+  listed = (*pos++ == TILE_CHANGED);
+
+  unsigned distance = 0;
+  for(size_t k = 0 ; k < sizeof(distance) ; ++k)
+    distance |= static_cast<unsigned>(*pos++) << (8 * k);
+  earlier = tile - distance;
+  return pos;
+}
+
+/**
+ * Apply the changes of a tile stored as changes to the values of the tile it changes
+ *
+ * @param changes   Start of the changes (see deltaOf())
+ * @param listed    True if only the cells that changed are stored
+ * @param n         Number of values
+ * @param vals      The earlier tile's values, changed in place
+ */
+void PackedGrid::applyDelta(const unsigned char* changes, bool listed, size_t n, double* vals) const
+{
+  const unsigned char* end = &data[0] + data.size();
+  uint64 words[TILE_VALUES];
+  unsigned short cells[TILE_VALUES];
+  if(listed) {
+    unsigned short changed;
+    memcpy(&changed, changes, sizeof(changed));
+    changes += sizeof(changed);
+    memcpy(cells, changes, changed * sizeof(cells[0]));
+    changes += changed * sizeof(cells[0]);
+    n = changed;
+  }
+  unpackWords(changes, end, n, words);
+
+  for(size_t i = 0 ; i < n ; ++i) {
+    double& val = vals[listed ? cells[i] : i];
+    uint64 bits;
+    memcpy(&bits, &val, sizeof(bits));
+    bits ^= words[i];
+    memcpy(&val, &bits, sizeof(bits));
+  }
+}
+
+/**
+ * Store the nonzero values of one tile and their cells onto the end of data
+ *
+ * The tile is stored as its count of nonzero values, the cell of each one
+ * and then the values, so kernels can work on the values as they are
+ *
+ * @param vals    The values
+ * @param n       Number of values (at most TILE_VALUES)
+ * @param single  If true, the values are rounded to floats
+ */
+void PackedGrid::sparseTile(const double* vals, size_t n, bool single)
+{
+  unsigned short cells[TILE_VALUES];
+  double nonzero[TILE_VALUES];
+  unsigned short nnz = 0;
+  for(size_t i = 0 ; i < n ; ++i) {
+    uint64 bits;
+    memcpy(&bits, &vals[i], sizeof(bits));
+    if(bits != 0) {
+      cells[nnz] = static_cast<unsigned short>(i);
+      nonzero[nnz++] = vals[i];
+    }
+  }
+
+  size_t offset = data.size();
+  size_t width = single ? sizeof(float) : sizeof(double);
+  data.resize(offset + 1 + sizeof(nnz) + nnz * (sizeof(cells[0]) + width));
+  unsigned char* pos = &data[offset];
+  *pos++ = single ? TILE_SPARSE_SINGLE : TILE_SPARSE;
+  memcpy(pos, &nnz, sizeof(nnz));
+  pos += sizeof(nnz);
+  memcpy(pos, cells, nnz * sizeof(cells[0]));
+  pos += nnz * sizeof(cells[0]);
+  if(single) {
+    float rounded[TILE_VALUES];
+    for(size_t i = 0 ; i < nnz ; ++i)
+      rounded[i] = static_cast<float>(nonzero[i]);
+    memcpy(pos, rounded, nnz * sizeof(float));
+  } else {
+    memcpy(pos, nonzero, nnz * sizeof(double));
+  }
+}
+
+/**
+ * Pack one tile onto the end of data
+ *
+ * Both ways of coding the tile are tried and the smaller one is kept (raw
+ * floats too when every value fits one exactly)
+ *
+ * @param vals  The values
+ * @param n     Number of values (at most TILE_VALUES)
+ */
+void PackedGrid::packTile(const double* vals, size_t n)
+{
+  const Tile& tile = index.back();
+
+  // XOR each value with the one before it
+  uint64 words[TILE_VALUES];
+  uint64 prev = 0;
+  for(size_t i = 0 ; i < n ; ++i) {
+    uint64 bits;
+    memcpy(&bits, &vals[i], sizeof(bits));
+    words[i] = bits ^ prev;
+    prev = bits;
+  }
+
+  data.push_back(TILE_XOR);
+  packWords(words, n, data);
+
+  // Values read from text are usually short decimals: find each one's
+  // shortest decimal, then pad them all to the same number of significant
+  // digits, so neighbours with the same exponent have close mantissas
+  unsigned char scales[TILE_VALUES];
+  int64 mantissas[TILE_VALUES];
+  vector<double> exceptions;
+  int precision = 1;
+  for(size_t i = 0 ; i < n ; ++i) {
+    int scale = NOT_DECIMAL;
+    mantissas[i] = 0;
+    if(vals[i] != 0.0)
+      scale = toDecimal(vals[i], mantissas[i]);
+    else if(1.0 / vals[i] > 0)
+      scale = MAX_POW10; // -0.0 keeps its sign bit as raw bits
+    if(scale == NOT_DECIMAL)
+      exceptions.push_back(vals[i]);
+    else if(mantissas[i] != 0)
+      precision = max(precision, digitsOf(mantissas[i]));
+    scales[i] = static_cast<unsigned char>(scale);
+  }
+
+  int64 last = 0;
+  for(size_t i = 0 ; i < n ; ++i) {
+    if(scales[i] == NOT_DECIMAL) {
+      mantissas[i] = last;
+    } else if(mantissas[i] != 0) {
+      int64 m = mantissas[i];
+      int scale = scales[i];
+      while(digitsOf(m) < precision && scale < 2 * MAX_POW10 && m < MAX_MANTISSA / 10 && m > -MAX_MANTISSA / 10) {
+        m *= 10;
+        scale++;
+      }
+      if(fromDecimal(m, scale) == vals[i]) {
+        mantissas[i] = m;
+        scales[i] = static_cast<unsigned char>(scale);
+      }
+    }
+    int64 delta = mantissas[i] - last;
+    words[i] = (static_cast<uint64>(delta) << 1) ^ static_cast<uint64>(delta >> 63); // Zigzag: small either side of 0
+    last = mantissas[i];
+  }
+
+  // Values rounded to single precision beforehand lose nothing as floats
+  // (compared bit for bit, so NaN payloads are not lost)
+  bool single = true;
+  for(size_t i = 0 ; i < n && single ; ++i) {
+    double back = static_cast<float>(vals[i]);
+    single = (memcmp(&back, &vals[i], sizeof(back)) == 0);
+  }
+  if(single && 1 + n * sizeof(float) < data.size() - tile.offset) {
+    data.resize(tile.offset);
+    singleTile(vals, n, data);
+  }
+
+  // Not worth it if too many values are not decimals
+  if(exceptions.size() * sizeof(double) >= data.size() - tile.offset)
+    return;
+
+  vector<unsigned char> decimal(1, TILE_DECIMAL);
+  packPlane(scales, n, decimal);
+  packWords(words, n, decimal);
+  for(size_t i = 0 ; i < exceptions.size() ; ++i) {
+    uint64 bits;
+    memcpy(&bits, &exceptions[i], sizeof(bits));
+    for(int k = 0 ; k < PLANES ; ++k)
+      decimal.push_back(static_cast<unsigned char>(bits >> (8 * k)));
+  }
+
+  if(decimal.size() < data.size() - tile.offset) {
+    data.resize(tile.offset);
+    data.insert(data.end(), decimal.begin(), decimal.end());
+  }
+}
+
+/**
+ * Unpack one tile
+ *
+ * @param tile  Index of the tile
+ * @param out   Receives the values (room for TILE_VALUES)
+ * @return  Number of values in the tile
+ */
+size_t PackedGrid::unpack(size_t tile, double* out) const
+{
+  if(tile >= index.size())
+    return 0;
+
+  size_t n = ((tile + 1 < index.size()) ? index[tile + 1].first : count) - index[tile].first;
+  const unsigned char* pos = &data[0] + index[tile].offset;
+  const unsigned char* end = &data[0] + data.size();
+  uint64 words[TILE_VALUES];
+
+  if(*pos == TILE_SINGLE) {
+    float single[TILE_VALUES];
+    memcpy(single, pos + 1, n * sizeof(float));
+    for(size_t i = 0 ; i < n ; ++i)
+      out[i] = single[i];
+    return n;
+  }
+
+  if(*pos == TILE_RAW) {
+    memcpy(out, pos + 1, n * sizeof(double));
+    return n;
+  }
+
+  size_t earlier;
+  bool listed;
+  const unsigned char* changes = deltaOf(tile, earlier, listed);
+  if(changes != NULL) {
+    // Unpack the earlier tile in place, then apply the changes to it
+    unpack(earlier, out);
+    applyDelta(changes, listed, n, out);
+    return n;
+  }
+
+  if(*pos == TILE_SPARSE || *pos == TILE_SPARSE_SINGLE) {
+    double vals[TILE_VALUES];
+    unsigned short cells[TILE_VALUES];
+    size_t nnz;
+    unpackSparse(tile, vals, cells, nnz);
+    fill(out, out + n, 0.0);
+    for(size_t i = 0 ; i < nnz ; ++i)
+      out[cells[i]] = vals[i];
+    return n;
+  }
+
+  if(*pos++ == TILE_XOR) {
+    unpackWords(pos, end, n, words);
+
+    // Undo the XOR with the previous value
+    uint64 prev = 0;
+    for(size_t i = 0 ; i < n ; ++i) {
+      prev ^= words[i];
+      memcpy(&out[i], &prev, sizeof(prev));
+    }
+    return n;
+  }
+
+  unsigned char scales[TILE_VALUES];
+  pos = unpackPlane(pos, end, n, scales);
+  pos = unpackWords(pos, end, n, words);
+
+  int64 m = 0;
+  for(size_t i = 0 ; i < n ; ++i) {
+    m += static_cast<int64>(words[i] >> 1) ^ -static_cast<int64>(words[i] & 1);
+    if(scales[i] == NOT_DECIMAL) {
+      uint64 bits = 0;
+      for(int k = 0 ; k < PLANES ; ++k)
+        bits |= static_cast<uint64>(*pos++) << (8 * k);
+      memcpy(&out[i], &bits, sizeof(bits));
+    } else {
+      out[i] = fromDecimal(m, scales[i]);
+    }
+  }
+
+  return n;
+}
+
+/**
+ * Unpack one tile, leaving it as it is if it is stored sparse
+ *
+ * @param tile    Index of the tile
+ * @param out     Receives the values (room for TILE_VALUES)
+ * @param cells   Receives the cell of each value within the tile (room for TILE_VALUES, only if sparse)
+ * @param stored  Receives the number of values in out
+ * @return  Number of cells in the tile (stored unless it is sparse)
+ */
+size_t PackedGrid::unpackSparse(size_t tile, double* out, unsigned short* cells, size_t& stored) const
+{
+  if(!isSparse(tile)) {
+    stored = unpack(tile, out);
+    return stored;
+  }
+
+  size_t n = ((tile + 1 < index.size()) ? index[tile + 1].first : count) - index[tile].first;
+  const unsigned char* pos = &data[0] + index[tile].offset;
+  bool single = (*pos++ == TILE_SPARSE_SINGLE);
+
+  unsigned short nnz;
+  memcpy(&nnz, pos, sizeof(nnz));
+  pos += sizeof(nnz);
+  memcpy(cells, pos, nnz * sizeof(cells[0]));
+  pos += nnz * sizeof(cells[0]);
+  if(single) {
+    float rounded[TILE_VALUES];
+    memcpy(rounded, pos, nnz * sizeof(float));
+    for(size_t i = 0 ; i < nnz ; ++i)
+      out[i] = rounded[i];
+  } else {
+    memcpy(out, pos, nnz * sizeof(double));
+  }
+
+  stored = nnz;
+  return n;
+}
+
+/**
+ * Check if a tile is stored sparse
+ *
+ * @param tile    Index of the tile
+ */
+bool PackedGrid::isSparse(size_t tile) const
+{
+  if(tile >= index.size())
+    return false;
+  unsigned char type = data[index[tile].offset];
+  return type == TILE_SPARSE || type == TILE_SPARSE_SINGLE;
+}
+
+/**
+ * Get the number of values in one tile, without unpacking it
+ *
+ * @param tile  Index of the tile
+ * @return  Number of values in the tile (0 past the last tile)
+ */
+size_t PackedGrid::tileSize(size_t tile) const
+{
+  if(tile >= index.size())
+    return 0;
+  return ((tile + 1 < index.size()) ? index[tile + 1].first : count) - index[tile].first;
+}
+
+/**
+ * Unpack every value
+ *
+ * @param out   Receives the values (replacing anything in it)
+ */
+void PackedGrid::unpackAll(vector<double>& out) const
+{
+  out.resize(count);
+  for(size_t t = 0 ; t < index.size() ; ++t) {
+    // The earlier tile of one stored as changes is already unpacked
+    size_t earlier;
+    bool listed;
+    const unsigned char* changes = deltaOf(t, earlier, listed);
+    if(changes == NULL) {
+      unpack(t, &out[index[t].first]);
+      continue;
+    }
+
+    size_t n = ((t + 1 < index.size()) ? index[t + 1].first : count) - index[t].first;
+    copy(out.begin() + index[earlier].first, out.begin() + index[earlier].first + n, out.begin() + index[t].first);
+    applyDelta(changes, listed, n, &out[index[t].first]);
+  }
+}
+
+/**
+ * Get the memory taken by the packed values
+ *
+ * @return  Size in bytes (including the tile index)
+ */
+size_t PackedGrid::bytes() const
+{
+  return data.capacity() + index.capacity() * sizeof(Tile) + blockTiles.capacity() * sizeof(size_t);
+}
+
+/**
+ * Release memory reserved for values that were never appended
+ */
+void PackedGrid::compact()
+{
+  vector<unsigned char>(data).swap(data);
+  vector<Tile>(index).swap(index);
+  vector<size_t>(blockTiles).swap(blockTiles);
+}
+
+/**
+ * Remove every value
+ */
+void PackedGrid::clear()
+{
+  vector<unsigned char>().swap(data);
+  vector<Tile>().swap(index);
+  vector<size_t>().swap(blockTiles);
+  count = 0;
+}
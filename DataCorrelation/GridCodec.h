@@ -0,0 +1,258 @@
+/**
+ * GridCodec.h
+ *
+ * Lossless compression of grids of doubles, in tiles that can be
+ * unpacked one at a time while scanning
+ *
+ * Each tile is coded one of two ways, whichever is smaller:
+ *   - XOR: every value's bits are XORed with those of the value before it,
+ *     so neighbouring cells with the same sign and exponent leave zero high bytes
+ *   - DECIMAL: every value is split into the decimal mantissa and power of
+ *     ten it was printed with; the change in mantissa from one value to the
+ *     next is stored along with a plane of powers (values with no exact
+ *     decimal are stored as raw bits after the planes)
+ * The 64-bit words are split into 8 byte planes (byte k of every word), and
+ * each plane is stored as all zeros, raw, or Huffman coded, whichever is smallest.
+ * A tile whose values all fit a float exactly may also be stored as raw
+ * floats (SINGLE).
+ *
+ * Blocks appended with a PackMode may also be stored in single precision
+ * (rounded), as raw doubles when not packing losslessly, or, for tiles with
+ * few nonzero values, as the positions and values of those only (SPARSE).
+ * A block may also name an earlier block holding the same cells (the same
+ * layer at the previous TIME): its tiles are then stored as the XOR of
+ * their bits with those of the earlier block's (DELTA), or as a list of
+ * just the cells that changed (CHANGED), when that is smaller, so cells
+ * that did not change cost next to nothing. Unpacking such a tile
+ * unpacks the one it refers to first, so every few tiles in a chain are
+ * stored whole to bound the work.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef GRIDCODEC_H__
+#define GRIDCODEC_H__
+
+#include <cstddef>
+#include <vector>
+
+#include "GridView.h"
+
+/**
+ * How PackedGrid::append() stores the tiles of a block
+ */
+struct PackMode
+{
+  PackMode()
+    : lossless(true), single(false), sparse(0.0)
+  {
+  }
+  bool lossless; // Pack tiles losslessly (otherwise they are stored raw)
+  bool single;   // Store tiles as floats (only where smaller than packing them losslessly)
+  double sparse; // Store tiles with fewer nonzero values than this fraction of their cells sparse (0 never)
+};
+
+class PackedGrid
+{
+public:
+  static const size_t NO_BLOCK = static_cast<size_t>(-1);
+
+  /**
+   * Constructor
+   */
+  PackedGrid();
+
+  /**
+   * Destructor
+   */
+  virtual ~PackedGrid(){}
+
+  /**
+   * Pack a layer block onto the end of the grid
+   *
+   * NOTE: A tile never spans two blocks
+   *
+   * @param vals  The values
+   * @param n     Number of values
+   */
+  void append(const double* vals, size_t n);
+
+  /**
+   * Store a layer block onto the end of the grid
+   *
+   * NOTE: The values of a tile stored as floats are rounded to the nearest one
+   *
+   * @param vals      The values
+   * @param n         Number of values
+   * @param mode      How to store the tiles
+   * @param absError  Raised to the largest absolute error made rounding
+   * @param relError  Raised to the largest error relative to the value
+   * @param earlier   Block of as many values to store changes from (NO_BLOCK for none, lossless only)
+   * @param previous  The values of that block (as they unpack)
+   */
+  void append(const double* vals, size_t n, const PackMode& mode, double& absError, double& relError,
+              size_t earlier=NO_BLOCK, const double* previous=NULL);
+
+  /**
+   * Unpack one tile
+   *
+   * @param tile  Index of the tile
+   * @param out   Receives the values (room for TILE_VALUES)
+   * @return  Number of values in the tile
+   */
+  size_t unpack(size_t tile, double* out) const;
+
+  /**
+   * Unpack one tile, leaving it as it is if it is stored sparse
+   *
+   * @param tile    Index of the tile
+   * @param out     Receives the values (room for TILE_VALUES)
+   * @param cells   Receives the cell of each value within the tile (room for TILE_VALUES, only if sparse)
+   * @param stored  Receives the number of values in out
+   * @return  Number of cells in the tile (stored unless it is sparse)
+   */
+  size_t unpackSparse(size_t tile, double* out, unsigned short* cells, size_t& stored) const;
+
+  /**
+   * Check if a tile is stored sparse
+   *
+   * @param tile    Index of the tile
+   */
+  bool isSparse(size_t tile) const;
+
+  /**
+   * Get the number of values in one tile, without unpacking it
+   *
+   * @param tile  Index of the tile
+   * @return  Number of values in the tile (0 past the last tile)
+   */
+  size_t tileSize(size_t tile) const;
+
+  /**
+   * Unpack every value
+   *
+   * @param out   Receives the values (replacing anything in it)
+   */
+  void unpackAll(std::vector<double>& out) const;
+
+  /**
+   * Get the number of values
+   */
+  size_t size() const { return count; }
+
+  /**
+   * Get the memory taken by the packed values
+   *
+   * @return  Size in bytes (including the tile index)
+   */
+  size_t bytes() const;
+
+  /**
+   * Get the number of tiles
+   */
+  size_t tiles() const { return index.size(); }
+
+  /**
+   * Get the first tile of a block
+   *
+   * @param block   Index of the block (blocks() for the end of the last one)
+   * @return  Index of the tile
+   */
+  size_t firstTile(size_t block) const { return (block < blockTiles.size()) ? blockTiles[block] : index.size(); }
+
+  /**
+   * Get the number of blocks appended
+   */
+  size_t blocks() const { return blockTiles.size(); }
+
+  /**
+   * Release memory reserved for values that were never appended
+   */
+  void compact();
+
+  /**
+   * Remove every value
+   */
+  void clear();
+
+private:
+  /**
+   * Where a tile starts
+   */
+  struct Tile
+  {
+    size_t first;  // Index of the tile's first value
+    size_t offset; // Where its planes start in data
+  };
+
+  /**
+   * Pack one tile onto the end of data
+   *
+   * @param vals  The values
+   * @param n     Number of values (at most TILE_VALUES)
+   */
+  void packTile(const double* vals, size_t n);
+
+  /**
+   * Add a tile to the index (its data is what follows)
+   *
+   * @param n     Number of values in it
+   * @return  Where its data starts
+   */
+  size_t addTile(size_t n);
+
+  /**
+   * Store one tile as changes from an earlier tile onto the end of data
+   *
+   * @param vals      The values
+   * @param n         Number of values (at most TILE_VALUES)
+   * @param earlier   Index of the earlier tile (as many values)
+   * @param previous  Its values
+   */
+  void deltaTile(const double* vals, size_t n, size_t earlier, const double* previous);
+
+  /**
+   * Find what a tile stored as changes refers to
+   *
+   * @param tile      Index of the tile
+   * @param earlier   Receives the index of the tile it changes
+   * @param listed    Receives true if only the cells that changed are stored
+   * @return  Start of its changes (NULL if the tile is stored whole)
+   */
+  const unsigned char* deltaOf(size_t tile, size_t& earlier, bool& listed) const;
+
+  /**
+   * Apply the changes of a tile stored as changes to the values of the tile it changes
+   *
+   * @param changes   Start of the changes (see deltaOf())
+   * @param listed    True if only the cells that changed are stored
+   * @param n         Number of values
+   * @param vals      The earlier tile's values, changed in place
+   */
+  void applyDelta(const unsigned char* changes, bool listed, size_t n, double* vals) const;
+
+  /**
+   * Store one tile as raw floats onto the end of data
+   *
+   * @param vals  The values (rounded to the nearest float)
+   * @param n     Number of values (at most TILE_VALUES)
+   * @param out   Buffer to append to
+   */
+  static void singleTile(const double* vals, size_t n, std::vector<unsigned char>& out);
+
+  /**
+   * Store the nonzero values of one tile and their cells onto the end of data
+   *
+   * @param vals    The values
+   * @param n       Number of values (at most TILE_VALUES)
+   * @param single  If true, the values are rounded to floats
+   */
+  void sparseTile(const double* vals, size_t n, bool single);
+
+  std::vector<unsigned char> data;
+  std::vector<Tile> index;
+  std::vector<size_t> blockTiles; // First tile of each block
+  size_t count;
+};
+
+#endif /** GRIDCODEC_H__ */
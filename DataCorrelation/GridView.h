@@ -0,0 +1,119 @@
+/**
+ * GridView.h
+ *
+ * Read-only view of values owned by a parser
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef GRIDVIEW_H__
+#define GRIDVIEW_H__
+
+#include <cstddef>
+
+#define TILE_VALUES 2048 // Values per tile handed out by ParserBase::getTile() (16KB, so a tile stays in cache while it is scanned)
+
+class GridView
+{
+public:
+  /**
+   * Constructor (empty view)
+   */
+  GridView()
+    : ptr(NULL), len(0)
+  {
+  }
+
+  /**
+   * Constructor
+   *
+   * @param data  First value in the view
+   * @param size  Number of values in the view
+   */
+  GridView(const double* data, size_t size)
+    : ptr(data), len(size)
+  {
+  }
+
+  /**
+   * Destructor
+   */
+  virtual ~GridView(){}
+
+  /**
+   * Get the values
+   *
+   * NOTE: Only valid for as long as the parser that owns them
+   *
+   * @return  Pointer to the first value
+   */
+  const double* data() const { return ptr; }
+
+  /**
+   * Get the number of values
+   *
+   * @return  Number of values in the view
+   */
+  size_t size() const { return len; }
+
+  /**
+   * Check if there are no values
+   *
+   * @return  True if the view is empty, false otherwise
+   */
+  bool empty() const { return len == 0; }
+
+  /**
+   * Get a value
+   *
+   * @param i   Index of the value (not bounds checked)
+   * @return  The value
+   */
+  const double& operator[](size_t i) const { return ptr[i]; }
+
+  /**
+   * Iterators over the values
+   */
+  const double* begin() const { return ptr; }
+  const double* end() const { return ptr + len; }
+
+  /**
+   * Get a view of the first n values
+   *
+   * @param n   Number of values (0 or more than size() means all of them)
+   * @return  The shortened view
+   */
+  GridView first(size_t n) const { return GridView(ptr, (n == 0 || n > len) ? len : n); }
+
+private:
+  const double* ptr;
+  size_t len;
+};
+
+/**
+ * One tile of values that may be stored sparse: only the nonzero values,
+ * each with its cell within the tile, every other cell being zero
+ */
+struct SparseTile
+{
+  SparseTile()
+    : cells(NULL), size(0)
+  {
+  }
+
+  SparseTile(const GridView& values, const unsigned short* cells, size_t size)
+    : values(values), cells(cells), size(size)
+  {
+  }
+
+  /**
+   * Check if only the nonzero values are held
+   */
+  bool sparse() const { return cells != NULL; }
+
+  GridView values;              // The values (every cell's when dense)
+  const unsigned short* cells;  // Cell of each value (NULL when dense)
+  size_t size;                  // Number of cells in the tile (0 past the last tile)
+};
+
+#endif /** GRIDVIEW_H__ */
@@ -0,0 +1,266 @@
+/**
+ * KendallTau.cpp
+ *
+ * Kendall's tau-b of two grids in O(n log n) (Knight's algorithm)
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#include "DCException.h"
+#include "KendallTau.h"
+#include "RadixSort.h"
+#include "ThreadPool.h"
+
+typedef unsigned long long uint64;
+
+using namespace std;
+
+/**
+ * Count the pairs within runs of equal keys
+ *
+ * @param keys  The keys (sorted)
+ * @param n     Number of keys
+ * @return  Sum of t * (t - 1) / 2 over every run of t equal keys
+ */
+static uint64 tiedPairs(const uint64* keys, size_t n)
+{
+  uint64 ret = 0;
+  size_t i = 0;
+  while(i < n) {
+    size_t j = i + 1;
+    while(j < n && keys[j] == keys[i])
+      ++j;
+    uint64 t = j - i;
+    ret += t * (t - 1) / 2;
+    i = j;
+  }
+  return ret;
+}
+
+/**
+ * Count the pairs within runs where both keys are equal
+ *
+ * @param xs  The first keys (sorted)
+ * @param ys  The second keys (sorted within each run of equal first keys)
+ * @param n   Number of pairs
+ * @return  Sum of t * (t - 1) / 2 over every run of t equal pairs
+ */
+static uint64 jointTies(const uint64* xs, const uint64* ys, size_t n)
+{
+  uint64 ret = 0;
+  size_t i = 0;
+  while(i < n) {
+    size_t j = i + 1;
+    while(j < n && xs[j] == xs[i] && ys[j] == ys[i])
+      ++j;
+    uint64 t = j - i;
+    ret += t * (t - 1) / 2;
+    i = j;
+  }
+  return ret;
+}
+
+/**
+ * Merge two sorted runs, counting the swaps a bubble sort would make
+ *
+ * @param src   The runs ([lo, mid) and [mid, hi))
+ * @param dst   Receives the merged run at [lo, hi)
+ * @return  Number of pairs the merge put in the other order (equal keys keep theirs)
+ */
+static uint64 mergeRuns(const uint64* src, uint64* dst, size_t lo, size_t mid, size_t hi)
+{
+  uint64 swaps = 0;
+  size_t i = lo, j = mid, k = lo;
+  while(i < mid && j < hi) {
+    if(src[j] < src[i]) {
+      // Goes ahead of every key left in the first run
+      swaps += mid - i;
+      dst[k++] = src[j++];
+    } else {
+      dst[k++] = src[i++];
+    }
+  }
+  while(i < mid)
+    dst[k++] = src[i++];
+  while(j < hi)
+    dst[k++] = src[j++];
+  return swaps;
+}
+
+/**
+ * Merge sorts one thread's run of keys, counting swaps
+ */
+class MergeSortTask : public Task
+{
+public:
+  MergeSortTask(uint64* keys, uint64* buffer, size_t first, size_t last)
+    : keys(keys), buffer(buffer), first(first), last(last), swaps(0)
+  {
+  }
+
+  virtual void run()
+  {
+    // Bottom up, between the keys and the buffer
+    uint64* src = keys;
+    uint64* dst = buffer;
+    for(size_t width = 1 ; width < last - first ; width *= 2) {
+      for(size_t lo = first ; lo < last ; lo += 2 * width) {
+        size_t mid = min(lo + width, last);
+        size_t hi = min(lo + 2 * width, last);
+        swaps += mergeRuns(src, dst, lo, mid, hi);
+      }
+      swap(src, dst);
+    }
+    if(src != keys)
+      copy(src + first, src + last, keys + first);
+  }
+
+  uint64* keys;
+  uint64* buffer;
+  size_t first, last;
+  uint64 swaps;
+};
+
+/**
+ * Merges two neighbouring sorted runs on a pool thread, counting swaps
+ */
+class MergeTask : public Task
+{
+public:
+  MergeTask(uint64* keys, uint64* buffer, size_t lo, size_t mid, size_t hi)
+    : keys(keys), buffer(buffer), lo(lo), mid(mid), hi(hi), swaps(0)
+  {
+  }
+
+  virtual void run()
+  {
+    swaps = mergeRuns(keys, buffer, lo, mid, hi);
+    copy(buffer + lo, buffer + hi, keys + lo);
+  }
+
+  uint64* keys;
+  uint64* buffer;
+  size_t lo, mid, hi;
+  uint64 swaps;
+};
+
+/**
+ * Merge sort keys on a pool, counting swaps
+ *
+ * @param keys    The keys (sorted in place)
+ * @param buffer  Room for as many keys
+ * @param pool    Threads to sort with
+ * @return  Number of pairs out of order (equal keys are in order)
+ */
+static uint64 countSwaps(vector<uint64>& keys, vector<uint64>& buffer, ThreadPool& pool)
+{
+  size_t n = keys.size();
+  unsigned workers = pool.size() > 0 ? pool.size() : 1;
+  vector<size_t> bounds;
+  for(unsigned w = 0 ; w <= workers ; ++w)
+    bounds.push_back(n * w / workers);
+
+  // Every thread sorts its own run...
+  uint64 swaps = 0;
+  vector<MergeSortTask> sorts;
+  for(unsigned w = 0 ; w < workers ; ++w)
+    sorts.push_back(MergeSortTask(&keys[0], &buffer[0], bounds[w], bounds[w + 1]));
+  vector<Task*> work;
+  for(unsigned w = 0 ; w < workers ; ++w)
+    work.push_back(&sorts[w]);
+  pool.run(work);
+  for(unsigned w = 0 ; w < workers ; ++w)
+    swaps += sorts[w].swaps;
+
+  // ...then neighbouring runs are merged pairwise, the pairs in parallel
+  for(unsigned step = 1 ; step < workers ; step *= 2) {
+    vector<MergeTask> merges;
+    for(unsigned w = 0 ; w + step < workers ; w += 2 * step)
+      merges.push_back(MergeTask(&keys[0], &buffer[0], bounds[w], bounds[w + step], bounds[min(w + 2 * step, workers)]));
+    work.clear();
+    for(size_t i = 0 ; i < merges.size() ; ++i)
+      work.push_back(&merges[i]);
+    pool.run(work);
+    for(size_t i = 0 ; i < merges.size() ; ++i)
+      swaps += merges[i].swaps;
+  }
+
+  return swaps;
+}
+
+/**
+ * Constructor
+ *
+ * @param n   Number of pairs that will be added (room is reserved for them)
+ */
+KendallTau::KendallTau(size_t n)
+{
+  xKeys.reserve(n);
+  yKeys.reserve(n);
+}
+
+/**
+ * Add the next pairs
+ *
+ * @param x   The first values
+ * @param y   The second values
+ * @param n   Number of pairs
+ */
+void KendallTau::add(const double* x, const double* y, size_t n)
+{
+  for(size_t i = 0 ; i < n ; ++i) {
+    xKeys.push_back(RadixSort::key(x[i]));
+    yKeys.push_back(RadixSort::key(y[i]));
+  }
+}
+
+/**
+ * Compute tau-b over every pair added
+ *
+ * @param threads   Threads to sort with (0 = one per hardware thread)
+ * @return  Kendall's tau-b (NaN if either value is the same in every pair)
+ */
+double KendallTau::compute(unsigned threads)
+{
+  size_t n = xKeys.size();
+  if(n > UINT_MAX)
+    throw DCException("KendallTau: too many pairs");
+  if(n == 0)
+    return sqrt(-1.0);
+
+  // A run of a few thousand pairs per thread at least
+  ThreadPool pool(ThreadPool::resolve(threads, n / 16384 + 1));
+
+  // Order the pairs by their second values, then (stably) by their first
+  vector<unsigned> index(n);
+  for(size_t i = 0 ; i < n ; ++i)
+    index[i] = static_cast<unsigned>(i);
+  vector<uint64> xs(yKeys);
+  RadixSort::sort(xs, index, pool);
+  for(size_t i = 0 ; i < n ; ++i)
+    xs[i] = xKeys[index[i]];
+  RadixSort::sort(xs, index, pool);
+
+  vector<uint64> ys(n);
+  for(size_t i = 0 ; i < n ; ++i)
+    ys[i] = yKeys[index[i]];
+  vector<uint64>().swap(xKeys);
+  vector<uint64>().swap(yKeys);
+  vector<unsigned>().swap(index);
+
+  uint64 xTies = tiedPairs(&xs[0], n);
+  uint64 bothTies = jointTies(&xs[0], &ys[0], n);
+
+  // Pairs the first values order one way and the second values the other
+  uint64 discordant = countSwaps(ys, xs, pool);
+  uint64 yTies = tiedPairs(&ys[0], n);
+
+  uint64 pairs = static_cast<uint64>(n) * (n - 1) / 2;
+  uint64 untied = pairs - xTies - yTies + bothTies; // Concordant + discordant
+  double s = static_cast<double>(untied) - 2.0 * static_cast<double>(discordant);
+  return s / sqrt(static_cast<double>(pairs - xTies) * static_cast<double>(pairs - yTies));
+}
@@ -0,0 +1,65 @@
+/**
+ * KendallTau.h
+ *
+ * Kendall's tau-b of two grids in O(n log n) (Knight's algorithm)
+ *
+ * The pairs are sorted by their first value and then their second (see
+ * RadixSort). The discordant pairs are then counted as the swaps a merge
+ * sort of the second values makes. Ties in either value, and in both,
+ * are counted from the runs of equal values the sorts leave, for the
+ * tau-b correction. Both the sort and the merge sort are split over
+ * threads.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef KENDALLTAU_H__
+#define KENDALLTAU_H__
+
+#include <cstddef>
+#include <vector>
+
+class KendallTau
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param n   Number of pairs that will be added (room is reserved for them)
+   */
+  KendallTau(size_t n=0);
+
+  /**
+   * Destructor
+   */
+  virtual ~KendallTau(){}
+
+  /**
+   * Add the next pairs
+   *
+   * @param x   The first values
+   * @param y   The second values
+   * @param n   Number of pairs
+   */
+  void add(const double* x, const double* y, size_t n);
+
+  /**
+   * Get the number of pairs added
+   */
+  size_t size() const { return xKeys.size(); }
+
+  /**
+   * Compute tau-b over every pair added
+   *
+   * NOTE: The pairs are released once it is computed
+   *
+   * @param threads   Threads to sort with (0 = one per hardware thread)
+   * @return  Kendall's tau-b (NaN if either value is the same in every pair)
+   */
+  double compute(unsigned threads=1);
+
+private:
+  std::vector<unsigned long long> xKeys, yKeys; // Sort keys of each pair's values
+};
+
+#endif /** KENDALLTAU_H__ */
@@ -0,0 +1,720 @@
+/**
+ * Kernels.cpp
+ *
+ * Reductions over arrays of values, dispatched to the best instruction set
+ * the CPU supports
+ *
+ * The vector kernels only ever see whole blocks of KERNEL_LANES values,
+ * with partial sum k kept in element k of a set of registers (2 registers
+ * of 8 with AVX-512, 4 of 4 with AVX2, 8 of 2 with SSE2), so each value is
+ * rounded into the same partial sum as in the scalar loop. The values
+ * before the first whole block and after the last one are added one at a
+ * time. Products are never fused into the sums (no FMA), which would round
+ * them differently.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#include <limits>
+
+#include "Kernels.h"
+
+// Pick the vector kernels this compiler can build
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_SSE2_KERNEL
+#define HAVE_AVX2_KERNEL
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define HAVE_AVX512_KERNEL
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <emmintrin.h>
+#define HAVE_SSE2_KERNEL
+#define TARGET_SSE2
+#if _MSC_VER >= 1700 // AVX2 intrinsics arrived with VS2012
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#define TARGET_AVX2
+#endif
+#if _MSC_VER >= 1911 // AVX-512 intrinsics arrived with VS2017 15.3
+#define HAVE_AVX512_KERNEL
+#define TARGET_AVX512
+#endif
+#endif
+
+using namespace std;
+
+/**
+ * What is added up for each value (or pair of values)
+ */
+enum OP
+{
+  SUM,        // x
+  SQUARES,    // x * x
+  DEVIATIONS, // (x - mean)^2
+  DOT,        // x * y
+  DIFFS,      // (x - y)^2
+  CODEVIATIONS, // (x - xMean) * (y - yMean)
+  OPS
+};
+
+typedef void (*BlockFn)(double* lanes, const double* x, const double* y, double mean, double yMean, size_t blocks);
+typedef void (*FloatBlockFn)(double* lanes, const float* x, const float* y, size_t blocks);
+typedef void (*MinMaxFn)(const double* x, size_t n, double& min, double& max);
+
+/**
+ * The kernels of one instruction set
+ */
+struct KernelTable
+{
+  BlockFn blocks[OPS];      // Indexed by OP
+  FloatBlockFn floatDiffs;  // DIFFS of floats
+  MinMaxFn minMax;          // Whole blocks only
+};
+
+/**
+ * The term one value adds to its partial sum
+ */
+template<int O>
+static inline double term(double x, double y, double mean, double yMean)
+{
+  double d;
+  switch(O) {
+  case SUM:
+    return x;
+  case SQUARES:
+    return x * x;
+  case DEVIATIONS:
+    d = x - mean;
+    return d * d;
+  case DOT:
+    return x * y;
+  case CODEVIATIONS:
+    return (x - mean) * (y - yMean);
+  default:
+    d = x - y;
+    return d * d;
+  }
+}
+
+/**
+ * Smallest and largest of a set of minimums and maximums (NaNs never get in)
+ */
+static void reduceMinMax(const double* mins, const double* maxs, size_t n, double& min, double& max)
+{
+  for(size_t k = 0 ; k < n ; ++k) {
+    if(mins[k] < min)
+      min = mins[k];
+    if(maxs[k] > max)
+      max = maxs[k];
+  }
+}
+
+/**
+ * Scalar kernels
+ */
+template<int O>
+static void blocksScalar(double* lanes, const double* x, const double* y, double mean, double yMean, size_t blocks)
+{
+  for(size_t b = 0 ; b < blocks ; ++b, x += KERNEL_LANES, y += KERNEL_LANES) {
+    for(size_t k = 0 ; k < KERNEL_LANES ; ++k)
+      lanes[k] += term<O>(x[k], y[k], mean, yMean);
+  }
+}
+
+static void floatDiffsScalar(double* lanes, const float* x, const float* y, size_t blocks)
+{
+  for(size_t b = 0 ; b < blocks ; ++b, x += KERNEL_LANES, y += KERNEL_LANES) {
+    for(size_t k = 0 ; k < KERNEL_LANES ; ++k)
+      lanes[k] += term<DIFFS>(x[k], y[k], 0.0, 0.0);
+  }
+}
+
+static void minMaxScalar(const double* x, size_t n, double& min, double& max)
+{
+  reduceMinMax(x, x, n, min, max);
+}
+
+static const KernelTable scalarKernels = {
+  { blocksScalar<SUM>, blocksScalar<SQUARES>, blocksScalar<DEVIATIONS>, blocksScalar<DOT>, blocksScalar<DIFFS>,
+    blocksScalar<CODEVIATIONS> },
+  floatDiffsScalar,
+  minMaxScalar
+};
+
+#ifdef HAVE_SSE2_KERNEL
+#define SSE2_REGS (KERNEL_LANES / 2)
+
+template<int O>
+TARGET_SSE2 static inline __m128d termSSE2(__m128d x, __m128d y, __m128d mean, __m128d yMean)
+{
+  __m128d d;
+  switch(O) {
+  case SUM:
+    return x;
+  case SQUARES:
+    return _mm_mul_pd(x, x);
+  case DEVIATIONS:
+    d = _mm_sub_pd(x, mean);
+    return _mm_mul_pd(d, d);
+  case DOT:
+    return _mm_mul_pd(x, y);
+  case CODEVIATIONS:
+    return _mm_mul_pd(_mm_sub_pd(x, mean), _mm_sub_pd(y, yMean));
+  default:
+    d = _mm_sub_pd(x, y);
+    return _mm_mul_pd(d, d);
+  }
+}
+
+/**
+ * Add whole blocks of values to the partial sums with SSE2
+ *
+ * @param lanes   The partial sums
+ * @param x       The first values
+ * @param y       The second values (only read by DOT and DIFFS)
+ * @param mean    The mean of the first values (only read by DEVIATIONS and CODEVIATIONS)
+ * @param yMean   The mean of the second values (only read by CODEVIATIONS)
+ * @param blocks  Number of blocks of KERNEL_LANES values
+ */
+template<int O>
+TARGET_SSE2 static void blocksSSE2(double* lanes, const double* x, const double* y, double mean, double yMean, size_t blocks)
+{
+  const bool pairs = (O == DOT || O == DIFFS || O == CODEVIATIONS);
+  __m128d acc[SSE2_REGS];
+  __m128d m = _mm_set1_pd(mean);
+  __m128d my = _mm_set1_pd(yMean);
+  for(size_t r = 0 ; r < SSE2_REGS ; ++r)
+    acc[r] = _mm_loadu_pd(lanes + 2 * r);
+  for(size_t b = 0 ; b < blocks ; ++b, x += KERNEL_LANES, y += KERNEL_LANES) {
+    for(size_t r = 0 ; r < SSE2_REGS ; ++r) {
+      __m128d xv = _mm_loadu_pd(x + 2 * r);
+      acc[r] = _mm_add_pd(acc[r], termSSE2<O>(xv, pairs ? _mm_loadu_pd(y + 2 * r) : xv, m, my));
+    }
+  }
+  for(size_t r = 0 ; r < SSE2_REGS ; ++r)
+    _mm_storeu_pd(lanes + 2 * r, acc[r]);
+}
+
+TARGET_SSE2 static void floatDiffsSSE2(double* lanes, const float* x, const float* y, size_t blocks)
+{
+  __m128d acc[SSE2_REGS];
+  for(size_t r = 0 ; r < SSE2_REGS ; ++r)
+    acc[r] = _mm_loadu_pd(lanes + 2 * r);
+  for(size_t b = 0 ; b < blocks ; ++b, x += KERNEL_LANES, y += KERNEL_LANES) {
+    for(size_t r = 0 ; r < SSE2_REGS ; ++r) {
+      __m128d xv = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + 2 * r))));
+      __m128d yv = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + 2 * r))));
+      acc[r] = _mm_add_pd(acc[r], termSSE2<DIFFS>(xv, yv, xv, xv));
+    }
+  }
+  for(size_t r = 0 ; r < SSE2_REGS ; ++r)
+    _mm_storeu_pd(lanes + 2 * r, acc[r]);
+}
+
+TARGET_SSE2 static void minMaxSSE2(const double* x, size_t n, double& min, double& max)
+{
+  __m128d lo[SSE2_REGS], hi[SSE2_REGS];
+  for(size_t r = 0 ; r < SSE2_REGS ; ++r) {
+    lo[r] = _mm_set1_pd(min);
+    hi[r] = _mm_set1_pd(max);
+  }
+  // The value goes second so that a NaN leaves the running value as it is
+  for(size_t i = 0 ; i + KERNEL_LANES <= n ; i += KERNEL_LANES) {
+    for(size_t r = 0 ; r < SSE2_REGS ; ++r) {
+      __m128d v = _mm_loadu_pd(x + i + 2 * r);
+      lo[r] = _mm_min_pd(v, lo[r]);
+      hi[r] = _mm_max_pd(v, hi[r]);
+    }
+  }
+  double mins[KERNEL_LANES], maxs[KERNEL_LANES];
+  for(size_t r = 0 ; r < SSE2_REGS ; ++r) {
+    _mm_storeu_pd(mins + 2 * r, lo[r]);
+    _mm_storeu_pd(maxs + 2 * r, hi[r]);
+  }
+  reduceMinMax(mins, maxs, KERNEL_LANES, min, max);
+}
+
+static const KernelTable sse2Kernels = {
+  { blocksSSE2<SUM>, blocksSSE2<SQUARES>, blocksSSE2<DEVIATIONS>, blocksSSE2<DOT>, blocksSSE2<DIFFS>,
+    blocksSSE2<CODEVIATIONS> },
+  floatDiffsSSE2,
+  minMaxSSE2
+};
+#endif
+
+#ifdef HAVE_AVX2_KERNEL
+#define AVX2_REGS (KERNEL_LANES / 4)
+
+template<int O>
+TARGET_AVX2 static inline __m256d termAVX2(__m256d x, __m256d y, __m256d mean, __m256d yMean)
+{
+  __m256d d;
+  switch(O) {
+  case SUM:
+    return x;
+  case SQUARES:
+    return _mm256_mul_pd(x, x);
+  case DEVIATIONS:
+    d = _mm256_sub_pd(x, mean);
+    return _mm256_mul_pd(d, d);
+  case DOT:
+    return _mm256_mul_pd(x, y);
+  case CODEVIATIONS:
+    return _mm256_mul_pd(_mm256_sub_pd(x, mean), _mm256_sub_pd(y, yMean));
+  default:
+    d = _mm256_sub_pd(x, y);
+    return _mm256_mul_pd(d, d);
+  }
+}
+
+/**
+ * Add whole blocks of values to the partial sums with AVX2 (see blocksSSE2())
+ */
+template<int O>
+TARGET_AVX2 static void blocksAVX2(double* lanes, const double* x, const double* y, double mean, double yMean, size_t blocks)
+{
+  const bool pairs = (O == DOT || O == DIFFS || O == CODEVIATIONS);
+  __m256d acc[AVX2_REGS];
+  __m256d m = _mm256_set1_pd(mean);
+  __m256d my = _mm256_set1_pd(yMean);
+  for(size_t r = 0 ; r < AVX2_REGS ; ++r)
+    acc[r] = _mm256_loadu_pd(lanes + 4 * r);
+  for(size_t b = 0 ; b < blocks ; ++b, x += KERNEL_LANES, y += KERNEL_LANES) {
+    for(size_t r = 0 ; r < AVX2_REGS ; ++r) {
+      __m256d xv = _mm256_loadu_pd(x + 4 * r);
+      acc[r] = _mm256_add_pd(acc[r], termAVX2<O>(xv, pairs ? _mm256_loadu_pd(y + 4 * r) : xv, m, my));
+    }
+  }
+  for(size_t r = 0 ; r < AVX2_REGS ; ++r)
+    _mm256_storeu_pd(lanes + 4 * r, acc[r]);
+}
+
+TARGET_AVX2 static void floatDiffsAVX2(double* lanes, const float* x, const float* y, size_t blocks)
+{
+  __m256d acc[AVX2_REGS];
+  for(size_t r = 0 ; r < AVX2_REGS ; ++r)
+    acc[r] = _mm256_loadu_pd(lanes + 4 * r);
+  for(size_t b = 0 ; b < blocks ; ++b, x += KERNEL_LANES, y += KERNEL_LANES) {
+    for(size_t r = 0 ; r < AVX2_REGS ; ++r) {
+      __m256d xv = _mm256_cvtps_pd(_mm_loadu_ps(x + 4 * r));
+      __m256d yv = _mm256_cvtps_pd(_mm_loadu_ps(y + 4 * r));
+      acc[r] = _mm256_add_pd(acc[r], termAVX2<DIFFS>(xv, yv, xv, xv));
+    }
+  }
+  for(size_t r = 0 ; r < AVX2_REGS ; ++r)
+    _mm256_storeu_pd(lanes + 4 * r, acc[r]);
+}
+
+TARGET_AVX2 static void minMaxAVX2(const double* x, size_t n, double& min, double& max)
+{
+  __m256d lo[AVX2_REGS], hi[AVX2_REGS];
+  for(size_t r = 0 ; r < AVX2_REGS ; ++r) {
+    lo[r] = _mm256_set1_pd(min);
+    hi[r] = _mm256_set1_pd(max);
+  }
+  for(size_t i = 0 ; i + KERNEL_LANES <= n ; i += KERNEL_LANES) {
+    for(size_t r = 0 ; r < AVX2_REGS ; ++r) {
+      __m256d v = _mm256_loadu_pd(x + i + 4 * r);
+      lo[r] = _mm256_min_pd(v, lo[r]);
+      hi[r] = _mm256_max_pd(v, hi[r]);
+    }
+  }
+  double mins[KERNEL_LANES], maxs[KERNEL_LANES];
+  for(size_t r = 0 ; r < AVX2_REGS ; ++r) {
+    _mm256_storeu_pd(mins + 4 * r, lo[r]);
+    _mm256_storeu_pd(maxs + 4 * r, hi[r]);
+  }
+  reduceMinMax(mins, maxs, KERNEL_LANES, min, max);
+}
+
+static const KernelTable avx2Kernels = {
+  { blocksAVX2<SUM>, blocksAVX2<SQUARES>, blocksAVX2<DEVIATIONS>, blocksAVX2<DOT>, blocksAVX2<DIFFS>,
+    blocksAVX2<CODEVIATIONS> },
+  floatDiffsAVX2,
+  minMaxAVX2
+};
+#endif
+
+#ifdef HAVE_AVX512_KERNEL
+#define AVX512_REGS (KERNEL_LANES / 8)
+
+template<int O>
+TARGET_AVX512 static inline __m512d termAVX512(__m512d x, __m512d y, __m512d mean, __m512d yMean)
+{
+  __m512d d;
+  switch(O) {
+  case SUM:
+    return x;
+  case SQUARES:
+    return _mm512_mul_pd(x, x);
+  case DEVIATIONS:
+    d = _mm512_sub_pd(x, mean);
+    return _mm512_mul_pd(d, d);
+  case DOT:
+    return _mm512_mul_pd(x, y);
+  case CODEVIATIONS:
+    return _mm512_mul_pd(_mm512_sub_pd(x, mean), _mm512_sub_pd(y, yMean));
+  default:
+    d = _mm512_sub_pd(x, y);
+    return _mm512_mul_pd(d, d);
+  }
+}
+
+/**
+ * Add whole blocks of values to the partial sums with AVX-512 (see blocksSSE2())
+ */
+template<int O>
+TARGET_AVX512 static void blocksAVX512(double* lanes, const double* x, const double* y, double mean, double yMean, size_t blocks)
+{
+  const bool pairs = (O == DOT || O == DIFFS || O == CODEVIATIONS);
+  __m512d acc[AVX512_REGS];
+  __m512d m = _mm512_set1_pd(mean);
+  __m512d my = _mm512_set1_pd(yMean);
+  for(size_t r = 0 ; r < AVX512_REGS ; ++r)
+    acc[r] = _mm512_loadu_pd(lanes + 8 * r);
+  for(size_t b = 0 ; b < blocks ; ++b, x += KERNEL_LANES, y += KERNEL_LANES) {
+    for(size_t r = 0 ; r < AVX512_REGS ; ++r) {
+      __m512d xv = _mm512_loadu_pd(x + 8 * r);
+      acc[r] = _mm512_add_pd(acc[r], termAVX512<O>(xv, pairs ? _mm512_loadu_pd(y + 8 * r) : xv, m, my));
+    }
+  }
+  for(size_t r = 0 ; r < AVX512_REGS ; ++r)
+    _mm512_storeu_pd(lanes + 8 * r, acc[r]);
+}
+
+TARGET_AVX512 static void floatDiffsAVX512(double* lanes, const float* x, const float* y, size_t blocks)
+{
+  __m512d acc[AVX512_REGS];
+  for(size_t r = 0 ; r < AVX512_REGS ; ++r)
+    acc[r] = _mm512_loadu_pd(lanes + 8 * r);
+  for(size_t b = 0 ; b < blocks ; ++b, x += KERNEL_LANES, y += KERNEL_LANES) {
+    for(size_t r = 0 ; r < AVX512_REGS ; ++r) {
+      __m512d xv = _mm512_cvtps_pd(_mm256_loadu_ps(x + 8 * r));
+      __m512d yv = _mm512_cvtps_pd(_mm256_loadu_ps(y + 8 * r));
+      acc[r] = _mm512_add_pd(acc[r], termAVX512<DIFFS>(xv, yv, xv, xv));
+    }
+  }
+  for(size_t r = 0 ; r < AVX512_REGS ; ++r)
+    _mm512_storeu_pd(lanes + 8 * r, acc[r]);
+}
+
+TARGET_AVX512 static void minMaxAVX512(const double* x, size_t n, double& min, double& max)
+{
+  __m512d lo[AVX512_REGS], hi[AVX512_REGS];
+  for(size_t r = 0 ; r < AVX512_REGS ; ++r) {
+    lo[r] = _mm512_set1_pd(min);
+    hi[r] = _mm512_set1_pd(max);
+  }
+  for(size_t i = 0 ; i + KERNEL_LANES <= n ; i += KERNEL_LANES) {
+    for(size_t r = 0 ; r < AVX512_REGS ; ++r) {
+      __m512d v = _mm512_loadu_pd(x + i + 8 * r);
+      lo[r] = _mm512_min_pd(v, lo[r]);
+      hi[r] = _mm512_max_pd(v, hi[r]);
+    }
+  }
+  double mins[KERNEL_LANES], maxs[KERNEL_LANES];
+  for(size_t r = 0 ; r < AVX512_REGS ; ++r) {
+    _mm512_storeu_pd(mins + 8 * r, lo[r]);
+    _mm512_storeu_pd(maxs + 8 * r, hi[r]);
+  }
+  reduceMinMax(mins, maxs, KERNEL_LANES, min, max);
+}
+
+static const KernelTable avx512Kernels = {
+  { blocksAVX512<SUM>, blocksAVX512<SQUARES>, blocksAVX512<DEVIATIONS>, blocksAVX512<DOT>, blocksAVX512<DIFFS>,
+    blocksAVX512<CODEVIATIONS> },
+  floatDiffsAVX512,
+  minMaxAVX512
+};
+#endif
+
+/**
+ * Get the kernels for an instruction set
+ */
+static const KernelTable* kernelsFor(Kernels::ISA isa)
+{
+  switch(isa) {
+#ifdef HAVE_AVX512_KERNEL
+  case Kernels::AVX512:
+    return &avx512Kernels;
+#endif
+#ifdef HAVE_AVX2_KERNEL
+  case Kernels::AVX2:
+    return &avx2Kernels;
+#endif
+#ifdef HAVE_SSE2_KERNEL
+  case Kernels::SSE2:
+    return &sse2Kernels;
+#endif
+  default:
+    return &scalarKernels;
+  }
+}
+
+// Chosen once at start up (before any threads exist)
+static Kernels::ISA activeIsa = Kernels::detectInstructionSet();
+static const KernelTable* active = kernelsFor(activeIsa);
+
+/**
+ * Add a term for each value (or pair) to a run: one at a time up to the
+ * first whole block, then whole blocks in the kernel, then the rest
+ */
+template<int O>
+static void reduce(LaneSums& acc, const double* x, const double* y, double mean, double yMean, size_t n)
+{
+  size_t i = 0;
+  for( ; acc.next != 0 && i < n ; ++i) {
+    acc.lane[acc.next] += term<O>(x[i], y[i], mean, yMean);
+    acc.next = (acc.next + 1) % KERNEL_LANES;
+  }
+
+  size_t blocks = (n - i) / KERNEL_LANES;
+  if(blocks > 0)
+    active->blocks[O](acc.lane, x + i, y + i, mean, yMean, blocks);
+  i += blocks * KERNEL_LANES;
+
+  for( ; i < n ; ++i) {
+    acc.lane[acc.next] += term<O>(x[i], y[i], mean, yMean);
+    acc.next = (acc.next + 1) % KERNEL_LANES;
+  }
+}
+
+/**
+ * Constructor
+ */
+LaneSums::LaneSums()
+  : next(0)
+{
+  for(size_t k = 0 ; k < KERNEL_LANES ; ++k)
+    lane[k] = 0.0;
+}
+
+/**
+ * Add up the partial sums, halving them pairwise (as a vector register
+ * would be folded)
+ *
+ * @return  The sum of the run so far
+ */
+double LaneSums::total() const
+{
+  double sums[KERNEL_LANES];
+  for(size_t k = 0 ; k < KERNEL_LANES ; ++k)
+    sums[k] = lane[k];
+  for(size_t width = KERNEL_LANES / 2 ; width > 0 ; width /= 2) {
+    for(size_t k = 0 ; k < width ; ++k)
+      sums[k] += sums[k + width];
+  }
+  return sums[0];
+}
+
+/**
+ * Add values to a run
+ *
+ * @param acc   The run
+ * @param x     The values
+ * @param n     Number of values
+ */
+void Kernels::sum(LaneSums& acc, const double* x, size_t n)
+{
+  reduce<SUM>(acc, x, x, 0.0, 0.0, n);
+}
+
+/**
+ * Add the squares of values to a run
+ *
+ * @param acc   The run
+ * @param x     The values
+ * @param n     Number of values
+ */
+void Kernels::sumSquares(LaneSums& acc, const double* x, size_t n)
+{
+  reduce<SQUARES>(acc, x, x, 0.0, 0.0, n);
+}
+
+/**
+ * Add the squared deviations of values from a mean to a run
+ *
+ * @param acc   The run
+ * @param x     The values
+ * @param n     Number of values
+ * @param mean  The mean
+ */
+void Kernels::sumDeviations(LaneSums& acc, const double* x, size_t n, double mean)
+{
+  reduce<DEVIATIONS>(acc, x, x, mean, 0.0, n);
+}
+
+/**
+ * Add the products of pairs of values to a run
+ *
+ * @param acc   The run
+ * @param x     The first values
+ * @param y     The second values
+ * @param n     Number of pairs
+ */
+void Kernels::dot(LaneSums& acc, const double* x, const double* y, size_t n)
+{
+  reduce<DOT>(acc, x, y, 0.0, 0.0, n);
+}
+
+/**
+ * Add the products of the deviations of pairs of values from their means to a run
+ *
+ * @param acc     The run
+ * @param x       The first values
+ * @param y       The second values
+ * @param n       Number of pairs
+ * @param xMean   The mean of the first values
+ * @param yMean   The mean of the second values
+ */
+void Kernels::sumCoDeviations(LaneSums& acc, const double* x, const double* y, size_t n, double xMean, double yMean)
+{
+  reduce<CODEVIATIONS>(acc, x, y, xMean, yMean, n);
+}
+
+/**
+ * Add the squared differences of pairs of values to a run
+ *
+ * @param acc   The run
+ * @param x     The first values
+ * @param y     The second values
+ * @param n     Number of pairs
+ */
+void Kernels::sumSquaredDiffs(LaneSums& acc, const double* x, const double* y, size_t n)
+{
+  reduce<DIFFS>(acc, x, y, 0.0, 0.0, n);
+}
+
+/**
+ * Add the squared differences of pairs of floats to a run (in double precision)
+ *
+ * @param acc   The run
+ * @param x     The first values
+ * @param y     The second values
+ * @param n     Number of pairs
+ */
+void Kernels::sumSquaredDiffs(LaneSums& acc, const float* x, const float* y, size_t n)
+{
+  size_t i = 0;
+  for( ; acc.next != 0 && i < n ; ++i) {
+    acc.lane[acc.next] += term<DIFFS>(x[i], y[i], 0.0, 0.0);
+    acc.next = (acc.next + 1) % KERNEL_LANES;
+  }
+
+  size_t blocks = (n - i) / KERNEL_LANES;
+  if(blocks > 0)
+    active->floatDiffs(acc.lane, x + i, y + i, blocks);
+  i += blocks * KERNEL_LANES;
+
+  for( ; i < n ; ++i) {
+    acc.lane[acc.next] += term<DIFFS>(x[i], y[i], 0.0, 0.0);
+    acc.next = (acc.next + 1) % KERNEL_LANES;
+  }
+}
+
+/**
+ * Find the smallest and largest of some values (NaNs are skipped)
+ *
+ * @param x     The values
+ * @param n     Number of values
+ * @param min   Receives the smallest (+infinity if there are no numbers)
+ * @param max   Receives the largest (-infinity if there are no numbers)
+ */
+void Kernels::minMax(const double* x, size_t n, double& min, double& max)
+{
+  min = numeric_limits<double>::infinity();
+  max = -min;
+  size_t whole = n - (n % KERNEL_LANES);
+  if(whole > 0)
+    active->minMax(x, whole, min, max);
+  reduceMinMax(x + whole, x + whole, n - whole, min, max);
+}
+
+/**
+ * Get the instruction set the kernels are currently dispatched to
+ *
+ * @return  The instruction set in use
+ */
+Kernels::ISA Kernels::getInstructionSet()
+{
+  return activeIsa;
+}
+
+/**
+ * Force the kernels onto an instruction set (used for benchmarking)
+ *
+ * @param isa   The instruction set to use
+ * @return  True if the CPU supports it and it is now in use, false otherwise
+ */
+bool Kernels::setInstructionSet(ISA isa)
+{
+  if(isa > detectInstructionSet())
+    return false;
+  activeIsa = isa;
+  active = kernelsFor(isa);
+  return true;
+}
+
+/**
+ * Get the best instruction set supported by this CPU
+ *
+ * @return  The best supported instruction set
+ */
+Kernels::ISA Kernels::detectInstructionSet()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+#ifdef HAVE_AVX512_KERNEL
+  if(__builtin_cpu_supports("avx512f"))
+    return AVX512;
+#endif
+  if(__builtin_cpu_supports("avx2"))
+    return AVX2;
+  if(__builtin_cpu_supports("sse2"))
+    return SSE2;
+#elif defined(HAVE_SSE2_KERNEL) // MSVC
+  int info[4];
+  __cpuid(info, 1);
+#ifdef HAVE_AVX2_KERNEL
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  if(osxsave && (_xgetbv(0) & 6) == 6) { // OS saves the YMM registers
+    int ext[4];
+    __cpuidex(ext, 7, 0);
+#ifdef HAVE_AVX512_KERNEL
+    if((_xgetbv(0) & 0xe6) == 0xe6 && (ext[1] & (1 << 16))) // ...and the ZMM and mask registers
+      return AVX512;
+#endif
+    if(ext[1] & (1 << 5))
+      return AVX2;
+  }
+#endif
+  if(info[3] & (1 << 26))
+    return SSE2;
+#endif
+  return SCALAR;
+}
+
+/**
+ * Get a printable name for an instruction set
+ *
+ * @param isa   The instruction set
+ * @return  Its name
+ */
+const char* Kernels::getName(ISA isa)
+{
+  switch(isa) {
+  case AVX512:
+    return "AVX-512";
+  case AVX2:
+    return "AVX2";
+  case SSE2:
+    return "SSE2";
+  default:
+    return "scalar";
+  }
+}
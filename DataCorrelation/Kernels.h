@@ -0,0 +1,186 @@
+/**
+ * Kernels.h
+ *
+ * Reductions over arrays of values (sum, sum of squares, dot product,
+ * co-deviation, squared difference, minimum and maximum) with scalar,
+ * SSE2, AVX2 and AVX-512 versions, dispatched to the best one the CPU
+ * supports
+ *
+ * Sums are spread over KERNEL_LANES partial sums: value i of a run goes
+ * into partial sum i % KERNEL_LANES, and the partial sums are only added
+ * together, in a fixed order, when the total is asked for. Every version
+ * adds the same values in the same order, so they all give the same bits,
+ * and a run handed over in pieces (tiles, layer blocks) gives the same
+ * total as the whole run at once.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef KERNELS_H__
+#define KERNELS_H__
+
+#include <cstddef>
+
+#define KERNEL_LANES 16 // Partial sums per run (a multiple of the widest vector)
+
+/**
+ * Partial sums of a run of values
+ */
+struct LaneSums
+{
+  LaneSums();
+
+  /**
+   * Add a value some way past the next one in the run
+   *
+   * NOTE: Used for values stored sparse, with skip() past the run after them
+   *
+   * @param index   Position of the value counted from the next one
+   * @param val     The value
+   */
+  void addAt(size_t index, double val) { lane[(next + index) % KERNEL_LANES] += val; }
+
+  /**
+   * Move past values that add nothing (i.e. zero cells)
+   *
+   * @param n   Number of values
+   */
+  void skip(size_t n) { next = (next + n) % KERNEL_LANES; }
+
+  /**
+   * Add up the partial sums
+   *
+   * @return  The sum of the run so far
+   */
+  double total() const;
+
+  double lane[KERNEL_LANES];
+  size_t next; // Partial sum the next value goes into
+};
+
+class Kernels
+{
+public:
+  /**
+   * Instruction sets the kernels can be dispatched to
+   */
+  enum ISA
+  {
+    SCALAR,
+    SSE2,
+    AVX2,
+    AVX512
+  };
+
+  /**
+   * Add values to a run
+   *
+   * @param acc   The run
+   * @param x     The values
+   * @param n     Number of values
+   */
+  static void sum(LaneSums& acc, const double* x, size_t n);
+
+  /**
+   * Add the squares of values to a run
+   *
+   * @param acc   The run
+   * @param x     The values
+   * @param n     Number of values
+   */
+  static void sumSquares(LaneSums& acc, const double* x, size_t n);
+
+  /**
+   * Add the squared deviations of values from a mean to a run
+   *
+   * @param acc   The run
+   * @param x     The values
+   * @param n     Number of values
+   * @param mean  The mean
+   */
+  static void sumDeviations(LaneSums& acc, const double* x, size_t n, double mean);
+
+  /**
+   * Add the products of pairs of values to a run
+   *
+   * @param acc   The run
+   * @param x     The first values
+   * @param y     The second values
+   * @param n     Number of pairs
+   */
+  static void dot(LaneSums& acc, const double* x, const double* y, size_t n);
+
+  /**
+   * Add the products of the deviations of pairs of values from their means to a run
+   *
+   * @param acc     The run
+   * @param x       The first values
+   * @param y       The second values
+   * @param n       Number of pairs
+   * @param xMean   The mean of the first values
+   * @param yMean   The mean of the second values
+   */
+  static void sumCoDeviations(LaneSums& acc, const double* x, const double* y, size_t n, double xMean, double yMean);
+
+  /**
+   * Add the squared differences of pairs of values to a run
+   *
+   * NOTE: Floats are widened to double before they are subtracted
+   *
+   * @param acc   The run
+   * @param x     The first values
+   * @param y     The second values
+   * @param n     Number of pairs
+   */
+  static void sumSquaredDiffs(LaneSums& acc, const double* x, const double* y, size_t n);
+  static void sumSquaredDiffs(LaneSums& acc, const float* x, const float* y, size_t n);
+
+  /**
+   * Find the smallest and largest of some values (NaNs are skipped)
+   *
+   * NOTE: Zeros of either sign compare equal, so min or max may be either one
+   *
+   * @param x     The values
+   * @param n     Number of values
+   * @param min   Receives the smallest (+infinity if there are no numbers)
+   * @param max   Receives the largest (-infinity if there are no numbers)
+   */
+  static void minMax(const double* x, size_t n, double& min, double& max);
+
+  /**
+   * Get the instruction set the kernels are currently dispatched to
+   *
+   * @return  The instruction set in use
+   */
+  static ISA getInstructionSet();
+
+  /**
+   * Force the kernels onto an instruction set (used for benchmarking)
+   *
+   * @param isa   The instruction set to use
+   * @return  True if the CPU supports it and it is now in use, false otherwise
+   */
+  static bool setInstructionSet(ISA isa);
+
+  /**
+   * Get the best instruction set supported by this CPU
+   *
+   * @return  The best supported instruction set
+   */
+  static ISA detectInstructionSet();
+
+  /**
+   * Get a printable name for an instruction set
+   *
+   * @param isa   The instruction set
+   * @return  Its name
+   */
+  static const char* getName(ISA isa);
+
+private:
+  // Simple container so we don't have random methods floating.
+  Kernels(){}
+  virtual ~Kernels(){}
+};
+
+#endif /** KERNELS_H__ */
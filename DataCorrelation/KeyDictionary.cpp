@@ -0,0 +1,124 @@
+/**
+ * KeyDictionary.cpp
+ *
+ * Interns key names into dense integer ids
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#include "KeyDictionary.h"
+
+#define INITIAL_SLOTS 64 // Must be a power of 2
+
+using namespace std;
+
+/**
+ * Constructor
+ */
+KeyDictionary::KeyDictionary()
+  : slots(INITIAL_SLOTS, NO_KEY)
+{
+}
+
+/**
+ * Get the id of a key, adding it if it has not been seen
+ *
+ * NOTE: Ids are handed out in order starting from 0
+ *
+ * @param key   The key
+ * @return  Id of the key
+ */
+int KeyDictionary::intern(const string& key)
+{
+  unsigned h = hash(key);
+  size_t slot = slotOf(key, h);
+  if(slots[slot] != NO_KEY)
+    return slots[slot];
+
+  int id = static_cast<int>(names.size());
+  names.push_back(key);
+  hashes.push_back(h);
+  slots[slot] = id;
+
+  // Keep the table at most half full so probe runs stay short
+  if(names.size() * 2 > slots.size())
+    grow();
+
+  return id;
+}
+
+/**
+ * Get the id of a key
+ *
+ * @param key   The key
+ * @return  Id of the key (NO_KEY if it is not in the dictionary)
+ */
+int KeyDictionary::find(const string& key) const
+{
+  return slots[slotOf(key, hash(key))];
+}
+
+/**
+ * Remove every key
+ */
+void KeyDictionary::clear()
+{
+  names.clear();
+  hashes.clear();
+  slots.assign(INITIAL_SLOTS, NO_KEY);
+}
+
+/**
+ * Hash a key (FNV-1a)
+ *
+ * @param key   The key
+ * @return  Hash of the key
+ */
+unsigned KeyDictionary::hash(const string& key)
+{
+  unsigned h = 2166136261u;
+  for(size_t i = 0 ; i < key.size() ; ++i) {
+    h ^= static_cast<unsigned char>(key[i]);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/**
+ * Find the slot of a key
+ *
+ * @param key   The key
+ * @param h     Hash of the key
+ * @return  Index of the key's slot, or of the empty slot it would go in
+ */
+size_t KeyDictionary::slotOf(const string& key, unsigned h) const
+{
+  size_t mask = slots.size() - 1;
+  size_t slot = h & mask;
+
+  // Linear probing (the table is never full, so this ends)
+  while(slots[slot] != NO_KEY) {
+    int id = slots[slot];
+    if(hashes[id] == h && names[id] == key)
+      break;
+    slot = (slot + 1) & mask;
+  }
+
+  return slot;
+}
+
+/**
+ * Double the number of slots and re-insert every key
+ */
+void KeyDictionary::grow()
+{
+  slots.assign(slots.size() * 2, NO_KEY);
+  size_t mask = slots.size() - 1;
+
+  for(size_t id = 0 ; id < names.size() ; ++id) {
+    size_t slot = hashes[id] & mask;
+    while(slots[slot] != NO_KEY)
+      slot = (slot + 1) & mask;
+    slots[slot] = static_cast<int>(id);
+  }
+}
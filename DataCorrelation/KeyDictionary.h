@@ -0,0 +1,99 @@
+/**
+ * KeyDictionary.h
+ *
+ * Interns key names into dense integer ids
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef KEYDICTIONARY_H__
+#define KEYDICTIONARY_H__
+
+#include <string>
+#include <vector>
+
+class KeyDictionary
+{
+public:
+  /**
+   * Id of a key that is not in the dictionary
+   */
+  enum { NO_KEY = -1 };
+
+  /**
+   * Constructor
+   */
+  KeyDictionary();
+
+  /**
+   * Destructor
+   */
+  virtual ~KeyDictionary(){}
+
+  /**
+   * Get the id of a key, adding it if it has not been seen
+   *
+   * NOTE: Ids are handed out in order starting from 0
+   *
+   * @param key   The key
+   * @return  Id of the key
+   */
+  int intern(const std::string& key);
+
+  /**
+   * Get the id of a key
+   *
+   * @param key   The key
+   * @return  Id of the key (NO_KEY if it is not in the dictionary)
+   */
+  int find(const std::string& key) const;
+
+  /**
+   * Get the name of a key
+   *
+   * @param id  Id of the key (must exist)
+   * @return  The key
+   */
+  const std::string& name(int id) const { return names[id]; }
+
+  /**
+   * Get the number of keys
+   *
+   * @return  Number of keys interned
+   */
+  size_t size() const { return names.size(); }
+
+  /**
+   * Remove every key
+   */
+  void clear();
+
+private:
+  /**
+   * Hash a key (FNV-1a)
+   *
+   * @param key   The key
+   * @return  Hash of the key
+   */
+  static unsigned hash(const std::string& key);
+
+  /**
+   * Find the slot of a key
+   *
+   * @param key   The key
+   * @param h     Hash of the key
+   * @return  Index of the key's slot, or of the empty slot it would go in
+   */
+  size_t slotOf(const std::string& key, unsigned h) const;
+
+  /**
+   * Double the number of slots and re-insert every key
+   */
+  void grow();
+
+  std::vector<std::string> names; // Indexed by id
+  std::vector<unsigned> hashes;   // Hash of each name, indexed by id
+  std::vector<int> slots;         // Open addressed table of ids (NO_KEY when empty)
+};
+
+#endif /** KEYDICTIONARY_H__ */
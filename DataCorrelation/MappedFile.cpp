@@ -0,0 +1,155 @@
+/**
+ * MappedFile.cpp
+ *
+ * Read-only memory mapping of a file
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ */
+MappedFile::MappedFile()
+  : addr(NULL), len(0), opened(false)
+#ifdef _WIN32
+  , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#else
+  , fd(-1)
+#endif
+{
+}
+
+/**
+ * Destructor (unmaps the file if still open)
+ */
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+/**
+ * Map a file into memory
+ *
+ * @param path    Path to the file to map
+ * @return  True if the file was mapped, false otherwise
+ */
+bool MappedFile::open(const string& path)
+{
+  close();
+
+  // Platform-dependent again (see DCUtil::listFiles)
+#ifdef _WIN32
+  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if(file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fsize;
+  if(!GetFileSizeEx(file, &fsize)) {
+    close();
+    return false;
+  }
+  len = static_cast<size_t>(fsize.QuadPart);
+
+  // Windows refuses to map empty files, but an empty file is still "open"
+  if(len > 0) {
+    mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mapping == NULL) {
+      close();
+      return false;
+    }
+    addr = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(addr == NULL) {
+      close();
+      return false;
+    }
+  }
+#else
+  fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+
+  struct stat st;
+  if(fstat(fd, &st) != 0) {
+    close();
+    return false;
+  }
+  len = static_cast<size_t>(st.st_size);
+
+  // mmap() refuses zero-length mappings, but an empty file is still "open"
+  if(len > 0) {
+    void* ptr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(ptr == MAP_FAILED) {
+      close();
+      return false;
+    }
+    addr = static_cast<const char*>(ptr);
+
+    // We scan front to back exactly once, so let the kernel read ahead
+    // aggressively and drop pages behind us
+    madvise(ptr, len, MADV_SEQUENTIAL);
+  }
+#endif
+
+  opened = true;
+  return true;
+}
+
+/**
+ * Unmap the file
+ */
+void MappedFile::close()
+{
+#ifdef _WIN32
+  if(addr != NULL)
+    UnmapViewOfFile(addr);
+  if(mapping != NULL)
+    CloseHandle(mapping);
+  if(file != INVALID_HANDLE_VALUE)
+    CloseHandle(file);
+  mapping = NULL;
+  file = INVALID_HANDLE_VALUE;
+#else
+  if(addr != NULL)
+    munmap(const_cast<char*>(addr), len);
+  if(fd >= 0)
+    ::close(fd);
+  fd = -1;
+#endif
+  addr = NULL;
+  len = 0;
+  opened = false;
+}
+
+/**
+ * Hint that the pages in [begin, end) have been consumed and will not
+ * be read again so that they do not count against resident memory
+ *
+ * @param begin   First byte of the consumed range
+ * @param end     One past the last byte of the consumed range
+ */
+void MappedFile::release(const char* begin, const char* end)
+{
+#ifndef _WIN32
+  if(addr == NULL || begin >= end)
+    return;
+
+  // madvise() works on whole pages, so only drop the pages fully inside the range
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t first = ((static_cast<size_t>(begin - addr) + page - 1) / page) * page;
+  size_t last  = (static_cast<size_t>(end - addr) / page) * page;
+  if(first < last)
+    madvise(const_cast<char*>(addr) + first, last - first, MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,75 @@
+/**
+ * MappedFile.h
+ *
+ * Read-only memory mapping of a file
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef MAPPEDFILE_H__
+#define MAPPEDFILE_H__
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+class MappedFile
+{
+public:
+  /**
+   * Constructor
+   */
+  MappedFile();
+
+  /**
+   * Destructor (unmaps the file if still open)
+   */
+  virtual ~MappedFile();
+
+  /**
+   * Map a file into memory
+   *
+   * @param path    Path to the file to map
+   * @return  True if the file was mapped, false otherwise
+   */
+  bool open(const std::string& path);
+
+  /**
+   * Unmap the file
+   */
+  void close();
+
+  /**
+   * Hint that the pages in [begin, end) have been consumed and will not
+   * be read again so that they do not count against resident memory
+   *
+   * @param begin   First byte of the consumed range
+   * @param end     One past the last byte of the consumed range
+   */
+  void release(const char* begin, const char* end);
+
+  /** Simple get methods */
+  const char* data() const { return addr; }
+  size_t size() const { return len; }
+  bool isOpen() const { return opened; }
+
+private:
+  // Mappings are not copyable
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const char* addr;
+  size_t len;
+  bool opened;
+
+#ifdef _WIN32
+  HANDLE file, mapping;
+#else
+  int fd;
+#endif
+};
+
+#endif /** MAPPEDFILE_H__ */
@@ -6,6 +6,7 @@
  * @author Dennis J. McWherter, Jr.
  */
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <utility>
@@ -15,6 +16,7 @@
 #include "AnalyzeData.h"
 #include "Configuration.h"
 #include "DCUtil.h"
+#include "KeyDictionary.h"
 #include "Master.h"
 #include "Status.h"
 
@@ -101,7 +103,10 @@ void Master::collectResults(int size)
   unsigned count = 0, nSize = 0, stats = 0;
   MPI_Status status;
   vector<pair<int, pair<int, vector<double> > > > fullGrids; // Stores an int with the metadata (i.e. what stats to compute) and a vector of the values
-  vector<string> gridNames; // Stores names of full grids with corresponding indices
+  KeyDictionary gridKeys; // Names of the full grids, interned so they compare as ints
+  vector<int> gridIds; // Stores the name id of each full grid with corresponding indices
+  vector<vector<float> > singleGrids; // Values of each full grid sent in single precision (instead of those in fullGrids)
+  vector<vector<unsigned> > gridCells; // Cell of each value of a full grid sent sparse (empty if every value was sent)
   int totalNodes = 0;
 
   MPI_Comm_size(MPI_COMM_WORLD, &totalNodes);
@@ -117,14 +122,34 @@ void Master::collectResults(int size)
     // receive how many different parameters this process is giving us
     MPI_Recv(&count, 1, MPI_UNSIGNED, i, 1, MPI_COMM_WORLD, &status);
 
-    out<< "Varied Run," << ((work[i - 1] < 0) ? "" : "+") << (work[i - 1] * 100) << "%,id," << (i-1) << endl
-      << "Parameter,Sum,Mean,Variance,\"Std. Dev.\",Pearson" << endl;
+    out<< "Varied Run," << ((work[i - 1] < 0) ? "" : "+") << (work[i - 1] * 100) << "%,id," << (i-1) << endl;
 
     if(status.MPI_TAG == FATAL_ERROR) {
+      out<< "Parameter,Sum,Mean,Variance,\"Std. Dev.\",Pearson,Spearman,Kendall,Min,\"Min Cell\",Max,\"Max Cell\"" << endl;
       cout<< "Fatal error, could not compute results." << endl;
       continue;
     }
 
+    // Protocol step 1b:
+    // receive whether the simulation was stopped early (when, and by which stop rule)
+    unsigned stopped = 0;
+    MPI_Recv(&stopped, 1, MPI_UNSIGNED, i, 1, MPI_COMM_WORLD, &status);
+    if(stopped) {
+      double stopTime = 0.0;
+      MPI_Recv(&stopTime, 1, MPI_DOUBLE, i, 1, MPI_COMM_WORLD, &status);
+      MPI_Recv(&nSize, 1, MPI_UNSIGNED, i, 1, MPI_COMM_WORLD, &status);
+      char* reason = new char[nSize];
+      MPI_Recv(reason, nSize, MPI_BYTE, i, 1, MPI_COMM_WORLD, &status);
+      out<< "Terminated Early,TIME," << stopTime << ",\"" << reason << "\"" << endl;
+      delete [] reason;
+    }
+
+    out<< "Parameter,Sum,Mean,Variance,\"Std. Dev.\",Pearson,Spearman,Kendall,Min,\"Min Cell\",Max,\"Max Cell\"" << endl;
+
+    // Largest rounding error of the parameters sent in single precision
+    bool rounded = false;
+    double absError = 0.0, relError = 0.0;
+
     // For each parameter, retrieve the information
     for(unsigned j = 0 ; j < count ; ++j) {
       // Protocol step 2:
@@ -174,36 +199,100 @@ void Master::collectResults(int size)
       } else {
         out<< "NA";
       }
-      out << endl;
+      if(stats & Parameter::SPEARMAN) {
+        MPI_Recv(&val, 1, MPI_DOUBLE, i, 1, MPI_COMM_WORLD, &status);
+        out<< "," << val;
+      } else {
+        out<< ",NA";
+      }
+      if(stats & Parameter::KENDALL) {
+        MPI_Recv(&val, 1, MPI_DOUBLE, i, 1, MPI_COMM_WORLD, &status);
+        out<< "," << val;
+      } else {
+        out<< ",NA";
+      }
       if(stats & Parameter::NORM) {
-        unsigned numElems = 0;
+        double sparse = config.getParserOptions().sparse;
+        unsigned numElems = 0, nonzero = 0;
 
-        // Receive the number of elements
+        // Receive the number of elements (and how many are not zero, with sparse tiles)
         MPI_Recv(&numElems, 1, MPI_UNSIGNED, i, 1, MPI_COMM_WORLD, &status);
+        if(sparse > 0.0)
+          MPI_Recv(&nonzero, 1, MPI_UNSIGNED, i, 1, MPI_COMM_WORLD, &status);
+
+        // A grid with few nonzero values comes as just those values and their cells
+        vector<unsigned> cells;
+        unsigned count = numElems;
+        bool sentSparse = (sparse > 0.0 && nonzero < sparse * numElems);
+        if(sentSparse) {
+          cells.resize(nonzero);
+          MPI_Recv(cells.empty() ? NULL : &cells[0], nonzero, MPI_UNSIGNED, i, 1, MPI_COMM_WORLD, &status);
+          count = nonzero;
+        }
 
-        // Receive the values and store them for later
+        // Receive the values and store them for later (floats are kept that way)
         vector<double> cellValues;
-        cellValues.reserve(numElems);
-
-        // Receive the elements
-        double* dVals = new double[numElems];
-        MPI_Recv(dVals, numElems, MPI_DOUBLE, i, 1, MPI_COMM_WORLD, &status);
-
-        // Convert values to vector
-        for(unsigned j = 0 ; j < numElems ; ++j) {
-          double value = dVals[j];//0.f;
-          cellValues.push_back(value);
+        vector<float> single;
+        if(stats & Parameter::SINGLE) {
+          single.resize(count);
+          MPI_Recv(single.empty() ? NULL : &single[0], count, MPI_FLOAT, i, 1, MPI_COMM_WORLD, &status);
+        } else if(sentSparse) {
+          cellValues.resize(count);
+          MPI_Recv(cellValues.empty() ? NULL : &cellValues[0], count, MPI_DOUBLE, i, 1, MPI_COMM_WORLD, &status);
+        } else {
+          // A whole grid comes a tile (one message) at a time
+          cellValues.resize(count);
+          for(unsigned got = 0 ; got < count ; ) {
+            int tile = 0;
+            MPI_Recv(&cellValues[got], count - got, MPI_DOUBLE, i, 1, MPI_COMM_WORLD, &status);
+            MPI_Get_count(&status, MPI_DOUBLE, &tile);
+            got += static_cast<unsigned>(tile);
+          }
         }
 
-        delete [] dVals;
+        fullGrids.push_back(pair<int, pair<int, vector<double> > >(stats, pair<int, vector<double> >(i-1, vector<double>())));
+        fullGrids.back().second.second.swap(cellValues);
+        singleGrids.push_back(vector<float>());
+        singleGrids.back().swap(single);
+        gridCells.push_back(vector<unsigned>());
+        gridCells.back().swap(cells);
+        gridIds.push_back(gridKeys.intern(name));
+      }
+
+      // Protocol step 6:
+      // receive the rounding error of a parameter sent in single precision
+      if(stats & Parameter::SINGLE) {
+        double errors[2] = { 0.0, 0.0 };
+        MPI_Recv(errors, 2, MPI_DOUBLE, i, 1, MPI_COMM_WORLD, &status);
+        rounded = true;
+        absError = max(absError, errors[0]);
+        relError = max(relError, errors[1]);
+      }
 
-        fullGrids.push_back(pair<int, pair<int, vector<double> > >(stats, pair<int, vector<double> >(i-1, cellValues)));
-        gridNames.push_back(name);
+      // Protocol step 7:
+      // receive the minimum and maximum and the first cells holding them
+      const unsigned extremes[2] = { Parameter::MIN, Parameter::MAX };
+      for(unsigned k = 0 ; k < 2 ; ++k) {
+        if(stats & extremes[k]) {
+          double extreme[2] = { 0.0, 0.0 };
+          MPI_Recv(extreme, 2, MPI_DOUBLE, i, 1, MPI_COMM_WORLD, &status);
+          out<< "," << extreme[0] << ",";
+          if(extreme[1] == extreme[1])
+            out<< static_cast<unsigned long>(extreme[1]);
+          else
+            out<< "NA";
+        } else {
+          out<< ",NA,NA";
+        }
       }
+      out << endl;
 
       delete [] name;
     }
 
+    if(rounded)
+      out<< "Single Precision,\"Max Abs. Error\"," << absError << ",\"Max Rel. Error\"," << relError << endl;
+
     out << endl << endl;
 
     cout<< "Process " << i << " complete." << endl;
@@ -232,13 +321,15 @@ void Master::collectResults(int size)
         // Clear the NORM parameter from the current grid so it's not recomputed
         it->first &= ~Parameter::NORM;
         for(itt = fullGrids.begin(), j = 0 ; itt != fullGrids.end() ; ++itt, ++j) {
-          if(itt == it || !(itt->first & Parameter::NORM) || gridNames[i].compare(gridNames[j]) != 0)
+          if(itt == it || !(itt->first & Parameter::NORM) || gridIds[i] != gridIds[j])
             continue; // Skip this computation to avoid re-computation
           // Output the data
           int id1 = it->second.first;// % totalNodes;
           int id2 = itt->second.first;// % totalNodes;
-          simil<< gridNames[i] << "," << id1 << "," << id2 << ","
-            << AnalyzeData::computeNorm(it->second.second, itt->second.second) << endl;
+          double norm = (it->first & Parameter::SINGLE)
+            ? AnalyzeData::computeNorm(singleGrids[i], gridCells[i], singleGrids[j], gridCells[j])
+            : AnalyzeData::computeNorm(it->second.second, gridCells[i], itt->second.second, gridCells[j]);
+          simil<< gridKeys.name(gridIds[i]) << "," << id1 << "," << id2 << "," << norm << endl;
         }
       }
     }
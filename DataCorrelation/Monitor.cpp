@@ -0,0 +1,124 @@
+/**
+ * Monitor.cpp
+ *
+ * Watches keys while the simulation runs
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#include <cmath>
+#include <sstream>
+
+#include "Monitor.h"
+
+using namespace std;
+
+/**
+ * Names of the statistics (indexed by Watch::STAT)
+ */
+static const char* const STAT_NAMES[] = { "sum", "mean", "variance", "stddev", "min", "max" };
+
+/**
+ * Constructor
+ *
+ * @param watches   Keys to watch and their stop rules
+ */
+Monitor::Monitor(const watchset& watches)
+  : watches(watches), snapshots(watches.size()), stopped(false)
+{
+}
+
+/**
+ * Add the values of one layer block as it is read
+ *
+ * @param key     Key the values were read for (ignored unless watched)
+ * @param time    TIME value the block was written at (ignored if empty)
+ * @param layers  Number of layers of each key
+ * @param vals    The values
+ * @param n       Number of values
+ * @return  True once a stop rule has been met
+ */
+bool Monitor::add(const string& key, const string& time, unsigned layers, const double* vals, size_t n)
+{
+  if(stopped || time.empty())
+    return stopped;
+
+  for(size_t w = 0 ; w < watches.size() && !stopped ; ++w) {
+    if(watches[w].name != key)
+      continue;
+
+    // A later TIME means the last snapshot had fewer blocks than layers
+    Snapshot& snap = snapshots[w];
+    if(snap.layers > 0 && snap.time != time)
+      finish(w);
+    if(stopped)
+      break;
+
+    if(snap.layers == 0) {
+      snap.time = time;
+      snap.stats = RunningStats();
+    }
+    snap.stats.add(vals, n);
+
+    if(++snap.layers >= layers)
+      finish(w);
+  }
+
+  return stopped;
+}
+
+/**
+ * Compute the statistic of a finished snapshot and check the stop rules
+ *
+ * @param w   Index of the watch
+ */
+void Monitor::finish(size_t w)
+{
+  const Watch& watch = watches[w];
+  Snapshot& snap = snapshots[w];
+  snap.layers = 0;
+  if(snap.stats.count == 0)
+    return;
+
+  double val = 0.0;
+  switch(watch.stat) {
+  case Watch::SUM:      val = snap.stats.sum; break;
+  case Watch::MEAN:     val = snap.stats.mean(); break;
+  case Watch::VARIANCE: val = snap.stats.variance(); break;
+  case Watch::STDDEV:   val = snap.stats.stddev(); break;
+  case Watch::MIN:      val = snap.stats.min; break;
+  case Watch::MAX:      val = snap.stats.max; break;
+  }
+
+  // Only the changes over the window are needed
+  snap.history.push_back(val);
+  if(snap.history.size() > watch.window + 1)
+    snap.history.erase(snap.history.begin());
+
+  ostringstream why;
+  why<< watch.name << ' ' << STAT_NAMES[watch.stat] << ' ' << val;
+
+  // NaN and infinity leave NaN after subtracting themselves, so a statistic
+  // that diverged counts as crossing either threshold
+  bool finite = (val - val == 0.0);
+  if(watch.hasAbove && (!finite || val > watch.above)) {
+    why<< " above " << watch.above;
+    stopped = true;
+  } else if(watch.hasBelow && (!finite || val < watch.below)) {
+    why<< " below " << watch.below;
+    stopped = true;
+  } else if(watch.epsilon >= 0.0 && snap.history.size() > watch.window) {
+    bool settled = true;
+    for(size_t i = 1 ; i < snap.history.size() && settled ; ++i)
+      settled = (fabs(snap.history[i] - snap.history[i - 1]) < watch.epsilon);
+    if(settled) {
+      why<< " changed by less than " << watch.epsilon << " over " << watch.window << " snapshots";
+      stopped = true;
+    }
+  }
+
+  if(stopped) {
+    stopTime = snap.time;
+    reason = why.str();
+  }
+}
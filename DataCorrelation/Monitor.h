@@ -0,0 +1,94 @@
+/**
+ * Monitor.h
+ *
+ * Watches keys while the simulation runs: a statistic is computed over each
+ * TIME snapshot of a key as its blocks are read, and checked against the
+ * watch's stop rules
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef MONITOR_H__
+#define MONITOR_H__
+
+#include <string>
+#include <vector>
+
+#include "Configuration.h"
+#include "StreamStats.h"
+
+class Monitor
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param watches   Keys to watch and their stop rules
+   */
+  Monitor(const watchset& watches);
+
+  /**
+   * Destructor
+   */
+  virtual ~Monitor(){}
+
+  /**
+   * Add the values of one layer block as it is read
+   *
+   * A snapshot is complete once every layer of the key has been read at
+   * the same TIME (or a block of a later TIME turns up first)
+   *
+   * @param key     Key the values were read for (ignored unless watched)
+   * @param time    TIME value the block was written at (ignored if empty)
+   * @param layers  Number of layers of each key
+   * @param vals    The values
+   * @param n       Number of values
+   * @return  True once a stop rule has been met
+   */
+  bool add(const std::string& key, const std::string& time, unsigned layers, const double* vals, size_t n);
+
+  /**
+   * Check if a stop rule has been met
+   */
+  bool isStopped() const { return stopped; }
+
+  /**
+   * Get the TIME value of the snapshot that met a stop rule
+   */
+  const std::string& getStopTime() const { return stopTime; }
+
+  /**
+   * Get a description of the stop rule that was met
+   */
+  const std::string& getReason() const { return reason; }
+
+private:
+  /**
+   * The snapshot of a watched key being read
+   */
+  struct Snapshot
+  {
+    Snapshot()
+      : layers(0)
+    {
+    }
+    std::string time;
+    unsigned layers;             // Blocks read so far
+    RunningStats stats;
+    std::vector<double> history; // Statistic of the latest snapshots, oldest first
+  };
+
+  /**
+   * Compute the statistic of a finished snapshot and check the stop rules
+   *
+   * @param w   Index of the watch
+   */
+  void finish(size_t w);
+
+  watchset watches;
+  std::vector<Snapshot> snapshots; // Indexed like watches
+  bool stopped;
+  std::string stopTime, reason;
+};
+
+#endif /** MONITOR_H__ */
@@ -9,19 +9,93 @@
 #ifndef PARSER_BASE_H__
 #define PARSER_BASE_H__
 
+#include <map>
 #include <string>
 #include <vector>
 
 #include "Coord3D.h"
+#include "GridView.h"
+#include "KeyDictionary.h"
+
+class StreamStats;
+
+/**
+ * Tells a parser following output files whether they are still being written,
+ * and hears about each layer block as soon as it has been read
+ */
+class OutputStatus
+{
+public:
+  /**
+   * Destructor
+   */
+  virtual ~OutputStatus(){}
+
+  /**
+   * Check if the output files are complete
+   *
+   * NOTE: Called from the parsing thread while the files are written
+   *
+   * @return  True once nothing more will be written to them
+   */
+  virtual bool isComplete() const = 0;
+
+  /**
+   * Check if the writer was stopped before it finished
+   *
+   * NOTE: Only asked once the files are complete. A stopped writer may have
+   *       been cut off part way through a line or a block, so those are dropped.
+   *
+   * @return  True if the output files were cut short
+   */
+  virtual bool wasStopped() const { return false; }
+
+  /**
+   * Hear about a layer block as soon as it has been read
+   *
+   * NOTE: Called from the parsing thread while the files are written
+   *
+   * @param key     Key the values were read for
+   * @param time    TIME value the block was written at (empty if none)
+   * @param layers  Number of layers of each key in the file
+   * @param vals    The values
+   * @param n       Number of values
+   */
+  virtual void blockRead(const std::string& key, const std::string& time, unsigned layers, const double* vals, size_t n) {}
+};
+
+/**
+ * Struct for parser tuning options
+ */
+struct ParserOptions
+{
+  ParserOptions()
+    : mmap(false), lazy(false), cache(false), compress(false), batch(false), single(false), sparse(0.0), delta(false), threads(0)
+  {
+  }
+  bool mmap; // Scan memory-mapped files rather than reading line by line
+  bool lazy; // Only index the files up front, decoding each key the first time it is used
+  bool cache; // Keep the parsed grids in a binary sidecar next to the output files and reuse it
+  bool compress; // Keep the grids losslessly packed in memory, unpacking them a tile at a time while scanning
+  bool batch; // Read the files ahead of the parser in large batched reads (io_uring where available)
+  bool single; // Store every grid rounded to single precision (half the memory, statistics still in double)
+  double sparse; // Store tiles with fewer nonzero values than this fraction of their cells as those values only (0 = never)
+  bool delta; // Store each snapshot's layers as changes from the same layers at the previous TIME (packed losslessly)
+  std::map<std::string, bool> singleKeys; // Keys stored in single precision (true to also take every key starting with it)
+  unsigned threads; // Files to parse at once, also threads per correlation pass (0 = one per hardware thread)
+};
 
 class ParserBase
 {
 public:
   /**
    * Constructor
+   *
+   * @param files     List of files to parse
+   * @param options   Parser tuning options
    */
-  ParserBase(const std::vector<std::string>& files)
-    : files(files)
+  ParserBase(const std::vector<std::string>& files, const ParserOptions& options=ParserOptions())
+    : files(files), options(options), stream(NULL), follow(NULL)
   {
   }
 
@@ -58,6 +132,126 @@ public:
    */
   virtual std::vector<double> getAllValues(const std::string& key) const = 0;
 
+  /**
+   * Get a read-only view of all values of a key (every layer, in order)
+   *
+   * @param key   The key to find all valid values for
+   * @return  A view of the values owned by the parser. If none exist, then
+   *          the view is empty.
+   */
+  virtual GridView getView(const std::string& key) const = 0;
+
+  /**
+   * Get a read-only view of the values of a key in one layer
+   *
+   * @param key     The key of the value to be found
+   * @param adtl    Additional information to identify the key
+   * @return  A view of the values owned by the parser. If none exist, then
+   *          the view is empty.
+   */
+  virtual GridView getLayerView(const std::string& key, int adtl) const = 0;
+
+  /**
+   * Get the id of a key (resolve names once, then use the id in hot paths)
+   *
+   * @param key   The key
+   * @return  Id of the key (KeyDictionary::NO_KEY if it was not parsed)
+   */
+  virtual int getKeyId(const std::string& key) const = 0;
+
+  /**
+   * Get a read-only view of all values of a key by its id
+   *
+   * @param id    Id of the key (see getKeyId())
+   * @return  A view of the values owned by the parser. If none exist, then
+   *          the view is empty.
+   */
+  virtual GridView getView(int id) const = 0;
+
+  /**
+   * Get a read-only view of the values of a key in one layer by its id
+   *
+   * @param id      Id of the key (see getKeyId())
+   * @param adtl    Additional information to identify the key
+   * @return  A view of the values owned by the parser. If none exist, then
+   *          the view is empty.
+   */
+  virtual GridView getLayerView(int id, int adtl) const = 0;
+
+  /**
+   * Get one tile of the values of a key, for scanning a key without
+   * needing all of its values unpacked at once
+   *
+   * NOTE: Tiles are handed out in order from 0 until an empty one is
+   *       returned. The default hands out every value as tile 0.
+   *
+   * @param id      Id of the key (see getKeyId())
+   * @param tile    Index of the tile
+   * @param buffer  Room for TILE_VALUES values, used if the tile has to be unpacked
+   * @return  View of the tile's values (empty past the last tile)
+   */
+  virtual GridView getTile(int id, size_t tile, double* buffer) const
+  {
+    return (tile == 0) ? getView(id) : GridView();
+  }
+
+  /**
+   * Get the number of values in one tile of a key without unpacking it,
+   * for skipping ahead to a position (see getTile())
+   *
+   * @param id      Id of the key (see getKeyId())
+   * @param tile    Index of the tile
+   * @return  Number of values in the tile (0 past the last tile)
+   */
+  virtual size_t getTileSize(int id, size_t tile) const
+  {
+    return (tile == 0) ? getView(id).size() : 0;
+  }
+
+  /**
+   * Get one tile of the values of a key, without expanding it if it is
+   * stored sparse (see getTile())
+   *
+   * NOTE: The default hands out every tile dense.
+   *
+   * @param id      Id of the key (see getKeyId())
+   * @param tile    Index of the tile
+   * @param buffer  Room for TILE_VALUES values, used if the tile has to be unpacked
+   * @param cells   Room for TILE_VALUES cells, used if the tile is sparse
+   * @return  The tile (no cells past the last tile)
+   */
+  virtual SparseTile getSparseTile(int id, size_t tile, double* buffer, unsigned short* cells) const
+  {
+    GridView values(getTile(id, tile, buffer));
+    return SparseTile(values, NULL, values.size());
+  }
+
+  /**
+   * Get every TIME value read, in order
+   *
+   * @return  The TIME values (empty if the files had none)
+   */
+  virtual const std::vector<std::string>& getTimes() const = 0;
+
+  /**
+   * Get the time snapshots of a key
+   *
+   * NOTE: A snapshot is a time-decorated key (i.e. "WATER-1.5000E+02") whose
+   *       values are the layers of the key read at that TIME
+   *
+   * @param id    Id of the key (see getKeyId())
+   * @return  Ids of the key's snapshots, in the order they were read
+   */
+  virtual std::vector<int> getSnapshots(int id) const = 0;
+
+  /**
+   * Get the TIME of a snapshot
+   *
+   * @param id    Id of a time-decorated key
+   * @return  Index of its TIME value in getTimes() (-1 if the key is not a snapshot)
+   */
+  virtual int getSnapshotTime(int id) const = 0;
+
   /**
    * Get keys
    *
@@ -65,6 +259,14 @@ public:
    */
   virtual std::vector<std::string> getParsedKeys() const = 0;
 
+  /**
+   * Hint that a set of keys is about to be used so that a parser
+   * which loads lazily can decode them all at once (unknown keys are ignored)
+   *
+   * @param keys  The keys that will be used
+   */
+  virtual void preload(const std::vector<std::string>& keys) {}
+
   /**
    * Checks if two cells are connected by a given component
    *
@@ -91,10 +293,33 @@ public:
    */
   virtual bool isValidResult(const std::vector<double>& val) const;
 
+  /**
+   * Stream the values into running statistics instead of keeping them
+   *
+   * NOTE: Must be set before readFile(). Keys are still listed, but
+   *       every grid is then empty.
+   *
+   * @param stats   Statistics to feed each layer block to as it is read (NULL to keep the grids)
+   */
+  void setStream(StreamStats* stats) { stream = stats; }
+
+  /**
+   * Follow the output files while they are still being written: readFile()
+   * parses whatever has been appended to them until the writer is complete
+   *
+   * NOTE: Must be set before readFile(). The files need not exist yet.
+   *
+   * @param status  Tells when the files are complete (NULL to parse them as they are)
+   */
+  void setFollow(OutputStatus* status) { follow = status; }
+
 protected:
   // Sentinel node (equivalent to NULL if no vector exists)
   const std::vector<double> sentinel;
   std::vector<std::string> files;
+  ParserOptions options;
+  StreamStats* stream;
+  OutputStatus* follow;
 };
 
 #endif /** PARSER_BASE_H__ */
@@ -0,0 +1,142 @@
+/**
+ * RadixSort.cpp
+ *
+ * Stable LSD radix sort of 64-bit keys on a thread pool
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#include <cstring>
+
+#include "RadixSort.h"
+#include "ThreadPool.h"
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+typedef unsigned long long uint64;
+
+using namespace std;
+
+static const uint64 SIGN_BIT = 1ULL << 63;
+
+/**
+ * One thread's run of the keys in one radix pass
+ */
+class RadixTask : public Task
+{
+public:
+  RadixTask()
+    : keys(NULL), index(NULL), outKeys(NULL), outIndex(NULL), shift(0), first(0), last(0), counting(true)
+  {
+  }
+
+  virtual void run()
+  {
+    if(counting) {
+      for(size_t d = 0 ; d < RADIX_BUCKETS ; ++d)
+        counts[d] = 0;
+      for(size_t i = first ; i < last ; ++i)
+        counts[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+    } else {
+      // counts now holds where this run's keys of each digit go
+      for(size_t i = first ; i < last ; ++i) {
+        size_t pos = counts[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+        outKeys[pos] = keys[i];
+        outIndex[pos] = index[i];
+      }
+    }
+  }
+
+  const uint64* keys;
+  const unsigned* index;
+  uint64* outKeys;
+  unsigned* outIndex;
+  unsigned shift;
+  size_t first, last;       // Run of keys
+  bool counting;            // Count the digits (otherwise move the keys)
+  size_t counts[RADIX_BUCKETS];
+};
+
+/**
+ * Map a value to a key that sorts like the numbers do
+ *
+ * @param val   The value
+ * @return  Its sort key
+ */
+uint64 RadixSort::key(double val)
+{
+  if(val == 0.0)
+    val = 0.0; // -0 ties with +0
+  uint64 bits;
+  memcpy(&bits, &val, sizeof(bits));
+  // Negative numbers order backwards, and below every positive one
+  return (bits & SIGN_BIT) ? ~bits : (bits | SIGN_BIT);
+}
+
+/**
+ * Sort keys, moving an index along with each
+ *
+ * @param keys    The keys (sorted in place)
+ * @param index   The index of each key (moved with it)
+ * @param pool    Threads to sort with (the keys are split over all of them)
+ */
+void RadixSort::sort(vector<uint64>& keys, vector<unsigned>& index, ThreadPool& pool)
+{
+  size_t n = keys.size();
+  uint64 anyBits = 0, allBits = ~0ULL;
+  for(size_t i = 0 ; i < n ; ++i) {
+    anyBits |= keys[i];
+    allBits &= keys[i];
+  }
+
+  vector<uint64> sortedKeys;
+  vector<unsigned> sortedIndex;
+  unsigned workers = pool.size() > 0 ? pool.size() : 1;
+  vector<RadixTask> runs(workers);
+  vector<Task*> work;
+  for(unsigned w = 0 ; w < workers ; ++w) {
+    runs[w].first = n * w / workers;
+    runs[w].last = n * (w + 1) / workers;
+    work.push_back(&runs[w]);
+  }
+
+  for(unsigned pass = 0 ; pass < RADIX_PASSES ; ++pass) {
+    unsigned shift = pass * RADIX_BITS;
+    // Nothing moves when every key has the same digit
+    if((((anyBits ^ allBits) >> shift) & (RADIX_BUCKETS - 1)) == 0)
+      continue;
+
+    if(sortedKeys.empty()) {
+      sortedKeys.resize(n);
+      sortedIndex.resize(n);
+    }
+    for(unsigned w = 0 ; w < workers ; ++w) {
+      runs[w].keys = &keys[0];
+      runs[w].index = &index[0];
+      runs[w].outKeys = &sortedKeys[0];
+      runs[w].outIndex = &sortedIndex[0];
+      runs[w].shift = shift;
+      runs[w].counting = true;
+    }
+    pool.run(work);
+
+    // Digits in order, and each digit's keys in the order of the runs
+    size_t pos = 0;
+    for(size_t d = 0 ; d < RADIX_BUCKETS ; ++d) {
+      for(unsigned w = 0 ; w < workers ; ++w) {
+        size_t count = runs[w].counts[d];
+        runs[w].counts[d] = pos;
+        pos += count;
+      }
+    }
+
+    for(unsigned w = 0 ; w < workers ; ++w)
+      runs[w].counting = false;
+    pool.run(work);
+
+    keys.swap(sortedKeys);
+    index.swap(sortedIndex);
+  }
+}
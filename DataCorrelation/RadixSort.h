@@ -0,0 +1,51 @@
+/**
+ * RadixSort.h
+ *
+ * Stable LSD radix sort of 64-bit keys on a thread pool, a byte per pass,
+ * used to order grid values for rank correlations
+ *
+ * Each pass splits the keys into one run per thread. Every thread counts
+ * the digits of its run, the counts are turned into where each thread's
+ * keys of each digit go (threads in order, so the sort stays stable), and
+ * every thread then moves its run into place. Bytes that every key shares
+ * are skipped.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef RADIXSORT_H__
+#define RADIXSORT_H__
+
+#include <vector>
+
+class ThreadPool;
+
+class RadixSort
+{
+public:
+  /**
+   * Map a value to a key that sorts like the numbers do
+   *
+   * NOTE: -0 gets the key of +0, so the two compare equal
+   *
+   * @param val   The value
+   * @return  Its sort key
+   */
+  static unsigned long long key(double val);
+
+  /**
+   * Sort keys, moving an index along with each
+   *
+   * @param keys    The keys (sorted in place)
+   * @param index   The index of each key (moved with it)
+   * @param pool    Threads to sort with (the keys are split over all of them)
+   */
+  static void sort(std::vector<unsigned long long>& keys, std::vector<unsigned>& index, ThreadPool& pool);
+
+private:
+  // Simple container so we don't have random methods floating.
+  RadixSort(){}
+  virtual ~RadixSort(){}
+};
+
+#endif /** RADIXSORT_H__ */
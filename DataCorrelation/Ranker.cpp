@@ -0,0 +1,116 @@
+/**
+ * Ranker.cpp
+ *
+ * Ranks the values of a grid with a parallel radix sort
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#include <climits>
+
+#include "DCException.h"
+#include "RadixSort.h"
+#include "Ranker.h"
+#include "ThreadPool.h"
+
+typedef unsigned long long uint64;
+
+using namespace std;
+
+/**
+ * Gives one thread's runs of equal values their average rank
+ */
+class TieTask : public Task
+{
+public:
+  TieTask(const vector<uint64>& keys, const vector<unsigned>& index, vector<double>& ranks, size_t first, size_t last)
+    : keys(keys), index(index), ranks(ranks), first(first), last(last)
+  {
+  }
+
+  virtual void run()
+  {
+    size_t i = first;
+    while(i < last) {
+      size_t j = i + 1;
+      while(j < keys.size() && keys[j] == keys[i])
+        ++j;
+      // Average of the ranks i + 1 to j
+      double rank = (static_cast<double>(i) + 1.0 + static_cast<double>(j)) / 2.0;
+      for(size_t k = i ; k < j ; ++k)
+        ranks[index[k]] = rank;
+      i = j;
+    }
+  }
+
+  const vector<uint64>& keys;
+  const vector<unsigned>& index;
+  vector<double>& ranks;
+  size_t first, last; // Runs starting in here
+};
+
+/**
+ * Constructor
+ *
+ * @param n   Number of values that will be added (room is reserved for them)
+ */
+Ranker::Ranker(size_t n)
+{
+  keys.reserve(n);
+}
+
+/**
+ * Add the next values
+ *
+ * @param vals  The values
+ * @param n     Number of values
+ */
+void Ranker::add(const double* vals, size_t n)
+{
+  for(size_t i = 0 ; i < n ; ++i)
+    keys.push_back(RadixSort::key(vals[i]));
+}
+
+/**
+ * Rank every value added, in the order they were added
+ *
+ * @param ranks     Receives the rank of each value
+ * @param threads   Threads to sort with (0 = one per hardware thread)
+ */
+void Ranker::rank(vector<double>& ranks, unsigned threads)
+{
+  size_t n = keys.size();
+  if(n > UINT_MAX)
+    throw DCException("Ranker: too many values to rank");
+
+  vector<unsigned> index(n);
+  for(size_t i = 0 ; i < n ; ++i)
+    index[i] = static_cast<unsigned>(i);
+
+  // A run of a few thousand values per thread at least
+  unsigned workers = ThreadPool::resolve(threads, n / 16384 + 1);
+  ThreadPool pool(workers);
+  RadixSort::sort(keys, index, pool);
+
+  // Each thread takes the runs of equal values that start in its share
+  ranks.resize(n);
+  vector<TieTask*> ties;
+  vector<Task*> work;
+  size_t first = 0;
+  for(unsigned w = 0 ; w < workers ; ++w) {
+    size_t last = n * (w + 1) / workers;
+    while(last < n && last > 0 && keys[last] == keys[last - 1])
+      ++last;
+    if(last < first)
+      last = first;
+    ties.push_back(new TieTask(keys, index, ranks, first, last));
+    work.push_back(ties.back());
+    first = last;
+  }
+  pool.run(work);
+
+  for(size_t i = 0 ; i < ties.size() ; ++i)
+    delete ties[i];
+
+  vector<uint64>().swap(keys);
+}
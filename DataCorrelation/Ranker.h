@@ -0,0 +1,61 @@
+/**
+ * Ranker.h
+ *
+ * Ranks the values of a grid (1 for the smallest), for rank correlation
+ *
+ * The values are sorted by a parallel LSD radix sort on their IEEE bits
+ * (see RadixSort). Equal values get the average of the ranks they span,
+ * and -0 ties with +0.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef RANKER_H__
+#define RANKER_H__
+
+#include <cstddef>
+#include <vector>
+
+class Ranker
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param n   Number of values that will be added (room is reserved for them)
+   */
+  Ranker(size_t n=0);
+
+  /**
+   * Destructor
+   */
+  virtual ~Ranker(){}
+
+  /**
+   * Add the next values
+   *
+   * @param vals  The values
+   * @param n     Number of values
+   */
+  void add(const double* vals, size_t n);
+
+  /**
+   * Get the number of values added
+   */
+  size_t size() const { return keys.size(); }
+
+  /**
+   * Rank every value added, in the order they were added
+   *
+   * NOTE: The values are released once ranked
+   *
+   * @param ranks     Receives the rank of each value
+   * @param threads   Threads to sort with (0 = one per hardware thread)
+   */
+  void rank(std::vector<double>& ranks, unsigned threads=1);
+
+private:
+  std::vector<unsigned long long> keys; // Sort key of each value
+};
+
+#endif /** RANKER_H__ */
@@ -6,30 +6,202 @@
  * @author Dennis J. McWherter, Jr.
  */
 #define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <stdexcept>
 
 #define USE_GETCWD // To include proper files from DCUtil
 #include "AnalyzeData.h"
+#include "ChildProcess.h"
 #include "Configuration.h"
 #include "DCUtil.h"
+#include "Monitor.h"
 #include "Slave.h"
 #include "Status.h"
+#include "StreamStats.h"
+#include "ThreadPool.h"
+#include "TileScanner.h"
 #include "UTChemParser.h"
 
 #include "mpi.h"
 
 using namespace std;
 
+/**
+ * Runs the simulator on a pool thread so that its output files can be
+ * parsed while they are written, and stops it once a watch's stop rule is met
+ */
+class SimulatorTask : public Task, public OutputStatus
+{
+public:
+  SimulatorTask(const string& cmd, const watchset& watches)
+    : cmd(cmd), complete(false), stopped(false), monitor(watches)
+  {
+  }
+
+  virtual void run()
+  {
+    {
+      ScopedLock guard(lock);
+      if(!process.start(cmd))
+        cerr<< "Could not start the simulator: " << cmd << endl;
+    }
+    process.wait();
+
+    // A stop that came as the simulator finished on its own did not cut it short
+    ScopedLock guard(lock);
+    complete = true;
+    stopped = stopped && process.wasStopped();
+  }
+
+  virtual bool isComplete() const
+  {
+    ScopedLock guard(lock);
+    return complete;
+  }
+
+  virtual bool wasStopped() const
+  {
+    ScopedLock guard(lock);
+    return stopped;
+  }
+
+  virtual void blockRead(const string& key, const string& time, unsigned layers, const double* vals, size_t n)
+  {
+    if(monitor.isStopped() || !monitor.add(key, time, layers, vals, n))
+      return;
+
+    // Too late if the simulator finished on its own in the meantime (even
+    // if wait() has not returned yet)
+    ScopedLock guard(lock);
+    if(!complete && process.stop()) {
+      cout<< "Stopping the simulation at TIME " << monitor.getStopTime() << ": " << monitor.getReason() << endl;
+      stopped = true;
+    }
+  }
+
+  /**
+   * Get the watch that stopped the simulator (only if wasStopped())
+   */
+  const Monitor& getMonitor() const { return monitor; }
+
+private:
+  string cmd;
+  bool complete, stopped;
+  ChildProcess process;
+  Monitor monitor; // Only used on the parsing thread
+  mutable Mutex lock;
+};
+
+/**
+ * Count the nonzero values of a key, a tile at a time
+ *
+ * @param p         The parser
+ * @param id        Id of the key
+ * @param cells     Receives the number of values
+ * @param nonzero   Receives how many of them are not zero
+ */
+static void countNonzero(const ParserBase& p, int id, unsigned& cells, unsigned& nonzero)
+{
+  TileScanner tiles(p, id);
+  SparseTile tile;
+  cells = nonzero = 0;
+  while(tiles.next(tile)) {
+    for(size_t i = 0 ; i < tile.values.size() ; ++i)
+      nonzero += (tile.values[i] != 0.0);
+    cells += static_cast<unsigned>(tile.size);
+  }
+}
+
+/**
+ * Gather the nonzero values of a key and their cells, a tile at a time
+ *
+ * @param p             The parser
+ * @param id            Id of the key
+ * @param cells         Receives the index of each value in the grid
+ * @param vals          Receives the values (rounded to T)
+ * @param roundErrors   Raised to the largest absolute and relative error made rounding
+ */
+template<typename T>
+static void gatherNonzero(const ParserBase& p, int id, vector<unsigned>& cells, vector<T>& vals, double* roundErrors)
+{
+  TileScanner tiles(p, id);
+  SparseTile tile;
+  unsigned first = 0; // Index of the tile's first cell in the grid
+  while(tiles.next(tile)) {
+    for(size_t i = 0 ; i < tile.values.size() ; ++i) {
+      double val = tile.values[i];
+      if(val == 0.0)
+        continue;
+      cells.push_back(first + static_cast<unsigned>(tile.sparse() ? tile.cells[i] : i));
+      vals.push_back(static_cast<T>(val));
+      double err = fabs(static_cast<double>(vals.back()) - val);
+      roundErrors[0] = max(roundErrors[0], err);
+      roundErrors[1] = max(roundErrors[1], err / fabs(val));
+    }
+    first += static_cast<unsigned>(tile.size);
+  }
+}
+
+/**
+ * Correlate every parameter asking for Pearson's, Spearman's or Kendall's coefficient
+ * with its partner key, reading each partner key once for all of them
+ *
+ * @param d             The analysis of the parsed grids
+ * @param params        The parameters
+ * @param stat          Parameter::PEARSON, Parameter::SPEARMAN or Parameter::KENDALL
+ * @param stoppedEarly  True if the simulation was stopped early (keys may be missing)
+ * @param threads       Threads to compute each pass with (0 = one per hardware thread)
+ * @param ret           Receives the coefficient of each parameter (NaN if not computed)
+ */
+static void correlate(const AnalyzeData& d, const paramset& params, unsigned stat, bool stoppedEarly,
+                      unsigned threads, vector<double>& ret)
+{
+  ret.assign(params.size(), numeric_limits<double>::quiet_NaN());
+
+  map<int, vector<size_t> > byPartner; // Parameters asking for each partner key
+  for(size_t i = 0 ; i < params.size() ; ++i) {
+    const Parameter& param = params[i];
+    int partner = param.kendallId;
+    if(stat == Parameter::PEARSON)
+      partner = param.pearsonId;
+    else if(stat == Parameter::SPEARMAN)
+      partner = param.spearmanId;
+    bool unwritten = stoppedEarly && (param.id == KeyDictionary::NO_KEY || partner == KeyDictionary::NO_KEY);
+    if((param.stats & stat) && !unwritten)
+      byPartner[partner].push_back(i);
+  }
+
+  map<int, vector<size_t> >::const_iterator group;
+  for(group = byPartner.begin() ; group != byPartner.end() ; ++group) {
+    vector<int> keys;
+    for(size_t i = 0 ; i < group->second.size() ; ++i)
+      keys.push_back(params[group->second[i]].id);
+    vector<double> results;
+    if(stat == Parameter::PEARSON)
+      d.pearsons(group->first, keys, results, threads);
+    else if(stat == Parameter::SPEARMAN)
+      d.spearmans(group->first, keys, results, threads);
+    else
+      d.kendalls(group->first, keys, results, threads);
+    for(size_t i = 0 ; i < group->second.size() ; ++i)
+      ret[group->second[i]] = results[i];
+  }
+}
+
 /**
  * Constructor
  *
  * @param config    The configuration settings passed to the slave
  */
 Slave::Slave(Configuration& config)
-  : config(config)
+  : config(config), simulator(NULL), simPool(NULL)
 {
 }
 
@@ -38,6 +210,8 @@ Slave::Slave(Configuration& config)
  */
 Slave::~Slave()
 {
+  delete simPool; // Waits for the simulator
+  delete simulator;
 }
 
 /**
@@ -135,7 +309,15 @@ vector<string> Slave::runSimulation()
   //system("echo %computername%");
 
   // Execute the above command
-  system(cmd.c_str());
+  if(config.followOutput()) {
+    // In the background, the output files are parsed as they are written
+    // (see calculateAndTxResults())
+    simulator = new SimulatorTask(cmd, config.getWatches());
+    simPool = new ThreadPool(1);
+    simPool->submit(simulator);
+  } else {
+    system(cmd.c_str());
+  }
 
   return files;
 }
@@ -152,13 +334,36 @@ void Slave::calculateAndTxResults(const vector<string>& files)
     debugMacro("Reading: "<< filepath);
   }
 
-  UTChemParser p(files);
+  UTChemParser p(files, config.getParserOptions());
+
+  // Parse the output files while the simulator is still writing them
+  if(simulator != NULL)
+    p.setFollow(simulator);
+
+  // If only running statistics were asked for, accumulate them while parsing
+  // rather than keeping every grid in memory
+  // NOTE: Not while following, since the blocks of different files are then
+  //       read interleaved rather than in file order
+  StreamStats streamed;
+  bool streaming = config.streamValues() && config.canStream() && simulator == NULL;
+  if(config.streamValues() && simulator != NULL)
+    cout<< "Not streaming values: the output files are followed." << endl;
+  else if(config.streamValues() && !streaming)
+    cout<< "Not streaming values: some statistics need the full grids." << endl;
+  if(streaming) {
+    const paramset& params = config.getParams();
+    paramset::const_iterator it;
+    for(it = params.begin() ; it != params.end() ; ++it)
+      streamed.watch(it->name, (it->stats & Parameter::ALL_SIMILAR) != 0);
+    p.setStream(&streamed);
+  }
 
   try {
     AnalyzeData d(p);
 
     // List parsed keys
     config.updateParams(p.getParsedKeys()); // Need these keys for any "all" values 
+    config.resolveParams(p); // Look each key up once rather than for every statistic
     if(config.listKeys()) {
       cout<< "Parsed keys: " << endl << "=====================" << endl;
       vector<string> keys(p.getParsedKeys());
@@ -179,14 +384,94 @@ void Slave::calculateAndTxResults(const vector<string>& files)
       debugMacro(d.getConnectivityGraph(g.valueToGraph, g.lowerThresh, g.upperThresh, addtl));
     }
 
+    // Keys of the correlation matrix, in the order they were parsed
+    const MatrixData& m = config.getMatrix();
+    vector<string> matrixKeys;
+    if(!m.prefixes.empty()) {
+      vector<string> keys(p.getParsedKeys());
+      for(size_t k = 0 ; k < keys.size() ; ++k) {
+        for(size_t i = 0 ; i < m.prefixes.size() ; ++i) {
+          if(DCUtil::startsWith(keys[k], m.prefixes[i])) {
+            matrixKeys.push_back(keys[k]);
+            break;
+          }
+        }
+      }
+    }
+
     const paramset& params = config.getParams();
     paramset::const_iterator it;
 
+    // Decode every key the parameters use in one go (only matters when loading lazily)
+    vector<string> used(matrixKeys);
+    for(it = params.begin() ; it != params.end() ; ++it) {
+      used.push_back(it->name);
+      if(!it->pearson.empty())
+        used.push_back(it->pearson);
+      if(!it->spearman.empty())
+        used.push_back(it->spearman);
+      if(!it->kendall.empty())
+        used.push_back(it->kendall);
+    }
+    p.preload(used);
+
+    const ParserOptions& opts = config.getParserOptions();
+
+    // The matrix is written next to the graphs, one file per run
+    if(!matrixKeys.empty()) {
+      string addtl("-");
+      addtl.append(DCUtil::XToY<double, string>(work));
+      vector<string> omitted;
+      string matrixFile(d.getCorrelationMatrix(matrixKeys, m.binary, addtl, opts.threads, &omitted));
+      cout<< "Correlation matrix of " << (matrixKeys.size() - omitted.size()) << " keys: " << matrixFile << endl;
+      for(size_t k = 0 ; k < omitted.size() ; ++k)
+        cout<< "Correlation matrix: left out " << omitted[k] << " (its number of values differs from most keys)" << endl;
+    } else if(!m.prefixes.empty()) {
+      cout<< "Correlation matrix: no parsed key matches." << endl;
+    }
+    if(opts.compress || opts.single || !opts.singleKeys.empty() || opts.sparse > 0.0 || opts.delta) {
+      size_t unpacked = 0, packed = 0;
+      p.getValueBytes(unpacked, packed);
+      if(packed > 0)
+        cout<< "Packed grids: " << unpacked << " bytes in " << packed << " bytes (ratio "
+            << static_cast<double>(unpacked) / packed << ")" << endl;
+    }
+    if(opts.single || !opts.singleKeys.empty()) {
+      double absError = 0.0, relError = 0.0;
+      p.getRoundingError(KeyDictionary::NO_KEY, absError, relError);
+      cout<< "Single precision: max absolute error " << absError << ", max relative error " << relError << endl;
+    }
+
     // Protocol step 1:
     // send to master how many parameters will be sent over
     size_t val = params.size();
     MPI_Send(&val, 1, MPI_UNSIGNED, MASTER, 1, MPI_COMM_WORLD);
-    
+
+    // Protocol step 1b:
+    // send to master whether the simulation was stopped early, and if so
+    // the simulated TIME it was stopped at and which stop rule was met
+    bool stoppedEarly = (simulator != NULL && simulator->wasStopped());
+    unsigned stopFlag = stoppedEarly ? 1 : 0;
+    MPI_Send(&stopFlag, 1, MPI_UNSIGNED, MASTER, 1, MPI_COMM_WORLD);
+    if(stoppedEarly) {
+      const Monitor& monitor = simulator->getMonitor();
+      double stopTime = DCUtil::XToY<string, double>(monitor.getStopTime());
+      MPI_Send(&stopTime, 1, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
+
+      unsigned rSize = static_cast<unsigned>(monitor.getReason().size() + 1); // With the null byte
+      MPI_Send(&rSize, 1, MPI_UNSIGNED, MASTER, 1, MPI_COMM_WORLD);
+      MPI_Send(const_cast<char*>(monitor.getReason().c_str()), static_cast<int>(rSize), MPI_BYTE, MASTER, 1, MPI_COMM_WORLD);
+    }
+
+    // A stopped simulation may not have written every key yet
+    const double notWritten = numeric_limits<double>::quiet_NaN();
+
+    // Every key correlated with the same partner is read in one pass over it
+    vector<double> pearsons, spearmans, kendalls;
+    correlate(d, params, Parameter::PEARSON, stoppedEarly, opts.threads, pearsons);
+    correlate(d, params, Parameter::SPEARMAN, stoppedEarly, opts.threads, spearmans);
+    correlate(d, params, Parameter::KENDALL, stoppedEarly, opts.threads, kendalls);
+
     // Now send each parameter
     for(it = params.begin() ; it != params.end() ; ++it) {
       // Make appropriate copies of the data to use with MPI_Send since
@@ -215,45 +500,149 @@ void Slave::calculateAndTxResults(const vector<string>& files)
       // Protocol step 5:
       // send to master the result of the parameter calculations
       double calcResult = 0.f;
+      const RunningStats* running = NULL;
+      if(streaming && (running = streamed.find(it->name)) == NULL)
+        throw out_of_range("No values were read for " + it->name);
+      bool missing = stoppedEarly && it->id == KeyDictionary::NO_KEY;
+      // Every summary statistic comes out of a single pass over the grid
+      RunningStats summary;
+      const unsigned summarized = Parameter::SUM | Parameter::MEAN | Parameter::VARIANCE | Parameter::STDDEV
+                                | Parameter::MIN | Parameter::MAX;
+      if(!streaming && !missing && (stats & summarized)) {
+        d.summarize(it->id, summary);
+        running = &summary;
+      }
       // Count along the way, calculate, and send in order.
       if(stats & Parameter::SUM) {
-        calcResult = d.sum(it->name);
+        calcResult = missing ? notWritten : running->sum;
         MPI_Send(&calcResult, 1, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
       }
       if(stats & Parameter::MEAN) {
-        calcResult = d.mean(it->name);
+        calcResult = missing ? notWritten : running->mean();
         MPI_Send(&calcResult, 1, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
       }
       if(stats & Parameter::VARIANCE) {
-        calcResult = d.variance(it->name);
+        calcResult = missing ? notWritten : running->variance();
         MPI_Send(&calcResult, 1, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
       }
       if(stats & Parameter::STDDEV) {
-        calcResult = d.stddev(it->name);
+        calcResult = missing ? notWritten : running->stddev();
         MPI_Send(&calcResult, 1, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
       }
       if(stats & Parameter::PEARSON) {
-        calcResult = d.pearsons(it->name, it->pearson);
+        calcResult = pearsons[it - params.begin()];
+        MPI_Send(&calcResult, 1, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
+      }
+      if(stats & Parameter::SPEARMAN) {
+        calcResult = spearmans[it - params.begin()];
+        MPI_Send(&calcResult, 1, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
+      }
+      if(stats & Parameter::KENDALL) {
+        calcResult = kendalls[it - params.begin()];
         MPI_Send(&calcResult, 1, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
       }
-      if(stats & Parameter::NORM) {
-        // Send the number of elements
-        vector<double> gridVals(p.getAllValues(name));
-        unsigned numVals = static_cast<unsigned>(gridVals.size());
+      // Rounding error of the stored values (rounding them to send adds to it below)
+      double roundErrors[2] = { 0.0, 0.0 };
+      if((stats & Parameter::SINGLE) && !missing)
+        p.getRoundingError(it->id, roundErrors[0], roundErrors[1]);
+      // With sparse tiles, a grid with few nonzero values is sent as just
+      // those values and their cells
+      unsigned numCells = 0, nonzero = 0;
+      bool sendSparse = false;
+      if((stats & Parameter::NORM) && opts.sparse > 0.0 && !missing) {
+        countNonzero(p, it->id, numCells, nonzero);
+        sendSparse = (nonzero < opts.sparse * numCells);
+      }
+      if(sendSparse) {
+        vector<unsigned> cells;
+        vector<double> vals;
+        vector<float> single;
+        if(stats & Parameter::SINGLE)
+          gatherNonzero(p, it->id, cells, single, roundErrors);
+        else
+          gatherNonzero(p, it->id, cells, vals, roundErrors);
+
+        // Send the number of elements, then how many of them are sent
+        MPI_Send(&numCells, 1, MPI_UNSIGNED, MASTER, 1, MPI_COMM_WORLD);
+        MPI_Send(&nonzero, 1, MPI_UNSIGNED, MASTER, 1, MPI_COMM_WORLD);
+
+        // Send the cells, then the values in them
+        MPI_Send(cells.empty() ? NULL : &cells[0], nonzero, MPI_UNSIGNED, MASTER, 1, MPI_COMM_WORLD);
+        if(stats & Parameter::SINGLE)
+          MPI_Send(single.empty() ? NULL : &single[0], nonzero, MPI_FLOAT, MASTER, 1, MPI_COMM_WORLD);
+        else
+          MPI_Send(vals.empty() ? NULL : &vals[0], nonzero, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
+      } else if((stats & Parameter::NORM) && (stats & Parameter::SINGLE)) {
+        // Round the values a tile at a time so the grid is never unpacked as a whole
+        vector<float> single;
+        if(!missing) {
+          double buffer[TILE_VALUES];
+          GridView tile;
+          for(size_t t = 0 ; !(tile = p.getTile(it->id, t, buffer)).empty() ; ++t) {
+            for(size_t i = 0 ; i < tile.size() ; ++i) {
+              single.push_back(static_cast<float>(tile[i]));
+              double err = fabs(single.back() - tile[i]);
+              roundErrors[0] = max(roundErrors[0], err);
+              if(tile[i] != 0.0)
+                roundErrors[1] = max(roundErrors[1], err / fabs(tile[i]));
+            }
+          }
+        }
+        unsigned numVals = static_cast<unsigned>(single.size());
 
         // Send the number of elements to receive
         MPI_Send(&numVals, 1, MPI_UNSIGNED, MASTER, 1, MPI_COMM_WORLD);
+        if(opts.sparse > 0.0)
+          MPI_Send(&nonzero, 1, MPI_UNSIGNED, MASTER, 1, MPI_COMM_WORLD);
+
+        // Send the values as floats
+        MPI_Send(single.empty() ? NULL : &single[0], numVals, MPI_FLOAT, MASTER, 1, MPI_COMM_WORLD);
+      } else if(stats & Parameter::NORM) {
+        // Count the elements without unpacking any of them
+        unsigned numVals = 0;
+        size_t size;
+        for(size_t t = 0 ; !missing && (size = p.getTileSize(it->id, t)) > 0 ; ++t)
+          numVals += static_cast<unsigned>(size);
 
-        double* dVals = new double[numVals];
-        // Send each value
-        for(unsigned i = 0 ; i < numVals ; ++i) {
-          //MPI_Send(&gridVals[i], 1, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
-          dVals[i] = gridVals[i];
+        // Send the number of elements to receive
+        MPI_Send(&numVals, 1, MPI_UNSIGNED, MASTER, 1, MPI_COMM_WORLD);
+        if(opts.sparse > 0.0)
+          MPI_Send(&nonzero, 1, MPI_UNSIGNED, MASTER, 1, MPI_COMM_WORLD);
+
+        // Send the values a tile (one message) at a time so a packed grid is
+        // never unpacked as a whole (MPI_Send does not take "const" args)
+        if(!missing) {
+          TileScanner tiles(p, it->id);
+          GridView tile;
+          while(tiles.next(tile))
+            MPI_Send(const_cast<double*>(tile.data()), static_cast<int>(tile.size()), MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
         }
+      }
 
-        MPI_Send(dVals, numVals, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
-
-        delete [] dVals;
+      // Protocol step 6:
+      // send to master the largest absolute and relative error made rounding
+      // the parameter to single precision (only if it was)
+      if(stats & Parameter::SINGLE)
+        MPI_Send(roundErrors, 2, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
+
+      // Protocol step 7:
+      // send to master the minimum and maximum, each followed by the index
+      // of the first cell holding it
+      if(stats & Parameter::MIN) {
+        double extreme[2] = { notWritten, notWritten };
+        if(!missing && running->minCell != RunningStats::NO_CELL) {
+          extreme[0] = running->min;
+          extreme[1] = static_cast<double>(running->minCell);
+        }
+        MPI_Send(extreme, 2, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
+      }
+      if(stats & Parameter::MAX) {
+        double extreme[2] = { notWritten, notWritten };
+        if(!missing && running->maxCell != RunningStats::NO_CELL) {
+          extreme[0] = running->max;
+          extreme[1] = static_cast<double>(running->maxCell);
+        }
+        MPI_Send(extreme, 2, MPI_DOUBLE, MASTER, 1, MPI_COMM_WORLD);
       }
 
       delete [] name;
@@ -15,6 +15,9 @@
 
 #include "Configuration.h"
 
+class SimulatorTask;
+class ThreadPool;
+
 class Slave
 {
 public:
@@ -103,6 +106,8 @@ private:
   /** Variables */
   Configuration& config;
   double work;
+  SimulatorTask* simulator; // Simulator running in the background while its output is followed (if any)
+  ThreadPool* simPool;      // Thread the simulator runs on
 };
 
 #endif /** SLAVE_H__ */
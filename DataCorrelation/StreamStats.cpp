@@ -0,0 +1,335 @@
+/**
+ * StreamStats.cpp
+ *
+ * Running statistics fed with values while the output files are parsed
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "DCUtil.h"
+#include "Kernels.h"
+#include "StreamStats.h"
+
+using namespace std;
+
+const size_t RunningStats::NO_CELL;
+
+/**
+ * Compute the moments of a chunk of values
+ *
+ * @param vals    The chunk
+ * @param n       Number of values in it
+ * @param count   Receives n
+ * @param mean    Receives their mean
+ * @param m2      Receives their sum of squared deviations from it
+ */
+static void chunkMoments(const double* vals, size_t n, size_t& count, double& mean, double& m2)
+{
+  LaneSums sum, squares;
+  Kernels::sum(sum, vals, n);
+  mean = sum.total() / n;
+  Kernels::sumDeviations(squares, vals, n, mean);
+  m2 = squares.total();
+  count = n;
+}
+
+/**
+ * Find the first of some values equal to one of them
+ *
+ * @param vals  The values
+ * @param val   The value (one of them)
+ * @return  Its index
+ */
+static size_t firstOf(const double* vals, double val)
+{
+  size_t i = 0;
+  while(vals[i] != val)
+    ++i;
+  return i;
+}
+
+/**
+ * Merge the moments of a run of values into those of the run before it
+ *
+ * @param count   Values in the run before (updated)
+ * @param mean    Their mean (updated)
+ * @param m2      Their sum of squared deviations from it (updated)
+ * @param n       Values in the run to merge
+ * @param mu      Their mean
+ * @param q       Their sum of squared deviations from it
+ */
+static void mergeMoments(size_t& count, double& mean, double& m2, size_t n, double mu, double q)
+{
+  double total = static_cast<double>(count + n);
+  double delta = mu - mean;
+  mean += delta * (n / total);
+  m2 += q + (delta * delta) * (static_cast<double>(count) * n / total);
+  count += n;
+}
+
+/**
+ * Constructor
+ */
+RunningStats::RunningStats()
+  : count(0), sum(0.0), min(numeric_limits<double>::quiet_NaN()), max(numeric_limits<double>::quiet_NaN()),
+    minCell(NO_CELL), maxCell(NO_CELL)
+{
+}
+
+/**
+ * Add the next values
+ *
+ * @param vals  The values
+ * @param n     Number of values
+ */
+void RunningStats::add(const double* vals, size_t n)
+{
+  Kernels::sum(sums, vals, n);
+  sum = sums.total();
+
+  // Only a block with a new minimum or maximum is looked through for its cell
+  double lo, hi;
+  Kernels::minMax(vals, n, lo, hi);
+  if(lo <= hi) {
+    if(minCell == NO_CELL || lo < min) {
+      size_t i = firstOf(vals, lo);
+      min = vals[i];
+      minCell = count + i;
+    }
+    if(maxCell == NO_CELL || hi > max) {
+      size_t i = firstOf(vals, hi);
+      max = vals[i];
+      maxCell = count + i;
+    }
+  }
+  count += n;
+
+  // Finish the chunk being filled, merge whole chunks in place, keep the rest
+  size_t i = 0;
+  if(!pending.empty()) {
+    i = std::min(n, TILE_VALUES - pending.size());
+    pending.insert(pending.end(), vals, vals + i);
+    if(pending.size() < TILE_VALUES)
+      return;
+    addChunk(&pending[0], pending.size());
+    pending.clear();
+  }
+  for( ; i + TILE_VALUES <= n ; i += TILE_VALUES)
+    addChunk(vals + i, TILE_VALUES);
+  pending.insert(pending.end(), vals + i, vals + n);
+}
+
+/**
+ * Merge a whole chunk into the moments
+ *
+ * @param vals  The values
+ * @param n     Number of values
+ */
+void RunningStats::addChunk(const double* vals, size_t n)
+{
+  Moments run;
+  chunkMoments(vals, n, run.count, run.mean, run.m2);
+
+  // Like carrying in binary, so each value goes through only log(chunks) merges
+  while(!merged.empty() && merged.back().count == run.count) {
+    Moments& before = merged.back();
+    mergeMoments(before.count, before.mean, before.m2, run.count, run.mean, run.m2);
+    run = before;
+    merged.pop_back();
+  }
+  merged.push_back(run);
+}
+
+/**
+ * Variance over every value seen
+ *
+ * @return  Sum of squared deviations from the mean / count
+ */
+double RunningStats::variance() const
+{
+  // Merge the runs from the smallest (and the chunk being filled) up
+  Moments total = { 0, 0.0, 0.0 };
+  if(!pending.empty())
+    chunkMoments(&pending[0], pending.size(), total.count, total.mean, total.m2);
+  for(size_t i = merged.size() ; i > 0 ; --i) {
+    const Moments& run = merged[i - 1];
+    if(total.count == 0)
+      total = run;
+    else
+      mergeMoments(total.count, total.mean, total.m2, run.count, run.mean, run.m2);
+  }
+  return total.m2 / count;
+}
+
+/**
+ * Standard deviation over every value seen
+ *
+ * @return  sqrt(variance)
+ */
+double RunningStats::stddev() const
+{
+  return sqrt(variance());
+}
+
+/**
+ * Constructor
+ */
+CoMoments::CoMoments()
+  : count(0), xMean(0.0), yMean(0.0), xM2(0.0), yM2(0.0), c(0.0)
+{
+}
+
+/**
+ * Take the moments of one chunk of pairs
+ *
+ * @param x   The first values
+ * @param y   The second values
+ * @param n   Number of pairs
+ */
+void CoMoments::set(const double* x, const double* y, size_t n)
+{
+  // The chunk stays in cache, so each sum is its own pass over it
+  LaneSums xSum, ySum, xSquares, ySquares, products;
+  Kernels::sum(xSum, x, n);
+  Kernels::sum(ySum, y, n);
+  xMean = xSum.total() / n;
+  yMean = ySum.total() / n;
+  Kernels::sumDeviations(xSquares, x, n, xMean);
+  Kernels::sumDeviations(ySquares, y, n, yMean);
+  Kernels::sumCoDeviations(products, x, y, n, xMean, yMean);
+  xM2 = xSquares.total();
+  yM2 = ySquares.total();
+  c = products.total();
+  count = n;
+}
+
+/**
+ * Merge the moments of the run after this one into it
+ *
+ * @param run   The moments of the next run
+ */
+void CoMoments::merge(const CoMoments& run)
+{
+  if(run.count == 0)
+    return;
+  if(count == 0) {
+    *this = run;
+    return;
+  }
+
+  double total = static_cast<double>(count + run.count);
+  double xDelta = run.xMean - xMean;
+  double yDelta = run.yMean - yMean;
+  double weight = static_cast<double>(count) * run.count / total;
+  xMean += xDelta * (run.count / total);
+  yMean += yDelta * (run.count / total);
+  xM2 += run.xM2 + (xDelta * xDelta) * weight;
+  yM2 += run.yM2 + (yDelta * yDelta) * weight;
+  c += run.c + (xDelta * yDelta) * weight;
+  count += run.count;
+}
+
+/**
+ * Merge the moments of consecutive chunks, pairing runs of equal size first
+ *
+ * @param chunks  The moments of each chunk, in order
+ * @return  The moments of every pair
+ */
+CoMoments CoMoments::total(const vector<CoMoments>& chunks)
+{
+  // Like carrying in binary (see RunningStats::addChunk())
+  vector<CoMoments> merged;
+  vector<CoMoments>::const_iterator it;
+  for(it = chunks.begin() ; it != chunks.end() ; ++it) {
+    CoMoments run = *it;
+    while(!merged.empty() && merged.back().count == run.count) {
+      merged.back().merge(run);
+      run = merged.back();
+      merged.pop_back();
+    }
+    merged.push_back(run);
+  }
+
+  // Merge the runs from the smallest (the last pairs) up
+  CoMoments ret;
+  for(size_t i = merged.size() ; i > 0 ; --i) {
+    CoMoments run = merged[i - 1];
+    run.merge(ret);
+    ret = run;
+  }
+  return ret;
+}
+
+/**
+ * Pearson's coefficient over every pair
+ *
+ * @return  Co-moment / sqrt(product of the sums of squared deviations)
+ */
+double CoMoments::pearson() const
+{
+  return c / sqrt(xM2 * yM2);
+}
+
+/**
+ * Accumulate the values of a key
+ *
+ * @param key     The key
+ * @param prefix  If true, accumulate every key starting with key instead
+ */
+void StreamStats::watch(const string& key, bool prefix)
+{
+  if(prefix)
+    prefixes.push_back(key);
+  else
+    exact.push_back(key);
+}
+
+/**
+ * Add the values of one layer block
+ *
+ * @param key     Key the values were read for (ignored unless watched)
+ * @param vals    The values
+ * @param n       Number of values
+ */
+void StreamStats::add(const string& key, const double* vals, size_t n)
+{
+  int id = keys.find(key);
+  if(id == KeyDictionary::NO_KEY) {
+    // First block of this key, so check whether it is wanted at all
+    if(ignored.find(key) != KeyDictionary::NO_KEY)
+      return;
+
+    bool wanted = false;
+    vector<string>::const_iterator it;
+    for(it = exact.begin() ; it != exact.end() && !wanted ; ++it)
+      wanted = (key == *it);
+    for(it = prefixes.begin() ; it != prefixes.end() && !wanted ; ++it)
+      wanted = DCUtil::startsWith(key, *it);
+
+    if(!wanted) {
+      ignored.intern(key);
+      return;
+    }
+
+    id = keys.intern(key);
+    stats.push_back(RunningStats());
+  }
+
+  stats[id].add(vals, n);
+}
+
+/**
+ * Get the statistics of a key
+ *
+ * @param key   The key
+ * @return  The statistics (NULL if no values of the key were seen)
+ */
+const RunningStats* StreamStats::find(const string& key) const
+{
+  int id = keys.find(key);
+  return (id == KeyDictionary::NO_KEY) ? NULL : &stats[id];
+}
@@ -0,0 +1,174 @@
+/**
+ * StreamStats.h
+ *
+ * Running statistics fed with values while the output files are parsed
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef STREAMSTATS_H__
+#define STREAMSTATS_H__
+
+#include <string>
+#include <vector>
+
+#include "GridView.h"
+#include "Kernels.h"
+#include "KeyDictionary.h"
+
+/**
+ * Accumulators for one key, filled in a single pass over its values
+ *
+ * NOTE: Values are summed with Kernels the same way AnalyzeData sums a
+ *       full grid, so the results are the same whichever way they arrive.
+ *       The variance is built a chunk of TILE_VALUES values at a time:
+ *       squared deviations are summed from the chunk's own mean, and the
+ *       chunks are merged pairwise (Chan et al.), which loses next to no
+ *       precision, unlike E(x^2) - E(x)^2. Chunks start at fixed positions
+ *       in the sequence of values, so the result does not depend on how
+ *       the values were handed over.
+ */
+struct RunningStats
+{
+  static const size_t NO_CELL = static_cast<size_t>(-1);
+
+  RunningStats();
+  size_t count;
+  double sum;
+  double min, max;          // Smallest and largest value (NaN until a number is seen)
+  size_t minCell, maxCell;  // Index of the first value equal to each (NO_CELL until a number is seen)
+
+  /**
+   * Add the next values
+   *
+   * @param vals  The values
+   * @param n     Number of values
+   */
+  void add(const double* vals, size_t n);
+
+  /**
+   * Statistics over every value seen
+   */
+  double mean() const { return sum / count; }
+  double variance() const;
+  double stddev() const;
+
+private:
+  /**
+   * Moments of a run of values
+   */
+  struct Moments
+  {
+    size_t count;
+    double mean, m2; // Mean and sum of squared deviations from it
+  };
+
+  /**
+   * Merge a whole chunk into the moments
+   *
+   * @param vals  The values
+   * @param n     Number of values
+   */
+  void addChunk(const double* vals, size_t n);
+
+  LaneSums sums;                // Partial sums of every value (sum is their total)
+  std::vector<Moments> merged;  // Runs of whole chunks, largest first (a run is merged with the next one as large)
+  std::vector<double> pending;  // Values of the chunk being filled
+};
+
+/**
+ * Moments of a run of pairs of values, for Pearson's coefficient
+ *
+ * NOTE: Built like the variance of RunningStats: the moments of each chunk
+ *       of TILE_VALUES pairs are taken from the chunk's own means, and the
+ *       chunks are merged (Chan et al.) in order, so no E(xy) - E(x)E(y)
+ *       cancellation creeps in and the result does not depend on how the
+ *       chunks were produced (or by how many threads).
+ */
+struct CoMoments
+{
+  CoMoments();
+  size_t count;
+  double xMean, yMean;
+  double xM2, yM2;  // Sums of squared deviations from the means
+  double c;         // Sum of products of the deviations from the means (co-moment)
+
+  /**
+   * Take the moments of one chunk of pairs
+   *
+   * @param x   The first values
+   * @param y   The second values
+   * @param n   Number of pairs
+   */
+  void set(const double* x, const double* y, size_t n);
+
+  /**
+   * Merge the moments of the run after this one into it
+   *
+   * @param run   The moments of the next run
+   */
+  void merge(const CoMoments& run);
+
+  /**
+   * Merge the moments of consecutive chunks, pairing runs of equal size first
+   *
+   * @param chunks  The moments of each chunk, in order
+   * @return  The moments of every pair
+   */
+  static CoMoments total(const std::vector<CoMoments>& chunks);
+
+  /**
+   * Pearson's coefficient over every pair
+   *
+   * @return  Co-moment / sqrt(product of the sums of squared deviations)
+   */
+  double pearson() const;
+};
+
+class StreamStats
+{
+public:
+  /**
+   * Constructor
+   */
+  StreamStats(){}
+
+  /**
+   * Destructor
+   */
+  virtual ~StreamStats(){}
+
+  /**
+   * Accumulate the values of a key
+   *
+   * @param key     The key
+   * @param prefix  If true, accumulate every key starting with key instead
+   */
+  void watch(const std::string& key, bool prefix=false);
+
+  /**
+   * Add the values of one layer block
+   *
+   * @param key     Key the values were read for (ignored unless watched)
+   * @param vals    The values
+   * @param n       Number of values
+   */
+  void add(const std::string& key, const double* vals, size_t n);
+
+  /**
+   * Get the statistics of a key
+   *
+   * @param key   The key
+   * @return  The statistics (NULL if no values of the key were seen)
+   */
+  const RunningStats* find(const std::string& key) const;
+
+private:
+  KeyDictionary keys;               // Keys values have been seen for
+  std::vector<RunningStats> stats;  // Indexed by key id
+  std::vector<std::string> exact;   // Keys to accumulate
+  std::vector<std::string> prefixes; // Keys to accumulate everything starting with
+  KeyDictionary ignored;            // Keys seen that are not watched
+};
+
+#endif /** STREAMSTATS_H__ */
@@ -0,0 +1,293 @@
+/**
+ * ThreadPool.cpp
+ *
+ * Minimal thread pool (pthreads or Win32 threads)
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+/** Mutex */
+
+Mutex::Mutex()
+{
+#ifdef _WIN32
+  InitializeCriticalSection(&cs);
+#else
+  pthread_mutex_init(&mtx, NULL);
+#endif
+}
+
+Mutex::~Mutex()
+{
+#ifdef _WIN32
+  DeleteCriticalSection(&cs);
+#else
+  pthread_mutex_destroy(&mtx);
+#endif
+}
+
+void Mutex::lock()
+{
+#ifdef _WIN32
+  EnterCriticalSection(&cs);
+#else
+  pthread_mutex_lock(&mtx);
+#endif
+}
+
+void Mutex::unlock()
+{
+#ifdef _WIN32
+  LeaveCriticalSection(&cs);
+#else
+  pthread_mutex_unlock(&mtx);
+#endif
+}
+
+/** Condition */
+
+Condition::Condition()
+{
+#ifdef _WIN32
+  InitializeConditionVariable(&cv);
+#else
+  pthread_cond_init(&cv, NULL);
+#endif
+}
+
+Condition::~Condition()
+{
+#ifndef _WIN32
+  pthread_cond_destroy(&cv);
+#endif
+}
+
+void Condition::wait(Mutex& m)
+{
+#ifdef _WIN32
+  SleepConditionVariableCS(&cv, &m.cs, INFINITE);
+#else
+  pthread_cond_wait(&cv, &m.mtx);
+#endif
+}
+
+void Condition::signal()
+{
+#ifdef _WIN32
+  WakeConditionVariable(&cv);
+#else
+  pthread_cond_signal(&cv);
+#endif
+}
+
+void Condition::broadcast()
+{
+#ifdef _WIN32
+  WakeAllConditionVariable(&cv);
+#else
+  pthread_cond_broadcast(&cv);
+#endif
+}
+
+/** ThreadPool */
+
+/**
+ * Constructor
+ *
+ * @param threads   Number of worker threads (0 = one per hardware thread)
+ */
+ThreadPool::ThreadPool(unsigned threads)
+  : pending(0), stopping(false)
+{
+  if(threads == 0)
+    threads = hardwareThreads();
+
+#ifdef _WIN32
+  InitializeConditionVariable(&hasWork);
+  InitializeConditionVariable(&allDone);
+  for(unsigned i = 0 ; i < threads ; ++i) {
+    HANDLE h = CreateThread(NULL, 0, workerMain, this, 0, NULL);
+    if(h != NULL)
+      workers.push_back(h);
+  }
+#else
+  pthread_cond_init(&hasWork, NULL);
+  pthread_cond_init(&allDone, NULL);
+  for(unsigned i = 0 ; i < threads ; ++i) {
+    pthread_t t;
+    if(pthread_create(&t, NULL, workerMain, this) == 0)
+      workers.push_back(t);
+  }
+#endif
+}
+
+/**
+ * Destructor (waits for outstanding work then joins the workers)
+ */
+ThreadPool::~ThreadPool()
+{
+  wait();
+
+  lock.lock();
+  stopping = true;
+#ifdef _WIN32
+  WakeAllConditionVariable(&hasWork);
+#else
+  pthread_cond_broadcast(&hasWork);
+#endif
+  lock.unlock();
+
+#ifdef _WIN32
+  for(size_t i = 0 ; i < workers.size() ; ++i) {
+    WaitForSingleObject(workers[i], INFINITE);
+    CloseHandle(workers[i]);
+  }
+#else
+  for(size_t i = 0 ; i < workers.size() ; ++i)
+    pthread_join(workers[i], NULL);
+  pthread_cond_destroy(&hasWork);
+  pthread_cond_destroy(&allDone);
+#endif
+}
+
+/**
+ * Queue a task
+ *
+ * NOTE: The pool does not take ownership, the task must outlive wait()
+ *
+ * @param task    Task to run
+ */
+void ThreadPool::submit(Task* task)
+{
+  // No workers (thread creation failed) - just do it here
+  if(workers.empty()) {
+    task->run();
+    return;
+  }
+
+  ScopedLock guard(lock);
+  queue.push_back(task);
+  pending++;
+#ifdef _WIN32
+  WakeConditionVariable(&hasWork);
+#else
+  pthread_cond_signal(&hasWork);
+#endif
+}
+
+/**
+ * Block until every submitted task has finished
+ */
+void ThreadPool::wait()
+{
+  ScopedLock guard(lock);
+  while(pending > 0) {
+#ifdef _WIN32
+    SleepConditionVariableCS(&allDone, &lock.cs, INFINITE);
+#else
+    pthread_cond_wait(&allDone, &lock.mtx);
+#endif
+  }
+}
+
+/**
+ * Run a set of tasks and wait for all of them
+ *
+ * @param tasks   Tasks to run
+ */
+void ThreadPool::run(const vector<Task*>& tasks)
+{
+  vector<Task*>::const_iterator it;
+  for(it = tasks.begin() ; it != tasks.end() ; ++it)
+    submit(*it);
+  wait();
+}
+
+/**
+ * Get the number of hardware threads on this machine
+ *
+ * @return  Number of hardware threads (at least 1)
+ */
+unsigned ThreadPool::hardwareThreads()
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  long n = static_cast<long>(info.dwNumberOfProcessors);
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return (n < 1) ? 1 : static_cast<unsigned>(n);
+}
+
+/**
+ * Resolve a requested thread count
+ *
+ * @param requested   Requested threads (0 = one per hardware thread)
+ * @param work        Number of independent pieces of work available
+ * @return  Number of threads worth starting (at least 1)
+ */
+unsigned ThreadPool::resolve(unsigned requested, size_t work)
+{
+  unsigned threads = (requested == 0) ? hardwareThreads() : requested;
+  if(work < threads)
+    threads = static_cast<unsigned>(work);
+  return (threads < 1) ? 1 : threads;
+}
+
+/**
+ * Worker loop
+ */
+void ThreadPool::work()
+{
+  lock.lock();
+  for(;;) {
+    while(queue.empty() && !stopping) {
+#ifdef _WIN32
+      SleepConditionVariableCS(&hasWork, &lock.cs, INFINITE);
+#else
+      pthread_cond_wait(&hasWork, &lock.mtx);
+#endif
+    }
+    if(queue.empty())
+      break; // Stopping and nothing left to do
+
+    Task* task = queue.front();
+    queue.pop_front();
+    lock.unlock();
+
+    task->run();
+
+    lock.lock();
+    if(--pending == 0) {
+#ifdef _WIN32
+      WakeAllConditionVariable(&allDone);
+#else
+      pthread_cond_broadcast(&allDone);
+#endif
+    }
+  }
+  lock.unlock();
+}
+
+#ifdef _WIN32
+DWORD WINAPI ThreadPool::workerMain(LPVOID arg)
+{
+  static_cast<ThreadPool*>(arg)->work();
+  return 0;
+}
+#else
+void* ThreadPool::workerMain(void* arg)
+{
+  static_cast<ThreadPool*>(arg)->work();
+  return NULL;
+}
+#endif
@@ -0,0 +1,197 @@
+/**
+ * ThreadPool.h
+ *
+ * Minimal thread pool (pthreads or Win32 threads)
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef THREADPOOL_H__
+#define THREADPOOL_H__
+
+#include <deque>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/**
+ * A unit of work to hand to the pool
+ */
+class Task
+{
+public:
+  virtual ~Task(){}
+
+  /**
+   * Do the work (called on a pool thread)
+   */
+  virtual void run() = 0;
+};
+
+/**
+ * Simple mutual exclusion lock
+ */
+class Mutex
+{
+public:
+  Mutex();
+  virtual ~Mutex();
+  void lock();
+  void unlock();
+
+private:
+  friend class ThreadPool;
+  friend class Condition;
+  Mutex(const Mutex&);
+  Mutex& operator=(const Mutex&);
+
+#ifdef _WIN32
+  CRITICAL_SECTION cs;
+#else
+  pthread_mutex_t mtx;
+#endif
+};
+
+/**
+ * Holds a mutex for the lifetime of the object
+ */
+class ScopedLock
+{
+public:
+  ScopedLock(Mutex& m) : m(m) { m.lock(); }
+  ~ScopedLock() { m.unlock(); }
+
+private:
+  ScopedLock(const ScopedLock&);
+  ScopedLock& operator=(const ScopedLock&);
+  Mutex& m;
+};
+
+/**
+ * Condition variable, waited on while holding a Mutex
+ */
+class Condition
+{
+public:
+  Condition();
+  virtual ~Condition();
+
+  /**
+   * Release the mutex until woken, then take it back
+   *
+   * NOTE: May wake spuriously, so wait in a loop checking what was waited for
+   *
+   * @param m   The mutex (must be locked)
+   */
+  void wait(Mutex& m);
+
+  /**
+   * Wake one waiting thread
+   */
+  void signal();
+
+  /**
+   * Wake every waiting thread
+   */
+  void broadcast();
+
+private:
+  Condition(const Condition&);
+  Condition& operator=(const Condition&);
+
+#ifdef _WIN32
+  CONDITION_VARIABLE cv;
+#else
+  pthread_cond_t cv;
+#endif
+};
+
+class ThreadPool
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param threads   Number of worker threads (0 = one per hardware thread)
+   */
+  ThreadPool(unsigned threads=0);
+
+  /**
+   * Destructor (waits for outstanding work then joins the workers)
+   */
+  virtual ~ThreadPool();
+
+  /**
+   * Queue a task
+   *
+   * NOTE: The pool does not take ownership, the task must outlive wait()
+   *
+   * @param task    Task to run
+   */
+  void submit(Task* task);
+
+  /**
+   * Block until every submitted task has finished
+   */
+  void wait();
+
+  /**
+   * Run a set of tasks and wait for all of them
+   *
+   * @param tasks   Tasks to run
+   */
+  void run(const std::vector<Task*>& tasks);
+
+  /**
+   * Get the number of worker threads
+   *
+   * @return  Number of workers
+   */
+  unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+  /**
+   * Get the number of hardware threads on this machine
+   *
+   * @return  Number of hardware threads (at least 1)
+   */
+  static unsigned hardwareThreads();
+
+  /**
+   * Resolve a requested thread count
+   *
+   * @param requested   Requested threads (0 = one per hardware thread)
+   * @param work        Number of independent pieces of work available
+   * @return  Number of threads worth starting (at least 1)
+   */
+  static unsigned resolve(unsigned requested, size_t work);
+
+private:
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  /**
+   * Worker loop
+   */
+  void work();
+
+#ifdef _WIN32
+  static DWORD WINAPI workerMain(LPVOID arg);
+  std::vector<HANDLE> workers;
+  CONDITION_VARIABLE hasWork, allDone;
+#else
+  static void* workerMain(void* arg);
+  std::vector<pthread_t> workers;
+  pthread_cond_t hasWork, allDone;
+#endif
+
+  Mutex lock;
+  std::deque<Task*> queue;
+  unsigned pending; // Tasks queued or running
+  bool stopping;
+};
+
+#endif /** THREADPOOL_H__ */
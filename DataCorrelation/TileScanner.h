@@ -0,0 +1,70 @@
+/**
+ * TileScanner.h
+ *
+ * Walks the values of a key one tile at a time (see ParserBase::getTile())
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef TILESCANNER_H__
+#define TILESCANNER_H__
+
+#include "GridView.h"
+#include "ParserBase.h"
+
+class TileScanner
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param parser  Parser holding the values
+   * @param id      Id of the key to scan
+   */
+  TileScanner(const ParserBase& parser, int id)
+    : parser(parser), id(id), tile(0)
+  {
+  }
+
+  /**
+   * Destructor
+   */
+  virtual ~TileScanner(){}
+
+  /**
+   * Move on to the next tile
+   *
+   * NOTE: The view is only valid until the next call
+   *
+   * @param values  Receives the tile's values
+   * @return  True if there was another tile, false once every value has been seen
+   */
+  bool next(GridView& values)
+  {
+    values = parser.getTile(id, tile++, buffer);
+    return !values.empty();
+  }
+
+  /**
+   * Move on to the next tile, leaving it sparse if it is stored that way
+   *
+   * NOTE: The tile is only valid until the next call
+   *
+   * @param values  Receives the tile
+   * @return  True if there was another tile, false once every value has been seen
+   */
+  bool next(SparseTile& values)
+  {
+    values = parser.getSparseTile(id, tile++, buffer, cells);
+    return values.size > 0;
+  }
+
+private:
+  const ParserBase& parser;
+  int id;
+  size_t tile;
+  double buffer[TILE_VALUES];
+  unsigned short cells[TILE_VALUES];
+};
+
+#endif /** TILESCANNER_H__ */
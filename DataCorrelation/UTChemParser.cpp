@@ -8,60 +8,1056 @@
 
 #define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
 
+#include <algorithm>
 #include <cstring>
 #include <iostream> // For debugging
+#include <map>
+#include <set>
+#include <stdexcept>
 
+#include "BatchReader.h"
+#include "CompressedFile.h"
+#include "DCException.h"
+#include "DCUtil.h"
+#include "GridCache.h"
+#include "MappedFile.h"
+#include "StreamStats.h"
 #include "UTChemParser.h"
+#include "ValueScanner.h"
 
-#define MAX_STRLEN 256
+#define MAX_LINELEN (2 * MAX_STRLEN) // Longest script line we bother to copy
+#define RELEASE_BYTES (8 << 20) // How much of a mapped file to scan between releasing pages
+#define DECODE_RUNS_PER_THREAD 4 // Runs of blocks handed to each thread when decoding a file in parallel
+#define FOLLOW_POLL_MS 250 // How long to wait for more output when following files that did not grow
+#define FOLLOW_CHUNK (64 << 10) // Bytes read at a time from a followed file
 
 using namespace std;
 
+/**
+ * Copy a line into a null terminated buffer of MAX_LINELEN bytes
+ * (truncating if necessary)
+ *
+ * @param dst   Destination buffer
+ * @param line  Start of the line
+ * @param len   Length of the line
+ */
+static void copyLine(char* dst, const char* line, size_t len)
+{
+  if(len > MAX_LINELEN - 1)
+    len = MAX_LINELEN - 1;
+  memcpy(dst, line, len);
+  dst[len] = '\0';
+}
+
+/**
+ * Check whether a line contains a token
+ *
+ * @param line    Start of the line
+ * @param len     Length of the line
+ * @param token   (Null terminated) token to look for
+ * @return  True if the token appears in the line, false otherwise
+ */
+static bool hasToken(const char* line, size_t len, const char* token)
+{
+  size_t tlen = strlen(token);
+  for(size_t i = 0 ; i + tlen <= len ; ++i) {
+    if(line[i] == token[0] && memcmp(line + i, token, tlen) == 0)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Add a TIME value to the list of those seen (unless it is the last one again)
+ *
+ * @param times   TIME values seen so far
+ * @param time    The TIME value (ignored if empty)
+ */
+static void noteTime(vector<string>& times, const string& time)
+{
+  if(!time.empty() && (times.empty() || times.back() != time))
+    times.push_back(time);
+}
+
+/**
+ * Parses one file on a pool thread
+ */
+class ParseFileTask : public Task
+{
+public:
+  ParseFileTask(const UTChemParser& parser, const string& path, BatchReader* reader, size_t index)
+    : parser(parser), path(path), reader(reader), index(index), opened(true), success(false)
+  {
+  }
+
+  virtual void run()
+  {
+    success = parser.parseFile(path, state, opened, NULL, reader, index);
+  }
+
+  const UTChemParser& parser;
+  string path;
+  BatchReader* reader;
+  size_t index;
+  UTChemParser::ParseState state;
+  bool opened, success;
+};
+
+/**
+ * Decodes a run of indexed blocks on a pool thread
+ */
+class DecodeBlocksTask : public Task
+{
+public:
+  DecodeBlocksTask(const UTChemParser& parser, const vector<const UTChemParser::BlockRef*>& refs,
+                   const vector<vector<double>*>& out, size_t first, size_t last)
+    : parser(parser), refs(refs), out(out), first(first), last(last), success(true)
+  {
+  }
+
+  virtual void run()
+  {
+    for(size_t i = first ; i < last && success ; ++i)
+      success = parser.decodeBlock(*refs[i], *out[i]);
+  }
+
+  const UTChemParser& parser;
+  const vector<const UTChemParser::BlockRef*>& refs;
+  const vector<vector<double>*>& out;
+  size_t first, last;
+  bool success;
+};
+
+/**
+ * Decodes every block of one key on a pool thread
+ */
+class LoadKeyTask : public Task
+{
+public:
+  LoadKeyTask(const UTChemParser& parser, const vector<UTChemParser::BlockRef>& refs, UTChemParser::Grid& grid)
+    : parser(parser), refs(refs), grid(grid), success(false)
+  {
+  }
+
+  virtual void run()
+  {
+    success = parser.decodeKey(refs, grid);
+  }
+
+  const UTChemParser& parser;
+  const vector<UTChemParser::BlockRef>& refs;
+  UTChemParser::Grid& grid;
+  bool success;
+};
+
+/**
+ * Destructor
+ */
+UTChemParser::~UTChemParser()
+{
+  vector<MappedFile*>::iterator it;
+  for(it = mappings.begin() ; it != mappings.end() ; ++it)
+    delete *it;
+  delete cache;
+}
+
 /**
  * Read file
  *
  * Reads the parser's files
  *
- * @return true if successful, false otherwise
+ * @return true if successful, false otherwise
+ */
+bool UTChemParser::readFile()
+{
+  // Outputs archived after the run are read compressed (e.g. X.VISC.gz for X.VISC)
+  bool compressed = false;
+  if(follow == NULL) {
+    for(size_t i = 0 ; i < files.size() ; ++i) {
+      files[i] = CompressedFile::locate(files[i]);
+      compressed |= (CompressedFile::formatOf(files[i]) != CompressedFile::NONE);
+    }
+  }
+
+  // Streamed values are never kept, so there is nothing to cache or decode later
+  bool useCache = options.cache && stream == NULL;
+  if(stream != NULL || follow != NULL || compressed)
+    options.lazy = false; // Followed files are read as they grow and compressed ones can't be mapped
+
+  // A cache of files still being written would be stale
+  if(useCache && follow == NULL && loadCache())
+    return true;
+
+  bool success = (follow != NULL) ? followFiles() : parseFiles();
+
+  // Packed grids only grow a block at a time, so give back what they over-reserved
+  if(packs()) {
+    deque<Grid>::iterator it;
+    for(it = grids.begin() ; it != grids.end() ; ++it) {
+      it->packed.compact();
+      map<size_t, vector<double> >().swap(it->recent);
+    }
+  }
+
+  // Lazily loaded keys have not been decoded yet, and packed keys would have
+  // to be unpacked, so there is nothing to write
+  if(success && useCache && !options.lazy && !packs()) {
+    if(!saveCache())
+      cerr<< "Could not write grid cache: " << GridCache::pathFor(files) << endl;
+  }
+
+  return success;
+}
+
+/**
+ * Use the grid cache of the files if it is still valid
+ *
+ * @return  True if the grids were loaded from the cache, false otherwise
+ */
+bool UTChemParser::loadCache()
+{
+  GridCache* found = new GridCache;
+  if(!found->open(files)) {
+    delete found;
+    return false;
+  }
+
+  delete cache;
+  cache = found;
+
+  nx = cache->getNX();
+  ny = cache->getNY();
+  layers = cache->getNZ();
+  times = cache->getTimes();
+  timestr = times.empty() ? string() : times.back();
+
+  // Serve the values straight out of the mapped cache
+  const vector<CachedGrid>& cached = cache->getGrids();
+  vector<int> ids(cached.size());
+  for(size_t i = 0 ; i < cached.size() ; ++i) {
+    ids[i] = addKey(cached[i].key);
+    Grid& grid = grids[ids[i]];
+
+    if(cached[i].base >= 0) {
+      // Bases always come before their snapshots
+      grid.base = ids[cached[i].base];
+      grid.time = cached[i].time;
+      grid.blocks = cached[i].blocks;
+      for(size_t j = 1 ; j < grid.blocks.size() ; ++j)
+        grid.contiguous &= (grid.blocks[j - 1] + 1 == grid.blocks[j]);
+      grids[grid.base].snapshots.push_back(ids[i]);
+      continue;
+    }
+
+    grid.offsets = cached[i].offsets;
+    grid.cached = cached[i].values;
+  }
+
+  return true;
+}
+
+/**
+ * Write the grid cache of the files
+ *
+ * @return  True if written, false otherwise
+ */
+bool UTChemParser::saveCache() const
+{
+  vector<CachedGrid> cached(grids.size());
+
+  for(size_t id = 0 ; id < grids.size() ; ++id) {
+    const Grid& grid = grids[id];
+    cached[id].key = keys.name(static_cast<int>(id));
+    if(grid.base != KeyDictionary::NO_KEY) {
+      cached[id].base = grid.base;
+      cached[id].time = grid.time;
+      cached[id].blocks = grid.blocks;
+    } else {
+      cached[id].offsets = grid.offsets;
+      cached[id].values = grid.all();
+    }
+  }
+
+  return GridCache::write(files, nx, ny, layers, times, cached);
+}
+
+/**
+ * Parse every file (or index it when loading lazily)
+ *
+ * @return true if successful, false otherwise
+ */
+bool UTChemParser::parseFiles()
+{
+  vector<string>::const_iterator it;
+  bool success = true;
+  unsigned workers = (options.threads == 0) ? ThreadPool::hardwareThreads() : options.threads;
+
+  if(options.lazy)
+    return indexFiles();
+
+  // Read the plain files ahead of the parser in large batched reads
+  BatchReader* reader = NULL;
+  if(options.batch && !options.mmap) {
+    reader = new BatchReader(files);
+    for(size_t i = 0 ; i < files.size() ; ++i) {
+      if(CompressedFile::formatOf(files[i]) != CompressedFile::NONE)
+        reader->close(i);
+    }
+    reader->start();
+  }
+
+  if(workers <= 1 || (options.mmap && files.size() < workers) || stream != NULL) {
+    // One file at a time, storing each before reading the next. If there are
+    // more threads than files, split each mapped file by blocks instead.
+    // Streamed values are accumulated in the order they are read, so one
+    // file and one block at a time.
+    ThreadPool* pool = (workers > 1 && stream == NULL) ? new ThreadPool(workers) : NULL;
+
+    for(it = files.begin() ; it != files.end() ; ++it) {
+      ParseState state;
+      bool opened = true;
+
+      bool parsed = parseFile(*it, state, opened, pool, reader, it - files.begin());
+      if(!opened) {
+        success = false;
+        break;
+      }
+
+      mergeBlocks(state);
+      success &= parsed;
+    }
+
+    delete pool;
+    delete reader;
+    return success;
+  }
+
+  // Parse every file concurrently into its own list of blocks...
+  vector<ParseFileTask*> tasks;
+  vector<Task*> work;
+  for(it = files.begin() ; it != files.end() ; ++it) {
+    tasks.push_back(new ParseFileTask(*this, *it, reader, it - files.begin()));
+    work.push_back(tasks.back());
+  }
+
+  ThreadPool pool(ThreadPool::resolve(workers, files.size()));
+  pool.run(work);
+
+  // ...then store them in file order so keys come out exactly as above
+  for(size_t i = 0 ; i < tasks.size() ; ++i) {
+    if(!tasks[i]->opened) {
+      success = false;
+      break;
+    }
+    mergeBlocks(tasks[i]->state);
+    success &= tasks[i]->success;
+  }
+
+  for(size_t i = 0 ; i < tasks.size() ; ++i)
+    delete tasks[i];
+  delete reader;
+
+  return success;
+}
+
+/**
+ * Parse the files while they are still being written
+ *
+ * Each file is polled for what has been appended since the last look and
+ * every completed line is parsed straight away, so once the writer is done
+ * only its last lines are left. The blocks are then stored in file order,
+ * exactly as parseFiles() does. Each block is also handed to
+ * OutputStatus::blockRead() as soon as it is finished.
+ *
+ * @return true if successful, false otherwise
+ */
+bool UTChemParser::followFiles()
+{
+  vector<ParseState> states(files.size());
+  vector<FollowedFile> followed(files.size());
+
+  bool complete = false;
+  while(!complete) {
+    // Checked before reading so the last pass sees everything that was written
+    complete = follow->isComplete();
+
+    bool grew = false;
+    for(size_t i = 0 ; i < files.size() ; ++i) {
+      grew |= followFile(files[i], followed[i], states[i]);
+
+      // Hand over every block finished since the last look
+      const vector<ParsedBlock>& blocks = states[i].blocks;
+      for( ; followed[i].reported < blocks.size() ; ++followed[i].reported) {
+        const ParsedBlock& block = blocks[followed[i].reported];
+        follow->blockRead(block.key, block.time, states[i].nz,
+          block.vals.empty() ? NULL : &block.vals[0], block.vals.size());
+      }
+    }
+
+    if(!complete && !grew)
+      DCUtil::sleepMillis(FOLLOW_POLL_MS);
+  }
+
+  // Files a stopped writer never got to are left out rather than failing
+  bool stopped = follow->wasStopped();
+  bool success = true;
+  for(size_t i = 0 ; i < files.size() ; ++i) {
+    if(!followed[i].opened) {
+      if(stopped)
+        continue;
+      success = false;
+      break;
+    }
+
+    // A stopped writer may have been cut off part way through the last
+    // line or block, so only what was finished is kept
+    if(stopped) {
+      followed[i].pending.clear();
+      if(states[i].filled() != states[i].expected)
+        states[i].vals.clear();
+      if(states[i].stage != BODY) {
+        mergeBlocks(states[i]);
+        continue;
+      }
+    }
+
+    // The last line need not end with a newline
+    bool parsed = !followed[i].failed;
+    if(parsed && !followed[i].pending.empty())
+      parsed = parseLine(states[i], followed[i].pending.c_str(), followed[i].pending.size());
+    parsed = parsed && finishParse(states[i]);
+
+    mergeBlocks(states[i]);
+    success &= parsed;
+  }
+
+  return success;
+}
+
+/**
+ * Parse the lines appended to a file since it was last looked at
+ *
+ * @param path      Path of the file
+ * @param followed  Where the file was left off
+ * @param state     Parse state for the file
+ * @return  True if anything new was read
+ */
+bool UTChemParser::followFile(const string& path, FollowedFile& followed, ParseState& state) const
+{
+  if(followed.failed)
+    return false;
+
+  // Opened again each time since the writer may not have created it yet
+  ifstream file(path.c_str(), ios::in | ios::binary);
+  if(!file.is_open())
+    return false;
+  followed.opened = true;
+  file.seekg(followed.offset);
+
+  bool grew = false;
+  char chunk[FOLLOW_CHUNK];
+  while(file.read(chunk, sizeof(chunk)) || file.gcount() > 0) {
+    size_t got = static_cast<size_t>(file.gcount());
+    followed.offset += got;
+    followed.pending.append(chunk, got);
+    grew = true;
+
+    // Parse every line that has been finished, keeping the rest for later
+    size_t begin = 0, eol;
+    while((eol = followed.pending.find('\n', begin)) != string::npos) {
+      if(!parseLine(state, followed.pending.data() + begin, eol - begin)) {
+        followed.failed = true;
+        return true;
+      }
+      begin = eol + 1;
+    }
+    followed.pending.erase(0, begin);
+  }
+
+  return grew;
+}
+
+/**
+ * Index the files without converting any values (lazy loading)
+ *
+ * The files stay mapped so that each key can be decoded the first time
+ * it is asked for. Errors in the values themselves are only found then.
+ *
+ * @return true if successful, false otherwise
+ */
+bool UTChemParser::indexFiles()
+{
+  vector<string>::const_iterator it;
+  bool success = true;
+
+  for(it = files.begin() ; it != files.end() ; ++it) {
+    MappedFile* file = new MappedFile;
+    if(!file->open(*it)) {
+      delete file;
+      return false;
+    }
+    mappings.push_back(file);
+
+    ParseState state;
+    state.indexOnly = true;
+    bool parsed = scanMapped(*file, state);
+    mergeBlocks(state);
+    success &= parsed;
+
+    // Nothing has been decoded yet, so drop the pages until a key needs them
+    file->release(file->data(), file->data() + file->size());
+  }
+
+  return success;
+}
+
+/**
+ * Decode a key that has not been used yet (lazy loading)
+ *
+ * @param id    Id of the key about to be used
+ */
+void UTChemParser::load(int id) const
+{
+  if(!options.lazy)
+    return;
+
+  ScopedLock guard(loadLock);
+
+  vector<BlockRef>& blocks = unloaded[id];
+  if(blocks.empty())
+    return; // Already decoded
+
+  if(!decodeKey(blocks, grids[id]))
+    throw DCException("Could not parse the values of " + keys.name(id));
+  vector<BlockRef>().swap(blocks);
+}
+
+/**
+ * Get the id of a key, adding an empty grid for it if it is new
+ *
+ * @param key   The key
+ * @return  Id of the key
+ */
+int UTChemParser::addKey(const string& key)
+{
+  int id = keys.intern(key);
+  if(static_cast<size_t>(id) == grids.size()) {
+    grids.push_back(Grid());
+    grids.back().single = storedSingle(key);
+    unloaded.push_back(vector<BlockRef>());
+  }
+  return id;
+}
+
+/**
+ * Check if a key is to be stored in single precision
+ *
+ * @param key   The key
+ * @return  True if so (see ParserOptions::singleKeys)
+ */
+bool UTChemParser::storedSingle(const string& key) const
+{
+  if(options.single)
+    return true;
+
+  map<string, bool>::const_iterator it;
+  for(it = options.singleKeys.begin() ; it != options.singleKeys.end() ; ++it) {
+    if(key.compare(it->first) == 0 || (it->second && DCUtil::startsWith(key, it->first)))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Pack a layer block onto the end of a grid (in single precision if the
+ * grid is stored that way, packing tiles losslessly instead when compressing
+ * and that is smaller, tiles with few nonzero values sparse, and tiles of
+ * snapshots as changes from the previous TIME when that is smaller)
+ *
+ * @param grid    The grid
+ * @param vals    The values
+ */
+void UTChemParser::packBlock(Grid& grid, const vector<double>& vals) const
+{
+  size_t block = grid.offsets.size();
+  grid.offsets.push_back(grid.packed.size());
+  if(vals.empty() || (!grid.single && options.sparse <= 0.0 && !options.delta)) {
+    grid.packed.append(vals.empty() ? NULL : &vals[0], vals.size());
+    return;
+  }
+
+  PackMode mode;
+  mode.lossless = options.compress || (options.delta && !grid.single);
+  mode.single = grid.single;
+  mode.sparse = options.sparse;
+
+  // Only the values of a block at the previous TIME are kept, until its next TIME is packed
+  bool timed = options.delta && !grid.single && block < grid.earlier.size();
+  size_t earlier = timed ? grid.earlier[block] : PackedGrid::NO_BLOCK;
+  map<size_t, vector<double> >::iterator before = grid.recent.find(earlier);
+  const double* previous = (before != grid.recent.end() && before->second.size() == vals.size()) ? &before->second[0] : NULL;
+  grid.packed.append(&vals[0], vals.size(), mode, grid.absError, grid.relError, earlier, previous);
+  if(before != grid.recent.end())
+    grid.recent.erase(before);
+  if(timed)
+    grid.recent[block] = vals;
+}
+
+/**
+ * Record that a block of a property was read at a TIME
+ *
+ * NOTE: The block's TIME is always the last one noted in times
+ *
+ * @param keyTime   The time-decorated key
+ * @param base      Id of the property
+ * @param block     Index of the block in the property's grid
+ */
+void UTChemParser::addSnapshot(const string& keyTime, int base, size_t block)
+{
+  int id = addKey(keyTime);
+  Grid& snapshot = grids[id];
+
+  if(snapshot.base == KeyDictionary::NO_KEY) {
+    snapshot.base = base;
+    snapshot.time = times.size() - 1;
+    grids[base].snapshots.push_back(id);
+  }
+
+  if(!snapshot.blocks.empty() && snapshot.blocks.back() + 1 != block)
+    snapshot.contiguous = false;
+  snapshot.blocks.push_back(block);
+
+  // The same layer of the snapshot before is what the block is stored as changes from
+  if(options.delta) {
+    Grid& property = grids[base];
+    const vector<int>& shots = property.snapshots;
+    size_t k = find(shots.begin(), shots.end(), id) - shots.begin();
+    size_t layer = snapshot.blocks.size() - 1;
+    if(property.earlier.size() <= block)
+      property.earlier.resize(block + 1, PackedGrid::NO_BLOCK);
+    if(k > 0 && layer < grids[shots[k - 1]].blocks.size())
+      property.earlier[block] = grids[shots[k - 1]].blocks[layer];
+  }
+}
+
+/**
+ * Get the number of layer blocks stored for a key so far
+ *
+ * @param id    Id of the key (must exist)
+ * @return  Number of blocks
+ */
+size_t UTChemParser::blockCount(int id) const
+{
+  return options.lazy ? unloaded[id].size() : grids[id].offsets.size();
+}
+
+/**
+ * Get the grid of a key, checking the id
+ *
+ * @param id    Id of the key
+ * @return  The key's grid
+ */
+const UTChemParser::Grid& UTChemParser::gridOf(int id) const
+{
+  if(id < 0 || static_cast<size_t>(id) >= grids.size())
+    throw out_of_range("UTChemParser: no such key");
+
+  load(id);
+  unpack(id);
+
+  return grids[id];
+}
+
+/**
+ * Unpack the values of a packed grid into its data (once)
+ *
+ * @param id    Id of the key (must exist)
+ */
+void UTChemParser::unpack(int id) const
+{
+  if(!packs())
+    return;
+
+  ScopedLock guard(loadLock);
+
+  Grid& grid = grids[id];
+  if(grid.data.empty() && grid.packed.size() > 0)
+    grid.packed.unpackAll(grid.data);
+}
+
+/**
+ * Convert every block of a key into its grid
+ *
+ * @param refs    The key's blocks
+ * @param grid    Receives the values
+ * @return  True if every block decoded to exactly what was counted, false otherwise.
+ */
+bool UTChemParser::decodeKey(const vector<BlockRef>& refs, Grid& grid) const
+{
+  size_t total = 0;
+  vector<BlockRef>::const_iterator it;
+  for(it = refs.begin() ; it != refs.end() ; ++it)
+    total += it->count;
+
+  grid.data.clear();
+  grid.offsets.clear();
+
+  if(packs(grid)) {
+    // Pack one block at a time so the key is never unpacked as a whole
+    vector<double> vals;
+    grid.packed.clear();
+    for(it = refs.begin() ; it != refs.end() ; ++it) {
+      vals.clear();
+      if(!decodeBlock(*it, vals))
+        return false;
+      packBlock(grid, vals);
+    }
+    grid.packed.compact();
+    map<size_t, vector<double> >().swap(grid.recent);
+    return true;
+  }
+
+  grid.data.reserve(total);
+
+  for(it = refs.begin() ; it != refs.end() ; ++it) {
+    grid.offsets.push_back(grid.data.size());
+    if(!decodeBlock(*it, grid.data))
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * Get the range of values of one layer of a grid
+ *
+ * @param grid    The grid
+ * @param layer   Index of the layer (must exist)
+ * @return  View of the layer
+ */
+GridView UTChemParser::layerOf(const Grid& grid, size_t layer)
+{
+  GridView all(grid.all());
+  size_t begin = grid.offsets[layer];
+  size_t end = (layer + 1 < grid.offsets.size()) ? grid.offsets[layer + 1] : all.size();
+  if(begin >= end)
+    return GridView();
+  return GridView(all.data() + begin, end - begin);
+}
+
+/**
+ * Return values for a particular index
+ *
+ * NOTE: The layer is copied out of the key's grid the first time it is asked
+ *       for, prefer getLayerView()
+ *
+ * @param key     The key of the value to be found
+ * @param layer   The layer to inspect
+ * @return A vector containing the corresponding values
+ */
+const vector<double>& UTChemParser::getValues(const string& key, int layer) const
+{
+  int id = keys.find(key);
+  GridView view(getLayerView(id, layer));
+
+  // If cannot find the vector, then return the sentinel
+  if(view.empty())
+    return sentinel;
+
+  ScopedLock guard(loadLock);
+
+  if(layerCopies.size() <= static_cast<size_t>(id))
+    layerCopies.resize(id + 1);
+  vector<vector<double> >& copies = layerCopies[id];
+  size_t checkLayer = (layer - 1 < 0) ? 0 : layer - 1;
+  if(copies.size() <= checkLayer)
+    copies.resize(checkLayer + 1);
+  if(copies[checkLayer].empty())
+    copies[checkLayer].assign(view.begin(), view.end());
+
+  return copies[checkLayer];
+}
+
+/**
+ * Get a read-only view of all values of a key (every layer, in order)
+ *
+ * @param key   The key to find all valid values for
+ * @return  A view of the key's grid. If none exist, then the view is empty.
+ */
+GridView UTChemParser::getView(const string& key) const
+{
+  return getView(keys.find(key));
+}
+
+/**
+ * Get a read-only view of the values of a key in one layer
+ *
+ * @param key     The key of the value to be found
+ * @param layer   The layer to inspect
+ * @return  A view of the layer. If none exist, then the view is empty.
+ */
+GridView UTChemParser::getLayerView(const string& key, int layer) const
+{
+  return getLayerView(keys.find(key), layer);
+}
+
+/**
+ * Get the id of a key
+ *
+ * @param key   The key
+ * @return  Id of the key (KeyDictionary::NO_KEY if it was not parsed)
+ */
+int UTChemParser::getKeyId(const string& key) const
+{
+  return keys.find(key);
+}
+
+/**
+ * Get a read-only view of all values of a key by its id
+ *
+ * @param id    Id of the key
+ * @return  A view of the key's grid. If none exist, then the view is empty.
+ */
+GridView UTChemParser::getView(int id) const
+{
+  gridOf(id); // Checks the id and decodes the key if need be
+
+  return viewOf(id);
+}
+
+/**
+ * Get every value of a key (a snapshot's values are gathered from its property)
+ *
+ * @param id    Id of the key (must exist)
+ * @return  View of the key's values
+ */
+GridView UTChemParser::viewOf(int id) const
+{
+  const Grid& grid = grids[id];
+  if(grid.base == KeyDictionary::NO_KEY || grid.blocks.empty())
+    return grid.all();
+
+  // A packed property is never unpacked as a whole for one of its
+  // snapshots: only the snapshot's own tiles go into a grid of its own
+  load(grid.base);
+  if(grids[grid.base].packed.size() > 0) {
+    ScopedLock guard(loadLock);
+    Grid& gathered = grids[id];
+    if(gathered.offsets.empty()) {
+      const PackedGrid& packed = grids[grid.base].packed;
+      size_t total = 0;
+      vector<size_t>::const_iterator it;
+      for(it = grid.blocks.begin() ; it != grid.blocks.end() ; ++it) {
+        for(size_t t = packed.firstTile(*it) ; t < packed.firstTile(*it + 1) ; ++t)
+          total += packed.tileSize(t);
+      }
+      gathered.data.resize(total);
+      size_t at = 0;
+      for(it = grid.blocks.begin() ; it != grid.blocks.end() ; ++it) {
+        gathered.offsets.push_back(at);
+        for(size_t t = packed.firstTile(*it) ; t < packed.firstTile(*it + 1) ; ++t)
+          at += packed.unpack(t, &gathered.data[at]);
+      }
+    }
+    return gathered.all();
+  }
+
+  const Grid& base = gridOf(grid.base);
+  if(grid.contiguous) {
+    // Usual case: every layer of the snapshot was read in one go
+    GridView all(base.all());
+    size_t last = grid.blocks.back();
+    size_t begin = base.offsets[grid.blocks.front()];
+    size_t end = (last + 1 < base.offsets.size()) ? base.offsets[last + 1] : all.size();
+    if(begin >= end)
+      return GridView();
+    return GridView(all.data() + begin, end - begin);
+  }
+
+  // The snapshot was split up (i.e. carried into a later file), so gather
+  // the blocks once into a grid of its own
+  ScopedLock guard(loadLock);
+  Grid& gathered = grids[id];
+  if(gathered.offsets.empty()) {
+    vector<size_t>::const_iterator it;
+    for(it = grid.blocks.begin() ; it != grid.blocks.end() ; ++it) {
+      GridView layer(layerOf(base, *it));
+      gathered.offsets.push_back(gathered.data.size());
+      gathered.data.insert(gathered.data.end(), layer.begin(), layer.end());
+    }
+  }
+  return gathered.all();
+}
+
+/**
+ * Get a read-only view of the values of a key in one layer by its id
+ *
+ * @param id      Id of the key
+ * @param layer   The layer to inspect
+ * @return  A view of the layer. If none exist, then the view is empty.
+ */
+GridView UTChemParser::getLayerView(int id, int layer) const
+{
+  const Grid& grid = gridOf(id);
+
+  // A snapshot's layers are straight out of its property's grid
+  if(grid.base != KeyDictionary::NO_KEY) {
+    if(grid.blocks.empty())
+      return GridView();
+
+    int checkLayer = (layer - 1 < 0) ? 0 : layer - 1;
+    if(static_cast<size_t>(checkLayer) >= grid.blocks.size())
+      throw out_of_range("UTChemParser::getLayerView");
+
+    // Layers of a packed property come out of the snapshot's own tiles
+    viewOf(id);
+    if(!grid.offsets.empty())
+      return layerOf(grid, checkLayer);
+
+    return layerOf(gridOf(grid.base), grid.blocks[checkLayer]);
+  }
+
+  if(grid.offsets.empty())
+    return GridView();
+
+  int checkLayer = (layer - 1 < 0) ? 0 : layer - 1;
+  if(static_cast<size_t>(checkLayer) >= grid.offsets.size())
+    throw out_of_range("UTChemParser::getLayerView");
+
+  return layerOf(grid, checkLayer);
+}
+
+/**
+ * Get one tile of the values of a key
+ *
+ * NOTE: Packed grids are unpacked into the buffer one tile at a time,
+ *       other grids are handed out in TILE_VALUES slices without copying
+ *
+ * @param id      Id of the key
+ * @param tile    Index of the tile
+ * @param buffer  Room for TILE_VALUES values, used if the tile has to be unpacked
+ * @return  View of the tile's values (empty past the last tile)
+ */
+GridView UTChemParser::getTile(int id, size_t tile, double* buffer) const
+{
+  size_t index = tile;
+  const PackedGrid* packed = tileOf(id, index);
+  if(packed != NULL)
+    return GridView(buffer, packed->unpack(index, buffer));
+
+  GridView all(getView(id));
+  size_t begin = tile * TILE_VALUES;
+  if(begin >= all.size())
+    return GridView();
+  return GridView(all.data() + begin, min(static_cast<size_t>(TILE_VALUES), all.size() - begin));
+}
+
+/**
+ * Get the number of values in one tile of a key without unpacking it
+ *
+ * @param id      Id of the key
+ * @param tile    Index of the tile
+ * @return  Number of values in the tile (0 past the last tile)
+ */
+size_t UTChemParser::getTileSize(int id, size_t tile) const
+{
+  size_t index = tile;
+  const PackedGrid* packed = tileOf(id, index);
+  if(packed != NULL)
+    return packed->tileSize(index);
+
+  size_t size = getView(id).size();
+  size_t begin = tile * TILE_VALUES;
+  return (begin >= size) ? 0 : min(static_cast<size_t>(TILE_VALUES), size - begin);
+}
+
+/**
+ * Get one tile of the values of a key, without expanding it if it is
+ * stored sparse
+ *
+ * @param id      Id of the key
+ * @param tile    Index of the tile
+ * @param buffer  Room for TILE_VALUES values, used if the tile has to be unpacked
+ * @param cells   Room for TILE_VALUES cells, used if the tile is sparse
+ * @return  The tile (no cells past the last tile)
  */
-bool UTChemParser::readFile()
+SparseTile UTChemParser::getSparseTile(int id, size_t tile, double* buffer, unsigned short* cells) const
 {
-  vector<string>::const_iterator it;
-  bool success = true;
+  size_t index = tile;
+  const PackedGrid* packed = tileOf(id, index);
+  if(packed == NULL || !packed->isSparse(index))
+    return ParserBase::getSparseTile(id, tile, buffer, cells);
 
-  for(it = files.begin() ; it != files.end() ; ++it) {
-    ifstream file(it->c_str());
+  size_t stored;
+  size_t size = packed->unpackSparse(index, buffer, cells, stored);
+  return SparseTile(GridView(buffer, stored), cells, size);
+}
 
-    if(!file.is_open())
-      return false;
+/**
+ * Find the packed grid holding a tile of a key
+ *
+ * @param id      Id of the key
+ * @param tile    Index of the tile in the key, changed to its index in the packed grid (past its
+ *                last tile if the key has no such tile)
+ * @return  The packed grid (NULL if the key is not packed)
+ */
+const PackedGrid* UTChemParser::tileOf(int id, size_t& tile) const
+{
+  if(id < 0 || static_cast<size_t>(id) >= grids.size())
+    throw out_of_range("UTChemParser: no such key");
 
-    success &= parseValues(file);
+  const Grid& grid = grids[id];
+  int owner = (grid.base == KeyDictionary::NO_KEY) ? id : grid.base;
+  load(owner);
+  const PackedGrid& packed = grids[owner].packed;
+  if(packed.size() == 0)
+    return NULL;
 
-    file.close();
+  // A snapshot's tiles are those of its blocks in the property's grid
+  if(owner != id) {
+    vector<size_t>::const_iterator it;
+    for(it = grid.blocks.begin() ; it != grid.blocks.end() ; ++it) {
+      size_t first = packed.firstTile(*it);
+      size_t count = packed.firstTile(*it + 1) - first;
+      if(tile < count) {
+        tile += first;
+        return &packed;
+      }
+      tile -= count;
+    }
+    tile = packed.tiles();
   }
 
-  return success;
+  return &packed;
 }
 
 /**
- * Return values for a particular index
+ * Get the snapshots of a property
  *
- * @param key     The key of the value to be found
- * @param layer   The layer to inspect
- * @return A vector containing the corresponding values
+ * @param id    Id of the property (e.g. that of "WATER")
+ * @return  Ids of the property's time-decorated keys (e.g. that of "WATER-1.5000E+02"),
+ *          in the order they were read
  */
-const vector<double>& UTChemParser::getValues(const string& key, int layer) const
+vector<int> UTChemParser::getSnapshots(int id) const
 {
-  const std::vector<std::vector<double> >& container = values.at(key);
+  if(id < 0 || static_cast<size_t>(id) >= grids.size())
+    throw out_of_range("UTChemParser: no such key");
 
-  if(container.empty())
-    return sentinel;
+  return grids[id].snapshots;
+}
 
-  int checkLayer = (layer - 1 < 0) ? 0 : layer - 1;
-  const std::vector<double>& check = container.at(checkLayer);
+/**
+ * Get the TIME of a snapshot
+ *
+ * @param id    Id of a time-decorated key
+ * @return  Index of its TIME value in getTimes() (-1 if the key is not a snapshot)
+ */
+int UTChemParser::getSnapshotTime(int id) const
+{
+  if(id < 0 || static_cast<size_t>(id) >= grids.size() || grids[id].base == KeyDictionary::NO_KEY)
+    return -1;
 
-  // If cannot find the vector, then return the sentinel
-  return (check.empty()) ? sentinel : check;
+  return static_cast<int>(grids[id].time);
 }
 
 /**
@@ -74,152 +1070,563 @@ const vector<double>& UTChemParser::getValues(const string& key, int layer) cons
  */
 std::vector<double> UTChemParser::getAllValues(const std::string& key) const
 {
-  std::vector<double> ret;
-  const std::vector<std::vector<double> >& container = values.at(key);
+  GridView view(getView(key));
+  return vector<double>(view.begin(), view.end());
+}
+
+/**
+ * Parse one file into its list of blocks
+ *
+ * NOTE: This does not touch the parser's members, so several files
+ *       can be parsed at the same time
+ *
+ * @param path    Path of the file to parse
+ * @param state   Receives the parsed blocks
+ * @param opened  Set to false if the file could not be opened
+ * @param pool    If given, the blocks of a mapped file are decoded on this pool
+ * @param reader  If given, plain files are taken from these batched reads
+ * @param index   Index of the file in the reader
+ * @return  True if successfully parsed, false otherwise.
+ */
+bool UTChemParser::parseFile(const string& path, ParseState& state, bool& opened, ThreadPool* pool,
+                             BatchReader* reader, size_t index) const
+{
+  bool success = false;
 
-  if(container.empty())
-    return ret;
+  if(CompressedFile::formatOf(path) != CompressedFile::NONE) {
+    // Never mapped: the values only exist once decompressed
+    CompressedFile file;
 
-  for(size_t i = 0 ; i < container.size() ; ++i) {
-    const std::vector<double>& vec = container.at(i);
-    vector<double>::const_iterator it;
-    for(it = vec.begin() ; it != vec.end() ; ++it) {
-      ret.push_back(*it);
-    }
+    opened = file.open(path);
+    if(!opened)
+      return false;
+
+    success = parseValues(file, state);
+
+    file.close();
+  } else if(reader != NULL) {
+    BatchedFile file(*reader, index);
+
+    opened = reader->isOpen(index);
+    if(!opened)
+      return false;
+
+    success = parseValues(file, state);
+  } else if(options.mmap) {
+    MappedFile file;
+
+    opened = file.open(path);
+    if(!opened)
+      return false;
+
+    success = parseValues(file, state, pool);
+
+    file.close();
+  } else {
+    ifstream file(path.c_str());
+
+    opened = file.is_open();
+    if(!opened)
+      return false;
+
+    success = parseValues(file, state);
+
+    file.close();
   }
 
-  return ret;
+  return success;
 }
 
 /**
  * Parse values and store them properly in the map/vector
  *
  * @param file    The open file stream to parse data
+ * @param state   Receives the parsed blocks
  * @return  True if successfully parsed, false otherwise.
  */
-bool UTChemParser::parseValues(ifstream& file)
+bool UTChemParser::parseValues(ifstream& file, ParseState& state) const
 {
   string line;
-  int currentLayer;
-  vector<double> vals;
-  char buffer[MAX_STRLEN];
-  char bufferTime[MAX_STRLEN];
-  double nextVal;
-  int advance = 0;
-  int phaseno = 0; // Not always applicable
-  
-  memset(bufferTime, 0, MAX_STRLEN);
-
-  for(int i = 0 ; i < 5 ; ++i)
-    getline(file, line); // Skip first 4 lines
-
-  if(3 != sscanf(line.c_str(), " NX = %d NY = %d NZ = %d", &nx, &ny, &layers))
+
+  while(getline(file, line)) {
+    if(!parseLine(state, line.c_str(), line.size()))
+      return false;
+  }
+
+  return finishParse(state);
+}
+
+/**
+ * Parse values out of a file read in chunks (compressed or batched reads)
+ *
+ * Lines are split out of each chunk in place, and only a line running over
+ * the end of a chunk is copied
+ *
+ * @param file    The open file
+ * @param state   Receives the parsed blocks
+ * @return  True if successfully parsed, false otherwise.
+ */
+bool UTChemParser::parseValues(ChunkSource& file, ParseState& state) const
+{
+  string pending; // Start of a line carried over from the last chunk
+  const char* data = NULL;
+  size_t size = 0;
+
+  while(file.next(data, size)) {
+    const char* begin = data;
+    const char* end = data + size;
+    const char* eol;
+    while((eol = static_cast<const char*>(memchr(begin, '\n', end - begin))) != NULL) {
+      bool parsed;
+      if(pending.empty()) {
+        parsed = parseLine(state, begin, eol - begin);
+      } else {
+        pending.append(begin, eol);
+        parsed = parseLine(state, pending.data(), pending.size());
+        pending.clear();
+      }
+      if(!parsed)
+        return false;
+      begin = eol + 1;
+    }
+    pending.append(begin, end);
+  }
+
+  if(file.failed())
     return false;
 
-  int expected = nx * ny; // Expected number of elements to read before next script line
+  // The last line need not end with a newline
+  if(!pending.empty() && !parseLine(state, pending.data(), pending.size()))
+    return false;
+
+  return finishParse(state);
+}
+
+/**
+ * Parse values directly out of a memory mapped file
+ *
+ * With a pool the file is parsed in two passes: the first runs the usual
+ * line by line state machine but only counts the values, recording where
+ * each block's lines are, and the second converts all the blocks in
+ * parallel. Anything unexpected while decoding and the file is simply
+ * parsed again in one pass so errors behave exactly the same.
+ *
+ * @param file    The mapped file to parse data from
+ * @param state   Receives the parsed blocks
+ * @param pool    If given, the blocks are decoded on this pool
+ * @return  True if successfully parsed, false otherwise.
+ */
+bool UTChemParser::parseValues(MappedFile& file, ParseState& state, ThreadPool* pool) const
+{
+  if(pool != NULL && pool->size() > 1) {
+    state.indexOnly = true;
+    if(scanMapped(file, state)) {
+      vector<const BlockRef*> refs;
+      vector<vector<double>*> out;
+      vector<ParsedBlock>::iterator it;
+      for(it = state.blocks.begin() ; it != state.blocks.end() ; ++it) {
+        refs.push_back(&it->ref);
+        out.push_back(&it->vals);
+      }
+      if(decodeBlocks(refs, out, *pool))
+        return true;
+    }
+    state = ParseState();
+  }
+
+  return scanMapped(file, state);
+}
+
+/**
+ * Run every line of a mapped file through parseLine()
+ *
+ * @param file    The mapped file to parse data from
+ * @param state   Parse state for the file
+ * @return  True if successfully parsed, false otherwise.
+ */
+bool UTChemParser::scanMapped(MappedFile& file, ParseState& state) const
+{
+  const char* pos = file.data();
+  const char* end = pos + file.size();
+  const char* released = pos;
+
+  state.eof = end;
+  while(pos < end) {
+    const char* eol = static_cast<const char*>(memchr(pos, '\n', end - pos));
 
-  getline(file, line);
-  
-  // Get time data
-  if(line.find("TIME") != string::npos) {
-    if(timestr == NULL) {
-      timestr = new char[MAX_STRLEN];
+    state.cursor = pos;
+    state.next = (eol == NULL) ? end : eol + 1;
+
+    if(eol == NULL) {
+      // The last line has no newline after it, so the mapping may end right
+      // after its last digit. Copy it out so conversions stop in bounds.
+      string last(pos, end);
+      if(!parseLine(state, last.c_str(), last.size()))
+        return false;
+      break;
     }
-    if(1 != sscanf(line.c_str(), " TIME = %s", timestr)) {
+
+    if(!parseLine(state, pos, eol - pos))
       return false;
+    pos = eol + 1;
+
+    // Give back what we have already scanned so large files do not stay resident
+    // (unless the blocks are about to be decoded)
+    if((!state.indexOnly || options.lazy) && static_cast<size_t>(pos - released) >= RELEASE_BYTES) {
+      file.release(released, pos);
+      released = pos;
     }
-    getline(file, line);
   }
 
-  if(3 != sscanf(line.c_str(), "%[^0-9] %d %*[^0-9] %d", buffer, &phaseno, &currentLayer))
-    if(2 != sscanf(line.c_str(), " %[^0-9] %d", buffer, &currentLayer))
-      return false; // First time
+  return finishParse(state);
+}
+
+/**
+ * Convert the values of indexed blocks in parallel
+ *
+ * @param refs    The blocks to decode
+ * @param out     Where to put the values of each block
+ * @param pool    Pool to decode the blocks on
+ * @return  True if every block decoded to exactly what was counted, false otherwise.
+ */
+bool UTChemParser::decodeBlocks(const vector<const BlockRef*>& refs, const vector<vector<double>*>& out,
+                                ThreadPool& pool) const
+{
+  // A few runs of consecutive blocks per thread evens out the load
+  // without paying for a task per block
+  size_t runs = pool.size() * DECODE_RUNS_PER_THREAD;
+  if(runs > refs.size())
+    runs = refs.size();
 
-  // Append time data if it exists
-  if(timestr != NULL) {
-    memset(bufferTime, 0, MAX_STRLEN);
-    strncpy(bufferTime, buffer, strlen(buffer));
-    strncat(bufferTime, "-", 1);
-    strncat(bufferTime, timestr, MAX_STRLEN - strlen(buffer));
+  vector<DecodeBlocksTask*> tasks;
+  vector<Task*> work;
+  for(size_t i = 0 ; i < runs ; ++i) {
+    size_t first = refs.size() * i / runs;
+    size_t last = refs.size() * (i + 1) / runs;
+    tasks.push_back(new DecodeBlocksTask(*this, refs, out, first, last));
+    work.push_back(tasks.back());
   }
 
-  while(!file.eof()) {
-    getline(file, line);
+  pool.run(work);
 
-    // Time data
-    if(line.find("TIME") != string::npos) {
-      if(timestr == NULL) {
-        timestr = new char[MAX_STRLEN];
-      }
-      if(1 != sscanf(line.c_str(), " TIME = %256s", timestr)) {
+  bool success = true;
+  for(size_t i = 0 ; i < tasks.size() ; ++i) {
+    success &= tasks[i]->success;
+    delete tasks[i];
+  }
+
+  return success;
+}
+
+/**
+ * Convert the values of one indexed block
+ *
+ * NOTE: This repeats the checks parseLine() makes on value lines so that a
+ *       block only decodes if reading it line by line would give the same result
+ *
+ * @param ref     The block to decode
+ * @param vals    The values are appended to this vector
+ * @return  True if the block decoded to exactly what was counted, false otherwise.
+ */
+bool UTChemParser::decodeBlock(const BlockRef& ref, vector<double>& vals) const
+{
+  const char* pos = ref.begin;
+  bool afterTime = false; // A block always starts after its header line
+  size_t start = vals.size();
+
+  vals.reserve(start + ref.count);
+
+  while(pos < ref.end) {
+    const char* eol = static_cast<const char*>(memchr(pos, '\n', ref.end - pos));
+    const char* lend = (eol == NULL) ? ref.end : eol;
+    size_t len = lend - pos;
+
+    if(!afterTime && hasToken(pos, len, "TIME")) {
+      afterTime = true; // Already read in the first pass
+    } else {
+      afterTime = false;
+      if(vals.size() - start == ref.expected && len > 0)
+        return false; // This would have been a header
+
+      if(eol == NULL && lend == ref.eof) {
+        string last(pos, lend); // See scanMapped()
+        if(!ValueScanner::scanLine(last.c_str(), last.c_str() + last.size(), vals))
+          return false;
+      } else if(!ValueScanner::scanLine(pos, lend, vals)) {
         return false;
       }
-      getline(file, line);
     }
-    const char* lptr = line.c_str();
-
-    // Try to match either of the following:
-    // (1) X-PERMEABILITY (MD) IN LAYER           12
-    // (2) POROSITY IN LAYER           12
-    // (3) VISCOSITY (MPA.S) OF PHASE            1  IN LAYER            1
-    // (4) TOTAL FLUID CONC. OF COMP. NO.  1:WATER    IN LAYER   1
-    // (5) SAT. OF PHASE            1  IN LAYER            1
-    // (6) EFFECTIVE SALINITY (MEQ/ML) IN LAYER            1 (refer to other lines in .SALT - should match all)
-    if(vals.size() == static_cast<size_t>(expected) && !line.empty()) {
-      values[buffer].push_back(vals);
-      if(strlen(bufferTime) > 0)
-        values[bufferTime].push_back(vals);
-
-      // Take the first word as the key then ignore everything up to the layer number
-      if(2 == sscanf(lptr, " %256[^(] %*s IN LAYER %d", buffer, &currentLayer) // (6)
-        || sscanf(lptr, " TOTAL FLUID CONC. OF COMP. NO. %*d:%256s IN LAYER %d", buffer, &currentLayer)) { // (4)
-        size_t blen = strlen(buffer) - 1;
-        while(blen >= 0) { // Trim trailing whitespace
-          if(buffer[blen] != ' ' && buffer[blen] != '\t') {
-            buffer[blen + 1] = '\0';
-            break;
-          }
-          blen--;
-        }
-        phaseno = 0;
-      } else if(3 != sscanf(lptr, " %256s %*[^0-9] %d %*[^0-9] %d", buffer, &phaseno, &currentLayer)) { // Try line (3), (5)
-        if(2 != sscanf(lptr, " %256s %*[^0-9] %d", buffer, &currentLayer)) { // This tries for lines (1), (2)
-          return false;
-        }
-      } else {
-        // If we got here phaseno should be part of our buffer
-        char intstr[20]; // Sufficiently large for an int? Sorry about the majik number :x
-        sprintf(intstr, "_%d", phaseno);
-        // Thus, for viscosity, this becomes "VISCOSITY_1" for reference (i.e. viscosity of phase 1)
-        strncat(buffer, intstr, MAX_STRLEN - strlen(buffer));
-      }
 
-      // Append time data if it exists
-      if(timestr != NULL) {
-        memset(bufferTime, 0, MAX_STRLEN);
-        strncpy(bufferTime, buffer, strlen(buffer));
-        strncat(bufferTime, "-", 1);
-        strncat(bufferTime, timestr, MAX_STRLEN - strlen(buffer));
-      }
+    pos = lend + 1;
+  }
 
-      vals.clear();
-    } else { // Read values
-      while(lptr != NULL && *lptr != '\0' && *lptr != '\n' && *lptr != '\r') {
-        while(*lptr == ' ') lptr++; // eat whitespace
-        if(1 != sscanf(lptr, "%lg%n", &nextVal, &advance))
-          return false;
-        lptr += advance;
-        vals.push_back(nextVal);
-      }
+  return vals.size() - start == ref.count;
+}
+
+/**
+ * Parse a single line of an output file
+ *
+ * NOTE: The byte at line[len] must not be part of a number (i.e. a
+ *       newline or the string terminator) since values are converted in place.
+ *
+ * @param state   Parse state for the file being read
+ * @param line    Start of the line (without its newline)
+ * @param len     Length of the line
+ * @return  True if successfully parsed, false otherwise.
+ */
+bool UTChemParser::parseLine(ParseState& state, const char* line, size_t len) const
+{
+  char text[MAX_LINELEN]; // Null terminated copy of a script line for sscanf
+
+  state.lineno++;
+
+  if(state.stage == PREAMBLE) {
+    if(state.lineno < 5)
+      return true; // Skip first 4 lines
+
+    copyLine(text, line, len);
+    if(3 != sscanf(text, " NX = %d NY = %d NZ = %d", &state.nx, &state.ny, &state.nz))
+      return false;
+
+    state.expected = state.nx * state.ny; // Expected number of elements to read before next script line
+    state.stage = FIRST_HEADER;
+    return true;
+  }
+
+  // Get time data (the line following a TIME line is never checked again)
+  if(!state.afterTime && hasToken(line, len, "TIME")) {
+    char timebuf[MAX_LINELEN];
+    copyLine(text, line, len);
+    const char* fmt = (state.stage == FIRST_HEADER) ? " TIME = %s" : " TIME = %256s";
+    if(1 != sscanf(text, fmt, timebuf)) {
+      return false;
     }
+    state.time = timebuf;
+    state.afterTime = true;
+    return true;
+  }
+  state.afterTime = false;
+
+  if(state.stage == FIRST_HEADER) {
+    int phaseno = 0; // Not always applicable
+    int currentLayer = 0;
+
+    copyLine(text, line, len);
+    if(3 != sscanf(text, "%[^0-9] %d %*[^0-9] %d", state.buffer, &phaseno, &currentLayer))
+      if(2 != sscanf(text, " %[^0-9] %d", state.buffer, &currentLayer))
+        return false; // First time
+
+    state.blockTime = state.time;
+    state.blockBegin = state.next;
+    state.stage = BODY;
+    return true;
+  }
+
+  // Try to match either of the following:
+  // (1) X-PERMEABILITY (MD) IN LAYER           12
+  // (2) POROSITY IN LAYER           12
+  // (3) VISCOSITY (MPA.S) OF PHASE            1  IN LAYER            1
+  // (4) TOTAL FLUID CONC. OF COMP. NO.  1:WATER    IN LAYER   1
+  // (5) SAT. OF PHASE            1  IN LAYER            1
+  // (6) EFFECTIVE SALINITY (MEQ/ML) IN LAYER            1 (refer to other lines in .SALT - should match all)
+  if(state.filled() == state.expected && len > 0) {
+    endBlock(state, true);
+
+    copyLine(text, line, len);
+    if(!parseHeader(state, text))
+      return false;
+
+    state.blockTime = state.time;
+    state.blockBegin = state.next;
+    return true;
+  }
+
+  // Read values (or just count them if the blocks are decoded later)
+  if(state.indexOnly) {
+    state.counted += ValueScanner::countTokens(line, line + len);
+    return true;
   }
+  return ValueScanner::scanLine(line, line + len, state.vals);
+}
+
+/**
+ * Flush the last block of a file once all lines have been parsed
+ *
+ * @param state   Parse state for the file being read
+ * @return  True if the file was complete, false otherwise.
+ */
+bool UTChemParser::finishParse(ParseState& state) const
+{
+  if(state.stage != BODY)
+    return false; // Never made it to the first block
+
+  if(state.filled() > 0)
+    endBlock(state, false);
+
+  return true;
+}
+
+/**
+ * Parse a block header line and set the key for the following block
+ *
+ * @param state   Parse state for the file being read
+ * @param lptr    The (null terminated) header line
+ * @return  True if the header was recognized, false otherwise.
+ */
+bool UTChemParser::parseHeader(ParseState& state, const char* lptr) const
+{
+  char* buffer = state.buffer;
+  int phaseno = 0;
+  int currentLayer = 0;
 
-  if(!vals.empty())
-    values[buffer].push_back(vals);
+  // Take the first word as the key then ignore everything up to the layer number
+  if(2 == sscanf(lptr, " %256[^(] %*s IN LAYER %d", buffer, &currentLayer) // (6)
+    || sscanf(lptr, " TOTAL FLUID CONC. OF COMP. NO. %*d:%256s IN LAYER %d", buffer, &currentLayer)) { // (4)
+    size_t blen = strlen(buffer) - 1;
+    while(blen >= 0) { // Trim trailing whitespace
+      if(buffer[blen] != ' ' && buffer[blen] != '\t') {
+        buffer[blen + 1] = '\0';
+        break;
+      }
+      blen--;
+    }
+  } else if(3 != sscanf(lptr, " %256s %*[^0-9] %d %*[^0-9] %d", buffer, &phaseno, &currentLayer)) { // Try line (3), (5)
+    if(2 != sscanf(lptr, " %256s %*[^0-9] %d", buffer, &currentLayer)) { // This tries for lines (1), (2)
+      return false;
+    }
+  } else {
+    // If we got here phaseno should be part of our buffer
+    char intstr[20]; // Sufficiently large for an int? Sorry about the majik number :x
+    sprintf(intstr, "_%d", phaseno);
+    // Thus, for viscosity, this becomes "VISCOSITY_1" for reference (i.e. viscosity of phase 1)
+    strncat(buffer, intstr, MAX_STRLEN - strlen(buffer));
+  }
 
   return true;
 }
 
+/**
+ * Finish the block currently being read
+ *
+ * @param state     Parse state for the file being read
+ * @param withTime  If true, also store the block under its time-decorated key
+ */
+void UTChemParser::endBlock(ParseState& state, bool withTime) const
+{
+  state.blocks.push_back(ParsedBlock());
+  ParsedBlock& block = state.blocks.back();
+  block.key = state.buffer;
+  block.time = state.blockTime;
+  block.withTime = withTime;
+
+  BlockRef& ref = block.ref;
+  if(state.indexOnly) {
+    // Ends just before the header line that closed it (or at the end of the file)
+    ref.begin = state.blockBegin;
+    ref.end = withTime ? state.cursor : state.next;
+    ref.eof = state.eof;
+    ref.count = state.counted;
+    ref.expected = state.expected;
+    state.counted = 0;
+    return;
+  }
+
+  ref.begin = ref.end = ref.eof = NULL;
+  ref.count = ref.expected = 0;
+
+  if(stream != NULL) {
+    // Hand the values over and reuse the buffer for the next block (see mergeBlocks()
+    // for which keys a block is stored under)
+    const string& time = (block.time.empty()) ? timestr : block.time;
+    const double* vals = state.vals.empty() ? NULL : &state.vals[0];
+    if(withTime && !time.empty()) {
+      string keyTime(block.key);
+      keyTime += '-';
+      keyTime.append(time);
+      stream->add(keyTime, vals, state.vals.size());
+    }
+    stream->add(block.key, vals, state.vals.size());
+    state.vals.clear();
+    return;
+  }
+
+  block.vals.swap(state.vals);
+  state.vals.reserve(state.expected);
+}
+
+/**
+ * Store the blocks of a parsed file under their keys (and time keys)
+ *
+ * NOTE: Files must be merged in the order they are listed since a file
+ *       without TIME data takes the last TIME value of the files before it
+ *
+ * @param state   The parsed file
+ */
+void UTChemParser::mergeBlocks(ParseState& state)
+{
+  if(state.stage != PREAMBLE) {
+    nx = state.nx;
+    ny = state.ny;
+    layers = state.nz;
+  }
+
+  // Resolve the keys first so each grid grows once per file
+  vector<pair<int, const ParsedBlock*> > targets;
+  map<int, size_t> added, seen;
+
+  vector<ParsedBlock>::const_iterator it;
+  for(it = state.blocks.begin() ; it != state.blocks.end() ; ++it) {
+    const string& time = (it->time.empty()) ? timestr : it->time;
+    noteTime(times, it->time);
+
+    int id = addKey(it->key);
+    size_t block = blockCount(id) + seen[id]++;
+    targets.push_back(make_pair(id, &*it));
+
+    // The block is also found under its time-decorated key if there is time data
+    if(it->withTime && !time.empty()) {
+      string keyTime(it->key);
+      keyTime += '-';
+      keyTime.append(time);
+      addSnapshot(keyTime, id, block);
+    }
+  }
+
+  // Nothing to copy yet when loading lazily (see decodeKey())
+  vector<pair<int, const ParsedBlock*> >::const_iterator target;
+  if(options.lazy) {
+    for(target = targets.begin() ; target != targets.end() ; ++target)
+      unloaded[target->first].push_back(target->second->ref);
+  } else {
+    // Packed grids take their blocks one at a time, the others are copied as they are
+    for(target = targets.begin() ; target != targets.end() ; ++target) {
+      Grid& grid = grids[target->first];
+      if(packs(grid))
+        packBlock(grid, target->second->vals);
+      else
+        added[target->first] += target->second->vals.size();
+    }
+
+    map<int, size_t>::const_iterator grow;
+    for(grow = added.begin() ; grow != added.end() ; ++grow)
+      grids[grow->first].data.reserve(grids[grow->first].data.size() + grow->second);
+
+    for(target = targets.begin() ; target != targets.end() ; ++target) {
+      Grid& grid = grids[target->first];
+      if(packs(grid))
+        continue;
+      const vector<double>& vals = target->second->vals;
+      grid.offsets.push_back(grid.data.size());
+      grid.data.insert(grid.data.end(), vals.begin(), vals.end());
+    }
+  }
+  state.blocks.clear();
+
+  if(!state.time.empty())
+    timestr = state.time;
+  noteTime(times, state.time);
+}
+
 /**
  * Get keys
  *
@@ -228,16 +1635,125 @@ bool UTChemParser::parseValues(ifstream& file)
 vector<string> UTChemParser::getParsedKeys() const
 {
   vector<string> ret;
+  ret.reserve(keys.size());
 
-  map<string, vector<vector<double> > >::const_iterator it;
+  for(size_t id = 0 ; id < keys.size() ; ++id)
+    ret.push_back(keys.name(static_cast<int>(id)));
 
-  for(it = values.begin() ; it != values.end() ; ++it) {
-    ret.push_back(it->first);
-  }
+  // Ids are in the order keys were first seen, list them alphabetically
+  sort(ret.begin(), ret.end());
 
   return ret;
 }
 
+/**
+ * Decode a set of keys at once (in parallel) when loading lazily
+ *
+ * @param names   The keys that will be used
+ */
+void UTChemParser::preload(const vector<string>& names)
+{
+  if(!options.lazy)
+    return;
+
+  ScopedLock guard(loadLock);
+
+  vector<LoadKeyTask*> tasks;
+  vector<Task*> work;
+  vector<int> loading;
+
+  set<int> wanted; // Each key once
+  vector<string>::const_iterator key;
+  for(key = names.begin() ; key != names.end() ; ++key) {
+    int id = keys.find(*key);
+    if(id == KeyDictionary::NO_KEY)
+      continue;
+    wanted.insert((grids[id].base == KeyDictionary::NO_KEY) ? id : grids[id].base);
+  }
+
+  set<int>::const_iterator it;
+  for(it = wanted.begin() ; it != wanted.end() ; ++it) {
+    if(unloaded[*it].empty())
+      continue;
+
+    tasks.push_back(new LoadKeyTask(*this, unloaded[*it], grids[*it]));
+    work.push_back(tasks.back());
+    loading.push_back(*it);
+  }
+
+  if(tasks.empty())
+    return;
+
+  ThreadPool pool(ThreadPool::resolve(options.threads, tasks.size()));
+  pool.run(work);
+
+  bool success = true;
+  for(size_t i = 0 ; i < tasks.size() ; ++i) {
+    success &= tasks[i]->success;
+    delete tasks[i];
+  }
+
+  if(!success)
+    throw DCException("Could not parse the values of the requested keys");
+
+  for(size_t i = 0 ; i < loading.size() ; ++i)
+    vector<BlockRef>().swap(unloaded[loading[i]]);
+}
+
+/**
+ * Get the memory taken by the values of every grid
+ *
+ * NOTE: Keys that have not been decoded yet (lazy loading) are not counted
+ *
+ * @param values  Receives the size of the values unpacked, in bytes
+ * @param packed  Receives the size of the packed values, in bytes (0 unless compressing)
+ */
+void UTChemParser::getValueBytes(size_t& values, size_t& packed) const
+{
+  values = 0;
+  packed = 0;
+
+  ScopedLock guard(loadLock);
+
+  deque<Grid>::const_iterator it;
+  for(it = grids.begin() ; it != grids.end() ; ++it) {
+    if(it->base != KeyDictionary::NO_KEY)
+      continue; // Values are in the property's grid
+    size_t count = (it->packed.size() > 0) ? it->packed.size() : it->all().size();
+    values += count * sizeof(double);
+    packed += it->packed.bytes();
+  }
+}
+
+/**
+ * Get the largest error made rounding the values of a key to single precision
+ *
+ * @param id        Id of the key (KeyDictionary::NO_KEY for every key)
+ * @param absError  Receives the largest absolute error (0 if not rounded)
+ * @param relError  Receives the largest error relative to the value
+ */
+void UTChemParser::getRoundingError(int id, double& absError, double& relError) const
+{
+  absError = relError = 0.0;
+
+  ScopedLock guard(loadLock);
+
+  if(id != KeyDictionary::NO_KEY) {
+    if(id < 0 || static_cast<size_t>(id) >= grids.size())
+      throw out_of_range("UTChemParser: no such key");
+    const Grid& grid = grids[(grids[id].base == KeyDictionary::NO_KEY) ? id : grids[id].base];
+    absError = grid.absError;
+    relError = grid.relError;
+    return;
+  }
+
+  deque<Grid>::const_iterator it;
+  for(it = grids.begin() ; it != grids.end() ; ++it) {
+    absError = max(absError, it->absError);
+    relError = max(relError, it->relError);
+  }
+}
+
 /**
  * Checks if two cells are connected by a given component
  *
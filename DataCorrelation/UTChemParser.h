@@ -9,11 +9,21 @@
 #ifndef UTCHEMPARSER_H__
 #define UTCHEMPARSER_H__
 
+#include "GridCodec.h"
 #include "ParserBase.h"
+#include "ThreadPool.h"
 
+#include <deque>
 #include <fstream>
 #include <map>
 
+#define MAX_STRLEN 256
+
+class GridCache;
+class BatchReader;
+class ChunkSource;
+class MappedFile;
+
 // NOTE: Currently only supporting .PERM files
 //      this covers both permeability and porosity data
 class UTChemParser : public ParserBase
@@ -22,17 +32,18 @@ public:
   /**
    * Constructor
    *
-   * @param files  List of files to parse
+   * @param files     List of files to parse
+   * @param options   Parser tuning options
    */
-  UTChemParser(const std::vector<std::string>& files)
-    : ParserBase(files), nx(1), ny(1), layers(1), timestr(NULL)
+  UTChemParser(const std::vector<std::string>& files, const ParserOptions& options=ParserOptions())
+    : ParserBase(files, options), nx(1), ny(1), layers(1), cache(NULL)
   {
   }
 
   /**
    * Destructor
    */
-  virtual ~UTChemParser(){ delete [] timestr; }
+  virtual ~UTChemParser();
 
   /**
    * Read file
@@ -46,6 +57,9 @@ public:
   /**
    * Return values for a particular index
    *
+   * NOTE: The layer is copied out of the key's grid the first time it is asked
+   *       for, prefer getLayerView()
+   *
    * @param key     The key of the value to be found
    * @param layer   The layer to inspect
    * @return A vector containing the corresponding values
@@ -62,6 +76,106 @@ public:
    */
   virtual std::vector<double> getAllValues(const std::string& key) const;
 
+  /**
+   * Get a read-only view of all values of a key (every layer, in order)
+   *
+   * @param key   The key to find all valid values for
+   * @return  A view of the key's grid. If none exist, then the view is empty.
+   */
+  virtual GridView getView(const std::string& key) const;
+
+  /**
+   * Get a read-only view of the values of a key in one layer
+   *
+   * @param key     The key of the value to be found
+   * @param layer   The layer to inspect
+   * @return  A view of the layer. If none exist, then the view is empty.
+   */
+  virtual GridView getLayerView(const std::string& key, int layer) const;
+
+  /**
+   * Get the id of a key
+   *
+   * @param key   The key
+   * @return  Id of the key (KeyDictionary::NO_KEY if it was not parsed)
+   */
+  virtual int getKeyId(const std::string& key) const;
+
+  /**
+   * Get a read-only view of all values of a key by its id
+   *
+   * @param id    Id of the key
+   * @return  A view of the key's grid. If none exist, then the view is empty.
+   */
+  virtual GridView getView(int id) const;
+
+  /**
+   * Get a read-only view of the values of a key in one layer by its id
+   *
+   * @param id      Id of the key
+   * @param layer   The layer to inspect
+   * @return  A view of the layer. If none exist, then the view is empty.
+   */
+  virtual GridView getLayerView(int id, int layer) const;
+
+  /**
+   * Get one tile of the values of a key
+   *
+   * NOTE: Packed grids are unpacked into the buffer one tile at a time,
+   *       other grids are handed out in TILE_VALUES slices without copying
+   *
+   * @param id      Id of the key
+   * @param tile    Index of the tile
+   * @param buffer  Room for TILE_VALUES values, used if the tile has to be unpacked
+   * @return  View of the tile's values (empty past the last tile)
+   */
+  virtual GridView getTile(int id, size_t tile, double* buffer) const;
+
+  /**
+   * Get the number of values in one tile of a key without unpacking it
+   *
+   * @param id      Id of the key
+   * @param tile    Index of the tile
+   * @return  Number of values in the tile (0 past the last tile)
+   */
+  virtual size_t getTileSize(int id, size_t tile) const;
+
+  /**
+   * Get one tile of the values of a key, without expanding it if it is
+   * stored sparse
+   *
+   * @param id      Id of the key
+   * @param tile    Index of the tile
+   * @param buffer  Room for TILE_VALUES values, used if the tile has to be unpacked
+   * @param cells   Room for TILE_VALUES cells, used if the tile is sparse
+   * @return  The tile (no cells past the last tile)
+   */
+  virtual SparseTile getSparseTile(int id, size_t tile, double* buffer, unsigned short* cells) const;
+
+  /**
+   * Get every TIME value read, in order
+   *
+   * @return  The TIME values (empty if the files had none)
+   */
+  virtual const std::vector<std::string>& getTimes() const { return times; }
+
+  /**
+   * Get the snapshots of a property
+   *
+   * @param id    Id of the property (e.g. that of "WATER")
+   * @return  Ids of the property's time-decorated keys (e.g. that of "WATER-1.5000E+02"),
+   *          in the order they were read
+   */
+  virtual std::vector<int> getSnapshots(int id) const;
+
+  /**
+   * Get the TIME of a snapshot
+   *
+   * @param id    Id of a time-decorated key
+   * @return  Index of its TIME value in getTimes() (-1 if the key is not a snapshot)
+   */
+  virtual int getSnapshotTime(int id) const;
+
   /**
    * Get keys
    *
@@ -69,6 +183,13 @@ public:
    */
   virtual std::vector<std::string> getParsedKeys() const;
 
+  /**
+   * Decode a set of keys at once (in parallel) when loading lazily
+   *
+   * @param names   The keys that will be used
+   */
+  virtual void preload(const std::vector<std::string>& names);
+
   /**
    * Checks if two cells are connected by a given component
    *
@@ -87,23 +208,477 @@ public:
    */
   virtual Coord3D getCoordinate(unsigned id) const;
 
+  /**
+   * Get the memory taken by the values of every grid
+   *
+   * NOTE: Keys that have not been decoded yet (lazy loading) are not counted
+   *
+   * @param values  Receives the size of the values unpacked, in bytes
+   * @param packed  Receives the size of the packed values, in bytes (0 unless compressing)
+   */
+  void getValueBytes(size_t& values, size_t& packed) const;
+
+  /**
+   * Get the largest error made rounding the values of a key to single precision
+   *
+   * NOTE: For a time-decorated key, that of every TIME of its property
+   *
+   * @param id        Id of the key (KeyDictionary::NO_KEY for every key)
+   * @param absError  Receives the largest absolute error (0 if not rounded)
+   * @param relError  Receives the largest error relative to the value
+   */
+  void getRoundingError(int id, double& absError, double& relError) const;
+
 private:
+  /**
+   * Where we are within a single output file
+   */
+  enum PARSESTAGE
+  {
+    PREAMBLE,
+    FIRST_HEADER,
+    BODY
+  };
+
+  /**
+   * Every layer of one key stored back to back
+   *
+   * A time-decorated key (e.g. "WATER-1.5000E+02") holds no values of its
+   * own. It is a snapshot listing which layer blocks of its property's grid
+   * were read at that TIME, so each block is only ever stored once.
+   *
+   * When compressing or storing in single precision, the values are kept in
+   * packed and data is only filled in the first time a view of the grid is
+   * asked for. A view of a snapshot of such a grid unpacks only the
+   * snapshot's tiles, into the snapshot's own data.
+   */
+  struct Grid
+  {
+    Grid()
+      : single(false), absError(0.0), relError(0.0), base(KeyDictionary::NO_KEY), time(0), contiguous(true)
+    {
+    }
+    std::vector<double> data;
+    std::vector<size_t> offsets; // Where each layer starts in data
+    GridView cached;             // Values in the grid cache (used instead of data when set)
+    PackedGrid packed;           // Values packed a block at a time (compressing or single precision only)
+    bool single;                 // True if the values are rounded to single precision
+    double absError, relError;   // Largest rounding error so far (single precision only)
+
+    // Snapshots only
+    int base;                    // Id of the property grid holding the values (NO_KEY if this grid owns them)
+    size_t time;                 // Index of the snapshot's TIME value in times
+    std::vector<size_t> blocks;  // Layer blocks of the base grid in this snapshot
+    bool contiguous;             // True if the blocks follow each other in the base grid
+
+    // Properties only
+    std::vector<int> snapshots;  // Ids of the property's snapshots, in the order they were read
+    std::vector<size_t> earlier; // Block of the same layer at the previous TIME, for each block (delta only)
+    std::map<size_t, std::vector<double> > recent; // Values of blocks the next TIME's are stored as changes from (while packing)
+
+    /**
+     * Every value of the grid
+     */
+    GridView all() const
+    {
+      if(cached.data() != NULL)
+        return cached;
+      return data.empty() ? GridView() : GridView(&data[0], data.size());
+    }
+  };
+
+  /**
+   * Where the values of a block that has not been decoded yet are
+   * in a mapped file
+   */
+  struct BlockRef
+  {
+    const char* begin; // First value line
+    const char* end;   // End of the last value line
+    const char* eof;   // End of the mapped file
+    size_t count;      // Values counted in the first pass
+    size_t expected;   // Number of values in a full block
+  };
+
+  /**
+   * A completed layer block read from a file
+   */
+  struct ParsedBlock
+  {
+    std::string key;
+    std::string time; // TIME value when the block's header was read (empty if this file had none yet)
+    bool withTime;    // If true, the block is also stored under its time-decorated key
+    std::vector<double> vals;
+    BlockRef ref;     // Only set when the values were counted rather than converted
+  };
+
+  /**
+   * State carried from one line to the next while parsing a file
+   */
+  struct ParseState
+  {
+    ParseState()
+      : stage(PREAMBLE), lineno(0), expected(0), afterTime(false), nx(1), ny(1), nz(1),
+        indexOnly(false), counted(0), cursor(NULL), next(NULL), eof(NULL), blockBegin(NULL)
+    {
+      buffer[0] = '\0';
+    }
+    PARSESTAGE stage;
+    unsigned lineno;
+    size_t expected; // Number of values in one layer block (nx * ny)
+    bool afterTime;  // True if the previous line was a TIME line
+    unsigned nx, ny, nz;
+    std::string time; // Latest TIME value seen in this file
+    std::string blockTime; // TIME value when the current block's header was read
+    std::vector<double> vals;
+    char buffer[MAX_STRLEN];
+    std::vector<ParsedBlock> blocks;
+
+    // First pass of a block-parallel parse: values are only counted and
+    // each block remembers where its lines are in the mapped file
+    bool indexOnly;
+    size_t counted;         // Values counted in the current block
+    const char* cursor;     // Start of the current line in the mapped file
+    const char* next;       // Start of the line after it
+    const char* eof;        // End of the mapped file
+    const char* blockBegin; // First line of the current block
+
+    /**
+     * Number of values read so far in the current block
+     */
+    size_t filled() const { return indexOnly ? counted : vals.size(); }
+  };
+
+  friend class ParseFileTask;
+  friend class DecodeBlocksTask;
+  friend class LoadKeyTask;
+
+  /**
+   * Parse one file into its list of blocks
+   *
+   * NOTE: This does not touch the parser's members, so several files
+   *       can be parsed at the same time
+   *
+   * @param path    Path of the file to parse
+   * @param state   Receives the parsed blocks
+   * @param opened  Set to false if the file could not be opened
+   * @param pool    If given, the blocks of a mapped file are decoded on this pool
+   * @param reader  If given, plain files are taken from these batched reads
+   * @param index   Index of the file in the reader
+   * @return  True if successfully parsed, false otherwise.
+   */
+  bool parseFile(const std::string& path, ParseState& state, bool& opened, ThreadPool* pool=NULL,
+                 BatchReader* reader=NULL, size_t index=0) const;
 
   /**
    * Parse values and store them properly in the map/vector
    *
    * @param file    The open file stream to parse data
+   * @param state   Receives the parsed blocks
    * @return  True if successfully parsed, false otherwise.
    */
-  virtual bool parseValues(std::ifstream& file);
+  bool parseValues(std::ifstream& file, ParseState& state) const;
 
-  // Map accessed as follows:
-  // [property_name][layer-1][value]
-  std::map<std::string, std::vector<std::vector<double> > > values;
+  /**
+   * Parse values directly out of a memory mapped file
+   *
+   * @param file    The mapped file to parse data from
+   * @param state   Receives the parsed blocks
+   * @param pool    If given, the blocks are decoded on this pool
+   * @return  True if successfully parsed, false otherwise.
+   */
+  bool parseValues(MappedFile& file, ParseState& state, ThreadPool* pool) const;
+
+  /**
+   * Parse values out of a file read in chunks (compressed or batched reads)
+   *
+   * @param file    The open file
+   * @param state   Receives the parsed blocks
+   * @return  True if successfully parsed, false otherwise.
+   */
+  bool parseValues(ChunkSource& file, ParseState& state) const;
+
+  /**
+   * Run every line of a mapped file through parseLine()
+   *
+   * @param file    The mapped file to parse data from
+   * @param state   Parse state for the file
+   * @return  True if successfully parsed, false otherwise.
+   */
+  bool scanMapped(MappedFile& file, ParseState& state) const;
+
+  /**
+   * Convert the values of indexed blocks in parallel
+   *
+   * @param refs    The blocks to decode
+   * @param out     Where to put the values of each block
+   * @param pool    Pool to decode the blocks on
+   * @return  True if every block decoded to exactly what was counted, false otherwise.
+   */
+  bool decodeBlocks(const std::vector<const BlockRef*>& refs, const std::vector<std::vector<double>*>& out,
+                    ThreadPool& pool) const;
+
+  /**
+   * Convert the values of one indexed block
+   *
+   * @param ref     The block to decode
+   * @param vals    The values are appended to this vector
+   * @return  True if the block decoded to exactly what was counted, false otherwise.
+   */
+  bool decodeBlock(const BlockRef& ref, std::vector<double>& vals) const;
+
+  /**
+   * Convert every block of a key into its grid
+   *
+   * @param refs    The key's blocks
+   * @param grid    Receives the values
+   * @return  True if every block decoded to exactly what was counted, false otherwise.
+   */
+  bool decodeKey(const std::vector<BlockRef>& refs, Grid& grid) const;
+
+  /**
+   * Where a file being followed was left off
+   */
+  struct FollowedFile
+  {
+    FollowedFile()
+      : offset(0), opened(false), failed(false), reported(0)
+    {
+    }
+    std::streamoff offset; // Bytes read so far
+    std::string pending;   // Start of a line that has not been finished yet
+    bool opened;           // True once the file exists
+    bool failed;           // True if a line could not be parsed (the rest is ignored)
+    size_t reported;       // Blocks handed to OutputStatus::blockRead() so far
+  };
+
+  /**
+   * Parse the files while they are still being written
+   *
+   * @return true if successful, false otherwise
+   */
+  bool followFiles();
+
+  /**
+   * Parse the lines appended to a file since it was last looked at
+   *
+   * @param path      Path of the file
+   * @param followed  Where the file was left off
+   * @param state     Parse state for the file
+   * @return  True if anything new was read
+   */
+  bool followFile(const std::string& path, FollowedFile& followed, ParseState& state) const;
+
+  /**
+   * Parse every file (or index it when loading lazily)
+   *
+   * @return true if successful, false otherwise
+   */
+  bool parseFiles();
+
+  /**
+   * Use the grid cache of the files if it is still valid
+   *
+   * @return  True if the grids were loaded from the cache, false otherwise
+   */
+  bool loadCache();
+
+  /**
+   * Write the grid cache of the files
+   *
+   * @return  True if written, false otherwise
+   */
+  bool saveCache() const;
+
+  /**
+   * Index the files without converting any values (lazy loading)
+   *
+   * @return true if successful, false otherwise
+   */
+  bool indexFiles();
+
+  /**
+   * Decode a key that has not been used yet (lazy loading)
+   *
+   * @param id    Id of the key about to be used
+   */
+  void load(int id) const;
+
+  /**
+   * Get the id of a key, adding an empty grid for it if it is new
+   *
+   * @param key   The key
+   * @return  Id of the key
+   */
+  int addKey(const std::string& key);
+
+  /**
+   * Record that a block of a property was read at a TIME
+   *
+   * @param keyTime   The time-decorated key
+   * @param base      Id of the property
+   * @param block     Index of the block in the property's grid
+   */
+  void addSnapshot(const std::string& keyTime, int base, size_t block);
+
+  /**
+   * Get the grid of a key, checking the id
+   *
+   * @param id    Id of the key
+   * @return  The key's grid
+   */
+  const Grid& gridOf(int id) const;
+
+  /**
+   * Unpack the values of a packed grid into its data (once)
+   *
+   * @param id    Id of the key (must exist)
+   */
+  void unpack(int id) const;
+
+  /**
+   * Get every value of a key (a snapshot's values are gathered from its property)
+   *
+   * @param id    Id of the key (must exist)
+   * @return  View of the key's values
+   */
+  GridView viewOf(int id) const;
+
+  /**
+   * Get the number of layer blocks stored for a key so far
+   *
+   * @param id    Id of the key (must exist)
+   * @return  Number of blocks
+   */
+  size_t blockCount(int id) const;
+
+  /**
+   * Parse a single line of an output file
+   *
+   * NOTE: The byte at line[len] must not be part of a number (i.e. a
+   *       newline or the string terminator) since values are converted in place.
+   *
+   * @param state   Parse state for the file being read
+   * @param line    Start of the line (without its newline)
+   * @param len     Length of the line
+   * @return  True if successfully parsed, false otherwise.
+   */
+  bool parseLine(ParseState& state, const char* line, size_t len) const;
+
+  /**
+   * Flush the last block of a file once all lines have been parsed
+   *
+   * @param state   Parse state for the file being read
+   * @return  True if the file was complete, false otherwise.
+   */
+  bool finishParse(ParseState& state) const;
+
+  /**
+   * Parse a block header line and set the key for the following block
+   *
+   * @param state   Parse state for the file being read
+   * @param lptr    The (null terminated) header line
+   * @return  True if the header was recognized, false otherwise.
+   */
+  bool parseHeader(ParseState& state, const char* lptr) const;
+
+  /**
+   * Finish the block currently being read
+   *
+   * @param state     Parse state for the file being read
+   * @param withTime  If true, also store the block under its time-decorated key
+   */
+  void endBlock(ParseState& state, bool withTime) const;
+
+  /**
+   * Check if the values of some grids are kept packed
+   *
+   * @return  True if compressing, storing in single precision or storing sparse tiles
+   */
+  bool packs() const { return options.compress || options.single || !options.singleKeys.empty() || options.sparse > 0.0 || options.delta; }
+
+  /**
+   * Check if the values of a grid are kept packed
+   *
+   * @param grid    The grid
+   */
+  bool packs(const Grid& grid) const { return options.compress || grid.single || options.sparse > 0.0 || options.delta; }
+
+  /**
+   * Check if a key is to be stored in single precision
+   *
+   * @param key   The key
+   * @return  True if so (see ParserOptions::singleKeys)
+   */
+  bool storedSingle(const std::string& key) const;
+
+  /**
+   * Pack a layer block onto the end of a grid (in single precision if the
+   * grid is stored that way, packing tiles losslessly instead when compressing
+   * and that is smaller, tiles with few nonzero values sparse, and tiles of
+   * snapshots as changes from the previous TIME when that is smaller)
+   *
+   * @param grid    The grid
+   * @param vals    The values
+   */
+  void packBlock(Grid& grid, const std::vector<double>& vals) const;
+
+  /**
+   * Get the range of values of one layer of a grid
+   *
+   * @param grid    The grid
+   * @param layer   Index of the layer (must exist)
+   * @return  View of the layer
+   */
+  static GridView layerOf(const Grid& grid, size_t layer);
+
+  /**
+   * Find the packed grid holding a tile of a key
+   *
+   * @param id      Id of the key
+   * @param tile    Index of the tile in the key, changed to its index in the packed grid (past its
+   *                last tile if the key has no such tile)
+   * @return  The packed grid (NULL if the key is not packed)
+   */
+  const PackedGrid* tileOf(int id, size_t& tile) const;
+
+  /**
+   * Store the blocks of a parsed file under their keys (and time keys)
+   *
+   * NOTE: Files must be merged in the order they are listed since a file
+   *       without TIME data takes the last TIME value of the files before it
+   *
+   * @param state   The parsed file
+   */
+  void mergeBlocks(ParseState& state);
+
+  // Every key parsed, interned so the grids can be indexed by id
+  KeyDictionary keys;
+
+  // Grids indexed by key id, accessed as follows:
+  // grids[id].data[offsets[layer-1] + value]
+  // NOTE: Mutable so that keys can be decoded on first use when loading lazily
+  //       (a deque so grids never move as keys are added)
+  mutable std::deque<Grid> grids;
+
+  // Layers handed out by getValues(), copied on first use (indexed by key id)
+  mutable std::deque<std::vector<std::vector<double> > > layerCopies;
   unsigned nx, ny, layers;
 
-  // If we have time data
-  char* timestr;
+  // Lazy loading: blocks of each key still to be decoded (indexed by key id),
+  // and the files they live in
+  mutable std::deque<std::vector<BlockRef> > unloaded;
+  mutable Mutex loadLock;
+  std::vector<MappedFile*> mappings;
+
+  // Last TIME value seen (carried from one file into the next)
+  std::string timestr;
+
+  // Every TIME value in the order it was seen (stored in the grid cache)
+  std::vector<std::string> times;
+
+  // Grid cache the values are being served from (if any)
+  GridCache* cache;
 };
 
 #endif /** UTCHEMPARSER_H__ */
@@ -0,0 +1,299 @@
+/**
+ * ValueScanner.cpp
+ *
+ * Fast conversion of whitespace separated numbers in a line of values
+ *
+ * Numbers with at most 19 significant digits and a small decimal exponent are
+ * converted with one exactly rounded multiply or divide (Clinger's fast
+ * path), which gives the same bits as strtod/sscanf. Anything else falls
+ * back to strtod.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#include <cfloat>
+#include <cstdlib>
+
+#include "ValueScanner.h"
+
+// The fast path relies on each multiply/divide being rounded exactly once,
+// which is not true on x87 with extended precision
+#if (defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0) || defined(_M_X64) || defined(__x86_64__)
+#define USE_FAST_PATH
+#endif
+
+#define MAX_SIG_DIGITS 19 // Significant digits that always fit a 64-bit integer
+#define MAX_EXACT_MANTISSA (1ULL << 53) // Largest integer a double holds exactly
+
+using namespace std;
+
+typedef unsigned long long uint64;
+
+// Powers of ten that are exactly representable as doubles
+static const double exactPow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Integer powers of ten used to pull large exponents into the mantissa
+static const uint64 intPow10[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+  100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+  10000000000000ULL, 100000000000000ULL, 1000000000000000ULL
+};
+
+/**
+ * Convert a number using only the exactly rounded fast path
+ *
+ * @param p     Start of the number
+ * @param end   Furthest the number may extend
+ * @param val   The converted value
+ * @return  One past the last character converted, or NULL if the fast path does not apply
+ */
+static inline const char* fastPath(const char* p, const char* end, double& val)
+{
+#ifdef USE_FAST_PATH
+  bool neg = false;
+  bool any = false;
+  uint64 mant = 0;
+  int digits = 0;
+  int exp10 = 0;
+
+  if(p < end && (*p == '-' || *p == '+')) {
+    neg = (*p == '-');
+    p++;
+  }
+
+  // Integer part
+  for( ; p < end && *p >= '0' && *p <= '9' ; ++p) {
+    any = true;
+    if(mant == 0 && *p == '0')
+      continue; // Leading zeros are not significant
+    if(++digits > MAX_SIG_DIGITS)
+      return NULL;
+    mant = mant * 10 + (*p - '0');
+  }
+
+  // Fraction
+  if(p < end && *p == '.') {
+    for(p++ ; p < end && *p >= '0' && *p <= '9' ; ++p) {
+      any = true;
+      exp10--;
+      if(mant == 0 && *p == '0')
+        continue;
+      if(++digits > MAX_SIG_DIGITS)
+        return NULL;
+      mant = mant * 10 + (*p - '0');
+    }
+  }
+
+  if(!any)
+    return NULL; // inf, nan or garbage - let strtod decide
+
+  // Exponent
+  if(p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool eneg = false;
+    int e = 0;
+    if(q < end && (*q == '-' || *q == '+')) {
+      eneg = (*q == '-');
+      q++;
+    }
+    if(q >= end || *q < '0' || *q > '9')
+      return NULL;
+    for( ; q < end && *q >= '0' && *q <= '9' ; ++q) {
+      if(e < 10000)
+        e = e * 10 + (*q - '0');
+    }
+    exp10 += (eneg) ? -e : e;
+    p = q;
+  }
+
+  if(mant == 0) {
+    val = (neg) ? -0.0 : 0.0;
+    return p;
+  }
+
+  if(mant > MAX_EXACT_MANTISSA)
+    return NULL;
+
+  double d = static_cast<double>(mant);
+  if(exp10 < 0) {
+    if(exp10 < -22)
+      return NULL;
+    d /= exactPow10[-exp10];
+  } else if(exp10 > 22) {
+    // 1234e30 = 1234000000e22 as long as the bigger mantissa is still exact
+    if(exp10 > 22 + 15 || mant > MAX_EXACT_MANTISSA / intPow10[exp10 - 22])
+      return NULL;
+    d = static_cast<double>(mant * intPow10[exp10 - 22]) * exactPow10[22];
+  } else {
+    d *= exactPow10[exp10];
+  }
+
+  val = (neg) ? -d : d;
+  return p;
+#else
+  return NULL;
+#endif
+}
+
+/**
+ * Check if a character may follow a number the fast path converted
+ *
+ * NOTE: Fixed-width fields are written with no gap when they fill their
+ *       width (e.g. " 1.00000E+00-2.00000E+00"), so the next field's sign
+ *       or digit may follow directly, as it did for sscanf("%lg%n")
+ */
+static inline bool endsNumber(char c)
+{
+  return c == ' ' || c == '\t' || c == '-' || c == '+' || (c >= '0' && c <= '9');
+}
+
+/**
+ * Convert the number starting at p
+ *
+ * @param p         Start of the number
+ * @param end       End of the line
+ * @param out       Vector to append the value to
+ * @param tokEnd    One past the end of the number (a separator or the start of the next field)
+ * @return  True if a number was converted, false otherwise
+ */
+static inline bool convertToken(const char* p, const char* end, vector<double>& out, const char*& tokEnd)
+{
+  double val;
+  const char* next = fastPath(p, end, val);
+
+  // Anything the fast path cannot take whole (hex, inf, huge exponents...) goes to strtod
+  if(next == NULL || (next < end && !endsNumber(*next))) {
+    char* stop = NULL;
+    val = strtod(p, &stop);
+    if(stop == p)
+      return false;
+    next = stop;
+  }
+
+  out.push_back(val);
+  tokEnd = next;
+  return true;
+}
+
+/**
+ * Find where the number starting at p ends without converting it
+ *
+ * @param p     Start of the number
+ * @param end   End of the line
+ * @return  One past the end of the number (p if there is none), where convertToken() would stop
+ */
+static inline const char* skipNumber(const char* p, const char* end)
+{
+  const char* q = p;
+  if(q < end && (*q == '-' || *q == '+'))
+    q++;
+  size_t count = 0;
+  for( ; q < end && *q >= '0' && *q <= '9' ; ++q)
+    count++;
+  if(q < end && *q == '.') {
+    for(q++ ; q < end && *q >= '0' && *q <= '9' ; ++q)
+      count++;
+  }
+
+  if(count > 0 && q < end && (*q == 'e' || *q == 'E')) {
+    const char* e = q + 1;
+    if(e < end && (*e == '-' || *e == '+'))
+      e++;
+    if(e < end && *e >= '0' && *e <= '9') {
+      while(e < end && *e >= '0' && *e <= '9')
+        e++;
+      q = e;
+    }
+  }
+
+  // Anything else (hex, inf, nan...) is measured by strtod itself
+  if(count == 0 || (q < end && !endsNumber(*q))) {
+    char* stop = NULL;
+    strtod(p, &stop);
+    return stop;
+  }
+  return q;
+}
+
+/**
+ * Convert every number in a line of values
+ *
+ * NOTE: The byte at *end must not be part of a number (i.e. a newline or
+ *       the string terminator). Conversions are bit-identical to sscanf("%lg").
+ *
+ * @param begin   Start of the line
+ * @param end     End of the line (without its newline)
+ * @param out     Vector to append the converted values to
+ * @return  True if every token on the line was a number, false otherwise
+ */
+bool ValueScanner::scanLine(const char* begin, const char* end, vector<double>& out)
+{
+  // Lines from DOS formatted files keep their carriage return
+  if(end > begin && *(end - 1) == '\r')
+    end--;
+
+  while(begin < end) {
+    if(*begin == ' ' || *begin == '\t') { // eat whitespace
+      begin++;
+      continue;
+    }
+    if(!convertToken(begin, end, out, begin))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Count the numbers in a line without converting them
+ *
+ * @param begin   Start of the line
+ * @param end     End of the line (without its newline)
+ * @return  Number of numbers on the line
+ */
+size_t ValueScanner::countTokens(const char* begin, const char* end)
+{
+  if(end > begin && *(end - 1) == '\r')
+    end--;
+
+  size_t count = 0;
+  const char* p = begin;
+  while(p < end) {
+    if(*p == ' ' || *p == '\t') {
+      p++;
+      continue;
+    }
+    count++;
+    const char* next = skipNumber(p, end);
+    if(next == p) {
+      // Not a number (the line will not scan), so count the rest of the run once
+      while(p < end && *p != ' ' && *p != '\t')
+        p++;
+    } else {
+      p = next;
+    }
+  }
+  return count;
+}
+
+/**
+ * Convert a single number
+ *
+ * @param begin   Start of the number
+ * @param end     Furthest the number may extend
+ * @param val     The converted value
+ * @return  One past the last character converted, or NULL if nothing could be converted
+ */
+const char* ValueScanner::parseDouble(const char* begin, const char* end, double& val)
+{
+  const char* next = fastPath(begin, end, val);
+  if(next != NULL)
+    return next;
+
+  // Slow but always correct
+  char* stop = NULL;
+  val = strtod(begin, &stop);
+  return (stop == begin) ? NULL : stop;
+}
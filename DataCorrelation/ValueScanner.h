@@ -0,0 +1,59 @@
+/**
+ * ValueScanner.h
+ *
+ * Fast conversion of whitespace separated numbers in a line of values
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef VALUESCANNER_H__
+#define VALUESCANNER_H__
+
+#include <cstddef>
+#include <vector>
+
+class ValueScanner
+{
+public:
+  /**
+   * Convert every number in a line of values
+   *
+   * NOTE: The byte at *end must not be part of a number (i.e. a newline or
+   *       the string terminator). Conversions are bit-identical to sscanf("%lg").
+   *
+   * @param begin   Start of the line
+   * @param end     End of the line (without its newline)
+   * @param out     Vector to append the converted values to
+   * @return  True if every token on the line was a number, false otherwise
+   */
+  static bool scanLine(const char* begin, const char* end, std::vector<double>& out);
+
+  /**
+   * Count the numbers in a line without converting them
+   *
+   * NOTE: This is the number of values scanLine() appends when it succeeds
+   *       (fixed-width fields with no gap between them count separately)
+   *
+   * @param begin   Start of the line
+   * @param end     End of the line (without its newline)
+   * @return  Number of numbers on the line
+   */
+  static size_t countTokens(const char* begin, const char* end);
+
+  /**
+   * Convert a single number
+   *
+   * @param begin   Start of the number
+   * @param end     Furthest the number may extend
+   * @param val     The converted value
+   * @return  One past the last character converted, or NULL if nothing could be converted
+   */
+  static const char* parseDouble(const char* begin, const char* end, double& val);
+
+private:
+  // Simple container so we don't have random methods floating.
+  ValueScanner(){}
+  virtual ~ValueScanner(){}
+};
+
+#endif /** VALUESCANNER_H__ */
@@ -0,0 +1,57 @@
+/**
+ * GenOutput.cpp
+ *
+ * Writes a synthetic UTChem output file (see OutputGenerator)
+ *
+ * Usage: utchemgen file nx ny nz [properties] [phases] [timesteps] [format] [seed]
+ *   properties  Number of properties (default 3)
+ *   phases      Phases of each property (default 1, no "OF PHASE" headers)
+ *   timesteps   Number of TIME snapshots (default 2, 0 for no TIME lines)
+ *   format      printf format used to write each value (default " %12.5E")
+ *   seed        Seed of the values (default 1)
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
+#include <cstdio>
+#include <cstdlib>
+
+#include "OutputGenerator.h"
+
+int main(int argc, char** argv)
+{
+  if(argc < 5) {
+    fprintf(stderr, "Usage: %s file nx ny nz [properties] [phases] [timesteps] [format] [seed]\n", argv[0]);
+    return 1;
+  }
+
+  GeneratorOptions options;
+  options.nx = static_cast<unsigned>(atoi(argv[2]));
+  options.ny = static_cast<unsigned>(atoi(argv[3]));
+  options.nz = static_cast<unsigned>(atoi(argv[4]));
+  if(argc > 5)
+    options.properties = static_cast<unsigned>(atoi(argv[5]));
+  if(argc > 6)
+    options.phases = static_cast<unsigned>(atoi(argv[6]));
+  if(argc > 7)
+    options.timesteps = static_cast<unsigned>(atoi(argv[7]));
+  if(argc > 8)
+    options.format = argv[8];
+  if(argc > 9)
+    options.seed = static_cast<unsigned>(atoi(argv[9]));
+
+  if(options.nx == 0 || options.ny == 0 || options.nz == 0 || options.properties == 0 || options.phases == 0) {
+    fprintf(stderr, "Every dimension and count must be at least 1\n");
+    return 1;
+  }
+
+  OutputGenerator generator(options);
+  if(!generator.write(argv[1])) {
+    fprintf(stderr, "Could not write %s\n", argv[1]);
+    return 1;
+  }
+
+  printf("Wrote %lu values to %s\n", static_cast<unsigned long>(generator.values()), argv[1]);
+  return 0;
+}
@@ -0,0 +1,226 @@
+/**
+ * KernelBench.cpp
+ *
+ * Benchmark for the reduction kernels: the original one-accumulator loops
+ * against Kernels on every instruction set this CPU supports. Also
+ * verifies that every instruction set gives bit-identical results to the
+ * scalar kernels, also when the values are handed over in uneven pieces,
+ * and reports how far the results are from the original loops (in units in
+ * the last place).
+ *
+ * Usage: kernelbench [count]
+ *   count   Number of values per array (default 2048, one tile), repeated
+ *           to about 20 million values per timing
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "../Kernels.h"
+
+#define PASSES 3
+#define RESULTS 8 // sum, squares, deviations, dot, diffs, float diffs, co-deviations, min + max
+
+using namespace std;
+
+static const char* const resultNames[RESULTS] = { "sum", "squares", "deviations", "dot", "diffs", "float diffs", "codeviations",
+                                                    "min/max" };
+
+/**
+ * Fill an array with a mix of magnitudes and signs, and some zeros
+ */
+static void generate(vector<double>& vals, unsigned seed)
+{
+  srand(seed);
+  for(size_t i = 0 ; i < vals.size() ; ++i) {
+    double mag = static_cast<double>(rand()) / RAND_MAX;
+    int exp = (rand() % 8) - 4;
+    vals[i] = (rand() % 5 == 0) ? 0.0 : mag * pow(10.0, exp) * ((rand() % 2) ? 1 : -1) + 0.5;
+  }
+}
+
+/**
+ * The original loops, one accumulator each
+ */
+static double original(int op, const vector<double>& x, const vector<double>& y, const vector<float>& xs,
+                       const vector<float>& ys, double mean)
+{
+  double ret = 0.0, d;
+  switch(op) {
+  case 0:
+    for(size_t i = 0 ; i < x.size() ; ++i)
+      ret += x[i];
+    break;
+  case 1:
+    for(size_t i = 0 ; i < x.size() ; ++i)
+      ret += x[i] * x[i];
+    break;
+  case 2:
+    for(size_t i = 0 ; i < x.size() ; ++i) {
+      d = x[i] - mean;
+      ret += d * d;
+    }
+    break;
+  case 3:
+    for(size_t i = 0 ; i < x.size() ; ++i)
+      ret += x[i] * y[i];
+    break;
+  case 4:
+    for(size_t i = 0 ; i < x.size() ; ++i) {
+      d = x[i] - y[i];
+      ret += d * d;
+    }
+    break;
+  case 5:
+    for(size_t i = 0 ; i < x.size() ; ++i) {
+      d = static_cast<double>(xs[i]) - ys[i];
+      ret += d * d;
+    }
+    break;
+  case 6:
+    for(size_t i = 0 ; i < x.size() ; ++i)
+      ret += (x[i] - mean) * (y[i] - mean);
+    break;
+  default:
+    {
+      double min = x[0], max = x[0];
+      for(size_t i = 1 ; i < x.size() ; ++i) {
+        if(x[i] < min)
+          min = x[i];
+        if(x[i] > max)
+          max = x[i];
+      }
+      ret = max - min;
+    }
+  }
+  return ret;
+}
+
+/**
+ * One kernel over the arrays, handed over in pieces of at most piece values
+ */
+static double kernel(int op, const vector<double>& x, const vector<double>& y, const vector<float>& xs,
+                     const vector<float>& ys, double mean, size_t piece)
+{
+  LaneSums acc;
+  double min = 0.0, max = 0.0;
+  for(size_t i = 0 ; i < x.size() ; i += piece) {
+    size_t n = (x.size() - i < piece) ? x.size() - i : piece;
+    switch(op) {
+    case 0: Kernels::sum(acc, &x[i], n); break;
+    case 1: Kernels::sumSquares(acc, &x[i], n); break;
+    case 2: Kernels::sumDeviations(acc, &x[i], n, mean); break;
+    case 3: Kernels::dot(acc, &x[i], &y[i], n); break;
+    case 4: Kernels::sumSquaredDiffs(acc, &x[i], &y[i], n); break;
+    case 5: Kernels::sumSquaredDiffs(acc, &xs[i], &ys[i], n); break;
+    case 6: Kernels::sumCoDeviations(acc, &x[i], &y[i], n, mean, mean); break;
+    default:
+      {
+        double lo, hi;
+        Kernels::minMax(&x[i], n, lo, hi);
+        if(i == 0 || lo < min)
+          min = lo;
+        if(i == 0 || hi > max)
+          max = hi;
+      }
+    }
+  }
+  return (op < RESULTS - 1) ? acc.total() : max - min;
+}
+
+/**
+ * Distance between two doubles in units in the last place
+ */
+static double ulps(double a, double b)
+{
+  if(a == b)
+    return 0.0;
+  double unit = fabs(nextafter(a, b) - a);
+  return fabs(a - b) / unit;
+}
+
+/**
+ * Time the original loop (isa < 0) or a kernel over the arrays, repeated
+ *
+ * @return  Values per second of the fastest pass
+ */
+static double rate(int isa, int op, const vector<double>& x, const vector<double>& y, const vector<float>& xs,
+                   const vector<float>& ys, double mean, size_t repeat)
+{
+  volatile double sink = 0.0;
+  clock_t best = 0;
+  for(int pass = 0 ; pass < PASSES ; ++pass) {
+    clock_t start = clock();
+    for(size_t r = 0 ; r < repeat ; ++r)
+      sink = sink + ((isa < 0) ? original(op, x, y, xs, ys, mean) : kernel(op, x, y, xs, ys, mean, x.size()));
+    clock_t elapsed = clock() - start;
+    if(pass == 0 || elapsed < best)
+      best = elapsed;
+  }
+  double secs = static_cast<double>(best > 0 ? best : 1) / CLOCKS_PER_SEC;
+  return static_cast<double>(x.size()) * repeat / secs;
+}
+
+int main(int argc, char** argv)
+{
+  size_t count = (argc > 1) ? static_cast<size_t>(atol(argv[1])) : 2048;
+  if(count == 0)
+    count = 1;
+  size_t repeat = 1 + 20000000 / count;
+  vector<double> x(count), y(count);
+  generate(x, 12345);
+  generate(y, 54321);
+  vector<float> xs(x.begin(), x.end()), ys(y.begin(), y.end());
+  double mean = 0.5;
+  bool ok = true;
+
+  printf("%lu values (x %lu), best instruction set: %s\n", static_cast<unsigned long>(count),
+    static_cast<unsigned long>(repeat), Kernels::getName(Kernels::detectInstructionSet()));
+  printf("%-10s", "Mvalues/s");
+  for(int op = 0 ; op < RESULTS ; ++op)
+    printf(" %11s", resultNames[op]);
+  printf("\n%-10s", "original");
+  for(int op = 0 ; op < RESULTS ; ++op)
+    printf(" %11.0f", rate(-1, op, x, y, xs, ys, mean, repeat) / 1e6);
+  printf("\n");
+
+  Kernels::setInstructionSet(Kernels::SCALAR);
+  double reference[RESULTS];
+  for(int op = 0 ; op < RESULTS ; ++op)
+    reference[op] = kernel(op, x, y, xs, ys, mean, count);
+
+  for(int isa = Kernels::SCALAR ; isa <= Kernels::AVX512 ; ++isa) {
+    if(!Kernels::setInstructionSet(static_cast<Kernels::ISA>(isa)))
+      continue;
+    printf("%-10s", Kernels::getName(static_cast<Kernels::ISA>(isa)));
+    for(int op = 0 ; op < RESULTS ; ++op)
+      printf(" %11.0f", rate(isa, op, x, y, xs, ys, mean, repeat) / 1e6);
+    printf("\n");
+
+    // Bit-for-bit comparison against the scalar kernels, whole and in uneven pieces
+    const size_t pieces[] = { count, 1000, 7 };
+    for(size_t p = 0 ; p < sizeof(pieces) / sizeof(pieces[0]) ; ++p) {
+      for(int op = 0 ; op < RESULTS ; ++op) {
+        double got = kernel(op, x, y, xs, ys, mean, pieces[p]);
+        if(memcmp(&got, &reference[op], sizeof(double)) != 0) {
+          printf("  MISMATCH: %s in pieces of %lu differs from scalar\n", resultNames[op],
+            static_cast<unsigned long>(pieces[p]));
+          ok = false;
+        }
+      }
+    }
+  }
+
+  // How far the partial sums moved the results from the original loops
+  for(int op = 0 ; op < RESULTS ; ++op)
+    printf("%-12s %.0f ulp from the original loop\n", resultNames[op], ulps(original(op, x, y, xs, ys, mean), reference[op]));
+
+  return (ok) ? 0 : 1;
+}
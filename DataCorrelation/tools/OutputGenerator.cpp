@@ -0,0 +1,175 @@
+/**
+ * OutputGenerator.cpp
+ *
+ * Writes synthetic output files in the UTChem format
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "../DCUtil.h"
+#include "OutputGenerator.h"
+
+using namespace std;
+
+typedef unsigned long long uint64;
+
+/**
+ * Next number of a xorshift64* sequence (the same on every platform, unlike rand())
+ *
+ * @param state   State of the sequence (never 0)
+ * @return  The number
+ */
+static uint64 nextRandom(uint64& state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 2685821657736338717ULL;
+}
+
+/**
+ * Name of a property: PROPA to PROPZ, then PROPAA, PROPAB, ...
+ *
+ * NOTE: No digits, which the parser would take for the phase or layer
+ *
+ * @param index   Index of the property
+ * @return  The name
+ */
+static string propertyName(unsigned index)
+{
+  string letters;
+  do {
+    letters.insert(letters.begin(), static_cast<char>('A' + index % 26));
+    index = index / 26;
+  } while(index-- > 0);
+  return "PROP" + letters;
+}
+
+/**
+ * Constructor
+ *
+ * @param options   Shape and formatting of the file
+ */
+OutputGenerator::OutputGenerator(const GeneratorOptions& options)
+  : options(options)
+{
+  if(this->options.perLine == 0)
+    this->options.perLine = 1;
+}
+
+/**
+ * Write the file
+ *
+ * @param path  Where to write it
+ * @return  True on success, false otherwise
+ */
+bool OutputGenerator::write(const string& path) const
+{
+  FILE* out = fopen(path.c_str(), "wb");
+  if(out == NULL)
+    return false;
+  bool written = generate(out, NULL);
+  return (fclose(out) == 0) && written;
+}
+
+/**
+ * Generate the file's values again, without writing it
+ *
+ * @param sink  Receives every layer block in file order
+ */
+void OutputGenerator::replay(BlockSink& sink) const
+{
+  generate(NULL, &sink);
+}
+
+/**
+ * Get the number of values in the file
+ */
+size_t OutputGenerator::values() const
+{
+  size_t steps = (options.timesteps > 0) ? options.timesteps : 1;
+  return static_cast<size_t>(options.nx) * options.ny * options.nz * options.properties * options.phases * steps;
+}
+
+/**
+ * Generate the file
+ *
+ * @param out   Where to write it (NULL to only generate the values)
+ * @param sink  Receives every layer block (NULL if not wanted)
+ * @return  True on success, false if writing failed
+ */
+bool OutputGenerator::generate(FILE* out, BlockSink* sink) const
+{
+  const size_t count = static_cast<size_t>(options.nx) * options.ny;
+  const unsigned steps = (options.timesteps > 0) ? options.timesteps : 1;
+  uint64 state = (static_cast<uint64>(options.seed) << 1) | 1;
+  vector<double> vals(count);
+  string text;
+  char buffer[256];
+  bool first = true;
+
+  // The parser skips the first 4 lines
+  if(out != NULL) {
+    fprintf(out, " UTCHEM SYNTHETIC OUTPUT\n GENERATED FOR PARSER BENCHMARKS\n SEED %u\n\n", options.seed);
+    fprintf(out, " NX = %4u NY = %4u NZ = %4u\n", options.nx, options.ny, options.nz);
+  }
+
+  for(unsigned t = 0 ; t < steps ; ++t) {
+    if(options.timesteps > 0 && out != NULL)
+      fprintf(out, " TIME =  %.5E DAYS\n", 100.0 * (t + 1));
+
+    for(unsigned prop = 0 ; prop < options.properties ; ++prop) {
+      string name(propertyName(prop));
+      for(unsigned phase = 1 ; phase <= options.phases ; ++phase) {
+        for(unsigned layer = 1 ; layer <= options.nz ; ++layer) {
+          string key(name);
+          if(options.phases > 1) {
+            sprintf(buffer, " %s (UNITS) OF PHASE %12u  IN LAYER %12u", name.c_str(), phase, layer);
+            key.append("_" + DCUtil::XToY<unsigned, string>(phase));
+          } else {
+            sprintf(buffer, " %s (UNITS) IN LAYER %12u", name.c_str(), layer);
+          }
+          string header(buffer);
+
+          // The parser keys the first header of a file by its text up to the first digit
+          if(first)
+            key = header.substr(0, header.find_first_of("0123456789"));
+          first = false;
+
+          text.clear();
+          for(size_t i = 0 ; i < count ; ++i) {
+            // A fifth zeros, the rest anywhere from 1e-7 to 1e5 of either sign
+            double val = 0.0;
+            if(nextRandom(state) % 5 != 0) {
+              double mantissa = (nextRandom(state) >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+              int exponent = static_cast<int>(nextRandom(state) % 12) - 6;
+              val = mantissa * pow(10.0, exponent);
+            }
+
+            // The value as it reads back from the text, not as it was before printing
+            sprintf(buffer, options.format.c_str(), val);
+            vals[i] = strtod(buffer, NULL);
+            text.append(buffer);
+            if((i + 1) % options.perLine == 0 || i + 1 == count)
+              text += '\n';
+          }
+
+          if(out != NULL) {
+            fprintf(out, "%s\n", header.c_str());
+            if(fwrite(text.data(), 1, text.size(), out) != text.size())
+              return false;
+          }
+          if(sink != NULL)
+            sink->block(key, header, vals.empty() ? NULL : &vals[0], count);
+        }
+      }
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,105 @@
+/**
+ * OutputGenerator.h
+ *
+ * Writes synthetic output files in the UTChem format, so the parser can be
+ * exercised and timed without running the simulator
+ *
+ * Each timestep writes a TIME line and then every layer of every property
+ * (and phase) in turn. Values are pseudo-random (a fifth of them zero, the
+ * rest spread over 12 orders of magnitude) and the same for the same seed.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#ifndef OUTPUTGENERATOR_H__
+#define OUTPUTGENERATOR_H__
+
+#include <cstdio>
+#include <string>
+
+/**
+ * Shape and formatting of a generated file
+ */
+struct GeneratorOptions
+{
+  GeneratorOptions()
+    : nx(10), ny(10), nz(3), properties(3), phases(1), timesteps(2), perLine(8), seed(1), format(" %12.5E")
+  {
+  }
+  unsigned nx, ny, nz;
+  unsigned properties; // Named PROPA, PROPB, ...
+  unsigned phases;     // More than 1 writes "OF PHASE" headers (keys PROPA_1, PROPA_2, ...)
+  unsigned timesteps;  // 0 writes no TIME lines at all
+  unsigned perLine;    // Values per line
+  unsigned seed;
+  std::string format;  // printf format of one value (must print a single number)
+};
+
+/**
+ * Hears about each layer block as it is generated
+ */
+class BlockSink
+{
+public:
+  virtual ~BlockSink(){}
+
+  /**
+   * Take one layer block
+   *
+   * @param key     Key the parser stores the block under
+   * @param header  The block's header line (without the newline)
+   * @param vals    The values exactly as they read back from the file
+   * @param n       Number of values
+   */
+  virtual void block(const std::string& key, const std::string& header, const double* vals, size_t n) = 0;
+};
+
+class OutputGenerator
+{
+public:
+  /**
+   * Constructor
+   *
+   * @param options   Shape and formatting of the file
+   */
+  OutputGenerator(const GeneratorOptions& options);
+
+  /**
+   * Destructor
+   */
+  virtual ~OutputGenerator(){}
+
+  /**
+   * Write the file
+   *
+   * @param path  Where to write it
+   * @return  True on success, false otherwise
+   */
+  bool write(const std::string& path) const;
+
+  /**
+   * Generate the file's values again, without writing it
+   *
+   * @param sink  Receives every layer block in file order
+   */
+  void replay(BlockSink& sink) const;
+
+  /**
+   * Get the number of values in the file
+   */
+  size_t values() const;
+
+private:
+  /**
+   * Generate the file
+   *
+   * @param out   Where to write it (NULL to only generate the values)
+   * @param sink  Receives every layer block (NULL if not wanted)
+   * @return  True on success, false if writing failed
+   */
+  bool generate(FILE* out, BlockSink* sink) const;
+
+  GeneratorOptions options;
+};
+
+#endif /** OUTPUTGENERATOR_H__ */
@@ -0,0 +1,174 @@
+/**
+ * PackBench.cpp
+ *
+ * Benchmark for compressed grids: parses the given output files with the
+ * grids kept as they are and again with them packed, then reports the
+ * compression ratio and how fast AnalyzeData scans each way (and again
+ * with sparse tiles below the given density and/or snapshots stored as
+ * changes from the previous TIME, if asked for). Also verifies that every
+ * statistic is bit-identical every way.
+ *
+ * Usage: packbench [--sparse=density] [--delta] file [file...]
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "../AnalyzeData.h"
+#include "../TileScanner.h"
+#include "../UTChemParser.h"
+
+#define PASSES 3
+
+using namespace std;
+
+/**
+ * Results of one way of holding the grids
+ */
+struct Run
+{
+  double parseSecs;
+  double scanSecs;
+  size_t values;
+  size_t unpacked, packed;
+  vector<double> results; // sum, mean, variance and pearson (with the next key) of every key
+};
+
+/**
+ * Parse the files and scan every key
+ *
+ * @param files     Output files to parse
+ * @param compress  If true, keep the grids packed
+ * @param sparse    Density below which tiles are stored sparse (0 never)
+ * @param delta     If true, store snapshots as changes from the previous TIME
+ * @param run       Receives the timings and results
+ */
+static void bench(const vector<string>& files, bool compress, double sparse, bool delta, Run& run)
+{
+  ParserOptions options;
+  options.threads = 1; // Timings are CPU time
+  options.compress = compress;
+  options.sparse = sparse;
+  options.delta = delta;
+  UTChemParser parser(files, options);
+
+  clock_t start = clock();
+  AnalyzeData data(parser);
+  run.parseSecs = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  parser.getValueBytes(run.unpacked, run.packed);
+
+  // Snapshots share their property's values, so only scan the properties
+  vector<int> ids;
+  vector<size_t> sizes;
+  vector<string> keys(parser.getParsedKeys());
+  for(size_t i = 0 ; i < keys.size() ; ++i) {
+    int id = parser.getKeyId(keys[i]);
+    if(parser.getSnapshotTime(id) >= 0)
+      continue;
+    TileScanner tiles(parser, id);
+    GridView tile;
+    size_t count = 0;
+    while(tiles.next(tile))
+      count += tile.size();
+    ids.push_back(id);
+    sizes.push_back(count);
+  }
+
+  // Values read by one pass: sum, mean and variance (which takes the mean
+  // again) read each key 4 times, pearson reads both keys up to the shorter one
+  run.values = 0;
+  for(size_t i = 0 ; i < ids.size() ; ++i) {
+    run.values += 4 * sizes[i];
+    if(i + 1 < ids.size())
+      run.values += 2 * min(sizes[i], sizes[i + 1]);
+  }
+
+  clock_t best = 0;
+  for(int pass = 0 ; pass < PASSES ; ++pass) {
+    run.results.clear();
+    clock_t begin = clock();
+    for(size_t i = 0 ; i < ids.size() ; ++i) {
+      run.results.push_back(data.sum(ids[i]));
+      run.results.push_back(data.mean(ids[i]));
+      run.results.push_back(data.variance(ids[i]));
+      if(i + 1 < ids.size())
+        run.results.push_back(data.pearsons(ids[i], ids[i + 1]));
+    }
+    clock_t elapsed = clock() - begin;
+    if(pass == 0 || elapsed < best)
+      best = elapsed;
+  }
+  run.scanSecs = static_cast<double>(best) / CLOCKS_PER_SEC;
+}
+
+/**
+ * Report one way of holding the grids
+ */
+static void report(const char* name, const Run& run)
+{
+  size_t bytes = (run.packed > 0) ? run.packed : run.unpacked;
+  printf("%-12s %12lu bytes  parse %8.3f s  scan %8.3f s %14.0f values/s %10.1f MB/s\n", name,
+    static_cast<unsigned long>(bytes), run.parseSecs, run.scanSecs,
+    run.values / run.scanSecs, run.values * sizeof(double) / run.scanSecs / (1024.0 * 1024.0));
+}
+
+/**
+ * Count the results that are not bit-identical to those of the plain run
+ */
+static size_t mismatches(const Run& plain, const Run& run)
+{
+  size_t count = (plain.results.size() == run.results.size()) ? 0 : plain.results.size();
+  for(size_t i = 0 ; i < plain.results.size() && i < run.results.size() ; ++i) {
+    if(memcmp(&plain.results[i], &run.results[i], sizeof(double)) != 0)
+      count++;
+  }
+  if(count > 0)
+    printf("  MISMATCH: %lu results differ\n", static_cast<unsigned long>(count));
+  return count;
+}
+
+int main(int argc, char** argv)
+{
+  int first = 1;
+  double sparse = 0.0;
+  bool delta = false;
+  for( ; first < argc && strncmp(argv[first], "--", 2) == 0 ; ++first) {
+    if(strncmp(argv[first], "--sparse=", 9) == 0)
+      sparse = atof(argv[first] + 9);
+    else if(strcmp(argv[first], "--delta") == 0)
+      delta = true;
+    else
+      break;
+  }
+  if(argc <= first) {
+    fprintf(stderr, "Usage: %s [--sparse=density] [--delta] file [file...]\n", argv[0]);
+    return 1;
+  }
+
+  vector<string> files(argv + first, argv + argc);
+  Run plain, packed, tuned;
+  bench(files, false, 0.0, false, plain);
+  bench(files, true, 0.0, false, packed);
+
+  printf("%lu values, compression ratio %.2f\n", static_cast<unsigned long>(plain.unpacked / sizeof(double)),
+    static_cast<double>(packed.unpacked) / packed.packed);
+  report("plain", plain);
+  report("packed", packed);
+  size_t differ = mismatches(plain, packed);
+
+  if(sparse > 0.0 || delta) {
+    bench(files, true, sparse, delta, tuned);
+    report(delta ? ((sparse > 0.0) ? "sparse+delta" : "delta") : "sparse", tuned);
+    differ += mismatches(plain, tuned);
+  }
+
+  return (differ == 0) ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+/**
+ * ParseBench.cpp
+ *
+ * Benchmark for UTChemParser: generates output files at several scales
+ * (see OutputGenerator), parses each one reading lines and again scanning
+ * the mapped file, and reports CPU and wall time, MB/s, values/s and the
+ * peak resident set.
+ * Also verifies that every parsed value is bit-identical to what the
+ * generator wrote.
+ *
+ * Usage: parsebench [scale...]
+ *   scale   NX and NY of a file (default 32 64 128 256), each with 4 layers,
+ *           3 properties of 2 phases and 4 timesteps
+ *
+ * NOTE: Each case is parsed in a child process of its own, so the peak
+ *       resident set is that of the case alone (plus what the benchmark held
+ *       when it forked). On Windows the cases share the process and the
+ *       peak only grows, so scales run smallest first.
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../UTChemParser.h"
+#include "OutputGenerator.h"
+
+using namespace std;
+
+/**
+ * Compares each generated block with where the parser stored it
+ */
+class RoundTrip : public BlockSink
+{
+public:
+  RoundTrip(const ParserBase& parser)
+    : parser(parser), mismatches(0)
+  {
+  }
+
+  virtual void block(const string& key, const string& header, const double* vals, size_t n)
+  {
+    int id = parser.getKeyId(key);
+    GridView grid((id == KeyDictionary::NO_KEY) ? GridView() : parser.getView(id));
+    size_t& offset = offsets[key];
+    for(size_t i = 0 ; i < n ; ++i) {
+      if(offset + i >= grid.size() || memcmp(&grid[offset + i], &vals[i], sizeof(double)) != 0)
+        mismatches++;
+    }
+    offset += n;
+  }
+
+  /**
+   * Get the number of values that did not come back (or came back different)
+   */
+  size_t getMismatches() const
+  {
+    // Anything left over in a grid was never written
+    size_t extra = 0;
+    map<string, size_t>::const_iterator it;
+    for(it = offsets.begin() ; it != offsets.end() ; ++it) {
+      size_t parsed = parser.getView(it->first).size();
+      if(parsed > it->second)
+        extra += parsed - it->second;
+    }
+    return mismatches + extra;
+  }
+
+private:
+  const ParserBase& parser;
+  map<string, size_t> offsets; // Values of each key seen so far
+  size_t mismatches;
+};
+
+/**
+ * Peak resident set of this process so far (including its parent's pages
+ * at the time it was forked)
+ *
+ * @return  Size in MB
+ */
+static double peakResidentMB()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0.0;
+  return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0.0;
+  return usage.ru_maxrss / 1024.0; // Kilobytes
+#endif
+}
+
+/**
+ * Wall clock time
+ *
+ * @return  Seconds since some fixed point
+ */
+static double wallSeconds()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&frequency);
+  return static_cast<double>(count.QuadPart) / frequency.QuadPart;
+#else
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec / 1e6;
+#endif
+}
+
+/**
+ * Parse a generated file once and report it
+ *
+ * @param path        The file
+ * @param bytes       Size of the file
+ * @param generator   What wrote it
+ * @param mmap        If true, scan the mapped file rather than reading lines
+ * @return  True if every value round-tripped, false otherwise
+ */
+static bool parseOnce(const string& path, size_t bytes, const OutputGenerator& generator, bool mmap)
+{
+  ParserOptions options;
+  options.threads = 1; // Timings are CPU time
+  options.mmap = mmap;
+  UTChemParser parser(vector<string>(1, path), options);
+
+  double wallStart = wallSeconds();
+  clock_t start = clock();
+  bool parsed = parser.readFile();
+  double secs = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  double wall = wallSeconds() - wallStart;
+  double peak = peakResidentMB();
+  secs = max(secs, 1.0 / CLOCKS_PER_SEC);
+
+  RoundTrip check(parser);
+  generator.replay(check);
+  size_t mismatches = parsed ? check.getMismatches() : generator.values();
+
+  printf("  %-6s %8.3f s (wall %8.3f s) %10.1f MB/s %14.0f values/s  peak RSS %8.1f MB\n", mmap ? "mmap" : "lines",
+    secs, wall, bytes / secs / (1024.0 * 1024.0), generator.values() / secs, peak);
+  if(mismatches > 0)
+    printf("  MISMATCH: %lu values did not round-trip\n", static_cast<unsigned long>(mismatches));
+
+  return mismatches == 0;
+}
+
+/**
+ * Parse a generated file once in a child process and report it
+ *
+ * @param path        The file
+ * @param bytes       Size of the file
+ * @param generator   What wrote it
+ * @param mmap        If true, scan the mapped file rather than reading lines
+ * @return  True if every value round-tripped, false otherwise
+ */
+static bool bench(const string& path, size_t bytes, const OutputGenerator& generator, bool mmap)
+{
+#ifdef _WIN32
+  return parseOnce(path, bytes, generator, mmap);
+#else
+  fflush(stdout);
+  pid_t child = fork();
+  if(child < 0) {
+    perror("fork");
+    return false;
+  }
+  if(child == 0) {
+    bool ok = parseOnce(path, bytes, generator, mmap);
+    fflush(stdout);
+    _exit(ok ? 0 : 1);
+  }
+
+  int status = 0;
+  if(waitpid(child, &status, 0) != child)
+    return false;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+int main(int argc, char** argv)
+{
+  vector<unsigned> scales;
+  for(int i = 1 ; i < argc ; ++i)
+    scales.push_back(static_cast<unsigned>(atoi(argv[i])));
+  if(scales.empty()) {
+    scales.push_back(32);
+    scales.push_back(64);
+    scales.push_back(128);
+    scales.push_back(256);
+  }
+  sort(scales.begin(), scales.end());
+
+  bool ok = true;
+  for(size_t i = 0 ; i < scales.size() ; ++i) {
+    if(scales[i] == 0)
+      continue;
+
+    GeneratorOptions options;
+    options.nx = options.ny = scales[i];
+    options.nz = 4;
+    options.properties = 3;
+    options.phases = 2;
+    options.timesteps = 4;
+    OutputGenerator generator(options);
+
+    char path[64];
+    sprintf(path, "parsebench-%u.out", scales[i]);
+    if(!generator.write(path)) {
+      fprintf(stderr, "Could not write %s\n", path);
+      return 1;
+    }
+    ifstream file(path, ios::in | ios::binary | ios::ate);
+    size_t bytes = static_cast<size_t>(file.tellg());
+    file.close();
+
+    printf("%ux%ux%u: %lu values, %.1f MB\n", options.nx, options.ny, options.nz,
+      static_cast<unsigned long>(generator.values()), bytes / (1024.0 * 1024.0));
+    ok &= bench(path, bytes, generator, false);
+    ok &= bench(path, bytes, generator, true);
+
+    remove(path);
+  }
+
+  return ok ? 0 : 1;
+}
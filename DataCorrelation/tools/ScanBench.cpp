@@ -0,0 +1,163 @@
+/**
+ * ScanBench.cpp
+ *
+ * Benchmark for converting lines of values: the original sscanf("%lg%n")
+ * loop against ValueScanner.
+ * Also verifies that every conversion is bit-identical to sscanf, and that
+ * ValueScanner::countTokens() counts as many values, including lines of
+ * fixed-width fields with no gap between them.
+ *
+ * Usage: scanbench [count] [format]
+ *   count   Number of values to convert (default 2000000)
+ *   format  printf format used to write each value (default " %12.5E")
+ *
+ * @author Dennis J. McWherter, Jr.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS // Disable MSVC compiler warnings about secure methods
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../ValueScanner.h"
+
+#define VALUES_PER_LINE 8
+#define PASSES 3
+
+using namespace std;
+
+// Fixed-width fields that fill their width run into each other
+static const char* gluedLines[] = {
+  " 1.00000E+00-2.00000E+00",
+  " 0.1234-100 5.0",
+  "-1.25000E-03-4.50000E+02 6.00000E+01-7.00000E+00",
+  "  12345.6789-0.5+0.25   3"
+};
+
+/**
+ * Build lines of values the way UTChem writes them
+ *
+ * @param count   Number of values
+ * @param fmt     printf format for one value
+ * @param lines   Receives the lines (without newlines)
+ */
+static void generate(size_t count, const char* fmt, vector<string>& lines)
+{
+  char value[64];
+  string line;
+  srand(12345);
+  for(size_t i = 0 ; i < count ; ++i) {
+    // Mix of zeros, magnitudes and signs
+    double mag = static_cast<double>(rand()) / RAND_MAX;
+    int exp = (rand() % 12) - 6;
+    double val = (rand() % 5 == 0) ? 0.0 : mag * ((rand() % 2) ? 1 : -1);
+    while(exp > 0) { val *= 10; exp--; }
+    while(exp < 0) { val /= 10; exp++; }
+    sprintf(value, fmt, val);
+    line.append(value);
+    if((i + 1) % VALUES_PER_LINE == 0 || i + 1 == count) {
+      lines.push_back(line);
+      line.clear();
+    }
+  }
+}
+
+/**
+ * The original UTChemParser value loop
+ */
+static bool scanSscanf(const string& line, vector<double>& out)
+{
+  const char* lptr = line.c_str();
+  double nextVal;
+  int advance = 0;
+  while(lptr != NULL && *lptr != '\0' && *lptr != '\n' && *lptr != '\r') {
+    while(*lptr == ' ') lptr++; // eat whitespace
+    if(*lptr == '\0')
+      break;
+    if(1 != sscanf(lptr, "%lg%n", &nextVal, &advance))
+      return false;
+    lptr += advance;
+    out.push_back(nextVal);
+  }
+  return true;
+}
+
+/**
+ * Report a timing
+ */
+static void report(const char* name, size_t count, double secs)
+{
+  printf("%-10s %10.3f s %14.0f numbers/s\n", name, secs, count / secs);
+}
+
+int main(int argc, char** argv)
+{
+  size_t count = (argc > 1) ? static_cast<size_t>(atol(argv[1])) : 2000000;
+  const char* fmt = (argc > 2) ? argv[2] : " %12.5E";
+  vector<string> lines;
+  vector<double> expected, got;
+  bool ok = true;
+
+  generate(count, fmt, lines);
+  for(size_t i = 0 ; i < sizeof(gluedLines) / sizeof(gluedLines[0]) ; ++i)
+    lines.push_back(gluedLines[i]);
+  expected.reserve(count);
+  got.reserve(count);
+
+  printf("%lu values, format \"%s\"\n", static_cast<unsigned long>(count), fmt);
+
+  // Reference: sscanf
+  clock_t best = 0;
+  for(int pass = 0 ; pass < PASSES ; ++pass) {
+    expected.clear();
+    clock_t start = clock();
+    for(size_t i = 0 ; i < lines.size() ; ++i)
+      scanSscanf(lines[i], expected);
+    clock_t elapsed = clock() - start;
+    if(pass == 0 || elapsed < best)
+      best = elapsed;
+  }
+  report("sscanf", count, static_cast<double>(best) / CLOCKS_PER_SEC);
+
+  // Counting without converting must agree with sscanf line by line
+  size_t miscounted = 0;
+  for(size_t i = 0 ; i < lines.size() ; ++i) {
+    vector<double> vals;
+    scanSscanf(lines[i], vals);
+    if(ValueScanner::countTokens(lines[i].c_str(), lines[i].c_str() + lines[i].size()) != vals.size())
+      miscounted++;
+  }
+  if(miscounted > 0) {
+    printf("  MISCOUNT: %lu lines counted differently from sscanf\n", static_cast<unsigned long>(miscounted));
+    ok = false;
+  }
+
+  // ValueScanner
+  for(int pass = 0 ; pass < PASSES ; ++pass) {
+    got.clear();
+    clock_t start = clock();
+    for(size_t i = 0 ; i < lines.size() ; ++i)
+      ValueScanner::scanLine(lines[i].c_str(), lines[i].c_str() + lines[i].size(), got);
+    clock_t elapsed = clock() - start;
+    if(pass == 0 || elapsed < best)
+      best = elapsed;
+  }
+  report("scanner", count, static_cast<double>(best) / CLOCKS_PER_SEC);
+
+  // Bit-for-bit comparison against sscanf
+  size_t mismatches = (got.size() == expected.size()) ? 0 : count;
+  for(size_t i = 0 ; i < got.size() && i < expected.size() ; ++i) {
+    if(memcmp(&got[i], &expected[i], sizeof(double)) != 0)
+      mismatches++;
+  }
+  if(mismatches > 0) {
+    printf("  MISMATCH: %lu values differ from sscanf\n", static_cast<unsigned long>(mismatches));
+    ok = false;
+  }
+
+  return (ok) ? 0 : 1;
+}